@@ -3,6 +3,7 @@ import subprocess
 import os 
 import sys
 import os.path 
+import tempfile
 
 class OssecTester(object):
     def __init__(self):
@@ -13,16 +14,29 @@ class OssecTester(object):
         self._ossec_path = "/var/ossec/bin/"
         self._test_path = "./tests" 
 
-    def buildCmd(self, rule, alert, decoder):
+    def buildCmd(self, rule, alert, decoder, config=None):
         cmd = ['%s/ossec-logtest'%(self._ossec_path),] 
-        if self._ossec_conf: cmd += ["-c",self._ossec_conf]
+        if config: cmd += ["-c",config]
+        elif self._ossec_conf: cmd += ["-c",self._ossec_conf]
         if self._base_dir: cmd += ["-D", self._base_dir]
         cmd += ['-U', "%s:%s:%s"%(rule,alert,decoder)]
         return cmd
 
-    def runTest(self, log, rule, alert, decoder, section, name, negate=False):
-        print self.buildCmd(rule, alert, decoder)
-        p = subprocess.Popen(self.buildCmd(rule, alert, decoder),
+    def buildConf(self, rules):
+        # ossec.conf with only the rules of the test (the events
+        # of a log are correlated with each other only)
+        fd, conf = tempfile.mkstemp(suffix=".conf")
+        os.write(fd, "<ossec_config>\n  <rules>\n"
+                     "    <include>rules_config.xml</include>\n"
+                     "    <include>%s</include>\n"
+                     "  </rules>\n</ossec_config>\n"%(os.path.abspath(rules)))
+        os.close(fd)
+        return conf
+
+    def runTest(self, log, rule, alert, decoder, section, name, negate=False,
+                config=None):
+        print self.buildCmd(rule, alert, decoder, config)
+        p = subprocess.Popen(self.buildCmd(rule, alert, decoder, config),
                 stdout=subprocess.PIPE,
                 stderr=subprocess.STDOUT,
                 stdin=subprocess.PIPE,
@@ -57,6 +71,9 @@ class OssecTester(object):
                     rule = tGroup.get(t, "rule")
                     alert = tGroup.get(t, "alert")
                     decoder = tGroup.get(t, "decoder")
+                    config = None
+                    if tGroup.has_option(t, "rules"):
+                        config = self.buildConf(tGroup.get(t, "rules"))
                     for (name, value) in tGroup.items(t):
                         if name.startswith("log "):
                             if self._debug: 
@@ -67,7 +84,10 @@ class OssecTester(object):
                                 neg = True
                             else:
                                 neg = False 
-                            self.runTest(value, rule, alert, decoder, t, name, negate=neg)
+                            self.runTest(value, rule, alert, decoder, t, name, negate=neg,
+                                         config=config)
+                    if config:
+                        os.unlink(config)
                 print ""
 
 if __name__ == "__main__":
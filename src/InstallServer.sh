@@ -23,7 +23,7 @@ GROUP="ossec"
 USER="ossec"
 USER_MAIL="ossecm"
 USER_REM="ossecr"
-subdirs="logs logs/archives logs/alerts logs/firewall bin stats rules queue queue/alerts queue/ossec queue/fts queue/syscheck queue/rootcheck queue/diff queue/agent-info queue/agentless queue/rids tmp var var/run etc etc/shared active-response active-response/bin agentless .ssh"
+subdirs="logs logs/archives logs/alerts logs/firewall bin stats rules queue queue/alerts queue/ossec queue/fts queue/syscheck queue/rootcheck queue/diff queue/agent-info queue/agentless queue/rids queue/spool queue/logcollector tmp var var/run etc etc/shared active-response active-response/bin agentless .ssh"
 
 # ${DIR} must be set
 if [ "X${DIR}" = "X" ]; then
@@ -159,6 +159,10 @@ chmod 740 ${DIR}/queue/agent-info/* > /dev/null 2>&1
 chown -R ${USER_REM}:${GROUP} ${DIR}/queue/rids
 chmod -R 750 ${DIR}/queue/rids
 chmod 740 ${DIR}/queue/rids/* > /dev/null 2>&1
+chown -R ${USER_REM}:${GROUP} ${DIR}/queue/spool
+chmod -R 750 ${DIR}/queue/spool
+chmod 740 ${DIR}/queue/spool/* > /dev/null 2>&1
+chmod -R 750 ${DIR}/queue/logcollector
 
 chown -R ${USER}:${GROUP} ${DIR}/queue/agentless
 chmod -R 750 ${DIR}/queue/agentless
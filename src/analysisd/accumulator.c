@@ -127,25 +127,25 @@ Eventinfo* Accumulate(Eventinfo *lf)
         else {
             // Update the event
             do_update = 1;
-            if (acm_str_replace(&lf->dstuser,stored_data->dstuser) == 0)
+            if (acm_event_replace(lf, &lf->dstuser,stored_data->dstuser) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->dstuser to %s", _key, lf->dstuser);
 
-            if (acm_str_replace(&lf->srcuser,stored_data->srcuser) == 0)
+            if (acm_event_replace(lf, &lf->srcuser,stored_data->srcuser) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->srcuser to %s", _key, lf->srcuser);
 
-            if (acm_str_replace(&lf->dstip,stored_data->dstip) == 0)
+            if (acm_event_replace(lf, &lf->dstip,stored_data->dstip) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->dstip to %s", _key, lf->dstip);
 
-            if (acm_str_replace(&lf->srcip,stored_data->srcip) == 0)
+            if (acm_event_replace(lf, &lf->srcip,stored_data->srcip) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->srcip to %s", _key, lf->srcip);
 
-            if (acm_str_replace(&lf->dstport,stored_data->dstport) == 0)
+            if (acm_event_replace(lf, &lf->dstport,stored_data->dstport) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->dstport to %s", _key, lf->dstport);
 
-            if (acm_str_replace(&lf->srcport,stored_data->srcport) == 0)
+            if (acm_event_replace(lf, &lf->srcport,stored_data->srcport) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->srcport to %s", _key, lf->srcport);
 
-            if (acm_str_replace(&lf->data,stored_data->data) == 0)
+            if (acm_event_replace(lf, &lf->data,stored_data->data) == 0)
                 debug2("accumulator: DEBUG: (%s) updated lf->data to %s", _key, lf->data);
         }
     }
@@ -206,7 +206,7 @@ void Accumulate_CleanUp() {
     OSHashNode *curr;
     OS_ACM_Store *stored_data;
     char *key;
-    int ti;
+    unsigned int ti;
 
     // Keep track of how many times we're called
     acm_lookups++;
@@ -226,32 +226,31 @@ void Accumulate_CleanUp() {
     acm_purge_ts = current_ts;
 
     // Loop through the hash
-    for ( ti = 0; ti < acm_store->rows; ti++ ) {
-        curr = acm_store->table[ti];
-        while( curr != NULL ) {
-            // Get the Key and Data
-            key  = (char *) curr->key;
-            stored_data = (OS_ACM_Store *) curr->data;
-            // Increment to the next element
-            curr = curr->next;
-
-            debug2("accumulator: DEBUG: CleanUp() evaluating cached key: %s ", key);
-            /* check for a valid element */
-            if( stored_data != NULL ) {
-                /* Check for expiration */
-                debug2("accumulator: DEBUG: CleanUp() elm:%d, curr:%d", stored_data->timestamp, current_ts);
-                if( stored_data->timestamp < current_ts - OS_ACM_EXPIRE_ELM ) {
-                    debug2("accumulator: DEBUG: CleanUp() Expiring '%s'", key);
-                    if( OSHash_Delete(acm_store, key) != NULL ) {
-                        FreeACMStore(stored_data);
-                        expired++;
-                    }
-                    else {
-                        debug1("accumulator: DEBUG: CleanUp() failed to find key '%s'", key);
-                    }
+    curr = OSHash_Begin(acm_store, &ti);
+    while( curr != NULL ) {
+        // Get the Key and Data
+        key  = (char *) curr->key;
+        stored_data = (OS_ACM_Store *) curr->data;
+
+        debug2("accumulator: DEBUG: CleanUp() evaluating cached key: %s ", key);
+        /* check for a valid element */
+        if( stored_data != NULL ) {
+            /* Check for expiration */
+            debug2("accumulator: DEBUG: CleanUp() elm:%d, curr:%d", stored_data->timestamp, current_ts);
+            if( stored_data->timestamp < current_ts - OS_ACM_EXPIRE_ELM ) {
+                debug2("accumulator: DEBUG: CleanUp() Expiring '%s'", key);
+                if( OSHash_Delete(acm_store, key) != NULL ) {
+                    FreeACMStore(stored_data);
+                    expired++;
+                }
+                else {
+                    debug1("accumulator: DEBUG: CleanUp() failed to find key '%s'", key);
                 }
             }
         }
+
+        // Increment to the next element
+        curr = OSHash_Next(acm_store, &ti);
     }
     debug1("accumulator: DEBUG: Expired %d elements", expired);
 }
@@ -288,6 +287,27 @@ void FreeACMStore(OS_ACM_Store *obj) {
     }
 }
 
+/* Same as acm_str_replace, for the fields of the event
+ * (they may be on the event storage).
+ */
+int acm_event_replace(Eventinfo *lf, char **dst, const char *src) {
+    char *field = *dst;
+
+    // Don't overwrite something we already know
+    if (field != NULL && *field != '\0') {
+        return -1;
+    }
+
+    *dst = NULL;
+    if (acm_str_replace(dst, src) != 0) {
+        *dst = field;
+        return -1;
+    }
+
+    Free_EventField(lf, field);
+    return 0;
+}
+
 int acm_str_replace(char **dst, const char *src) {
     int result = 0;
 
@@ -51,6 +51,7 @@ void Accumulate_CleanUp();
 
 /* Internal Functions */
 int acm_str_replace(char **dst, const char* src);
+int acm_event_replace(Eventinfo *lf, char **dst, const char *src);
 OS_ACM_Store *InitACMStore();
 void FreeACMStore(OS_ACM_Store *obj);
 
@@ -35,25 +35,11 @@ static const char * _mk_NA( const char * p ){
 	return p ? p : "N/A";
 }
 
-/* StrIP2Long */
-/* Convert an dot-quad IP address into long format
- */
-unsigned long StrIP2Int(char *ip) {
-        unsigned int c1,c2,c3,c4;
-       /* IP address is not coming from user input -> We can trust it */
-       /* only minimal checking is performed */
-        int len = strlen(ip);
-        if ((len < 7) || (len > 15)) return 0;
-
-        sscanf(ip, "%d.%d.%d.%d", &c1, &c2, &c3, &c4);
-        return((unsigned long)c4+c3*256+c2*256*256+c1*256*256*256);
-}
-
-
 /* GeoIPLookup */
 /* Use the GeoIP API to locate an IP address
+ * ip_addr is the address already parsed (see Parse_EventIPs).
  */
-char *GeoIPLookup(char *ip)
+char *GeoIPLookup(char *ip, unsigned int ip_addr)
 {
 	GeoIP	*gi;
 	GeoIPRecord	*gir;
@@ -73,8 +59,8 @@ char *GeoIPLookup(char *ip)
 	else {
 		/* Use the IPv4 DB */
                 /* If we have a RFC1918 IP, do not perform a DB lookup (performance) */
-                longip = StrIP2Int(ip);
-                if (longip == 0 ) return("Unknown");
+                longip = ntohl(ip_addr);
+                if (longip == 0 || ip_addr == INADDR_NONE) return("Unknown");
                 if ((longip & NETMASK_8)  == RFC1918_10 ||
                     (longip & NETMASK_12) == RFC1918_172 ||
                     (longip & NETMASK_16) == RFC1918_192) return("");
@@ -182,8 +168,8 @@ void OS_LogOutput(Eventinfo *lf)
     geoip_msg_src[0] = '\0';
     geoip_msg_dst[0] = '\0';
     if (Config.loggeoip) {
- 	if (lf->srcip) { strncpy(geoip_msg_src, GeoIPLookup(lf->srcip), OS_SIZE_1024); }
-	if (lf->dstip) { strncpy(geoip_msg_dst, GeoIPLookup(lf->dstip), OS_SIZE_1024); }
+ 	if (lf->srcip) { strncpy(geoip_msg_src, GeoIPLookup(lf->srcip, lf->srcip_addr), OS_SIZE_1024); }
+	if (lf->dstip) { strncpy(geoip_msg_dst, GeoIPLookup(lf->dstip, lf->dstip_addr), OS_SIZE_1024); }
     }
 #endif
     printf(
@@ -269,8 +255,8 @@ void OS_Log(Eventinfo *lf)
     geoip_msg_src[0] = '\0';
     geoip_msg_dst[0] = '\0';
     if (Config.loggeoip) {
-        if (lf->srcip) { strncpy(geoip_msg_src, GeoIPLookup(lf->srcip), OS_SIZE_1024 ); }
-        if (lf->dstip) { strncpy(geoip_msg_dst, GeoIPLookup(lf->dstip), OS_SIZE_1024 ); }
+        if (lf->srcip) { strncpy(geoip_msg_src, GeoIPLookup(lf->srcip, lf->srcip_addr), OS_SIZE_1024 ); }
+        if (lf->dstip) { strncpy(geoip_msg_dst, GeoIPLookup(lf->dstip, lf->dstip_addr), OS_SIZE_1024 ); }
     }
 #endif
     /* Writting to the alert log file */
@@ -518,7 +504,7 @@ int FW_Log(Eventinfo *lf)
         /* block */
         case 'b':
         case 'B':
-            os_free(lf->action);
+            Free_EventField(lf, lf->action);
             os_strdup("DROP", lf->action);
             break;
         /* Closed */
@@ -527,7 +513,7 @@ int FW_Log(Eventinfo *lf)
         /* Teardown */
         case 't':
         case 'T':
-            os_free(lf->action);
+            Free_EventField(lf, lf->action);
             os_strdup("CLOSED", lf->action);
             break;
         /* allow, accept, */
@@ -539,23 +525,23 @@ int FW_Log(Eventinfo *lf)
         /* open */
         case 'o':
         case 'O':
-            os_free(lf->action);
+            Free_EventField(lf, lf->action);
             os_strdup("ALLOW", lf->action);
             break;
         default:
             if(OSMatch_Execute(lf->action,strlen(lf->action),&FWDROPpm))
             {
-                os_free(lf->action);
+                Free_EventField(lf, lf->action);
                 os_strdup("DROP", lf->action);
             }
             if(OSMatch_Execute(lf->action,strlen(lf->action),&FWALLOWpm))
             {
-                os_free(lf->action);
+                Free_EventField(lf, lf->action);
                 os_strdup("ALLOW", lf->action);
             }
             else
             {
-                os_free(lf->action);
+                Free_EventField(lf, lf->action);
                 os_strdup("UNKNOWN", lf->action);
             }
             break;
@@ -46,6 +46,7 @@
 #include "eventinfo.h"
 #include "accumulator.h"
 #include "analysisd.h"
+#include "receiver.h"
 
 #include "picviz.h"
 
@@ -577,6 +578,7 @@ void OS_ReadMSG_analysisd(int m_queue)
 
     /* Creating the event list */
     OS_CreateEventList(Config.memorysize);
+    OS_CreateEventIndexes();
 
 
     /* Initiating the FTS list */
@@ -694,9 +696,7 @@ void OS_ReadMSG_analysisd(int m_queue)
 
     /* Initializing the logs */
     {
-        lf = (Eventinfo *)calloc(1,sizeof(Eventinfo));
-        if(!lf)
-            ErrorExit(MEM_ERROR, ARGV0);
+        lf = Alloc_Eventinfo();
         lf->year = prev_year;
         strncpy(lf->mon, prev_month, 3);
         lf->day = today;
@@ -715,24 +715,38 @@ void OS_ReadMSG_analysisd(int m_queue)
     if(Config.custom_alert_output)
       debug1("%s: INFO: Custom output found.!",ARGV0);
 
-    /* Daemon loop */
-    while(1)
-    {
-        lf = (Eventinfo *)calloc(1,sizeof(Eventinfo));
 
-        /* This shouldn't happen .. */
-        if(lf == NULL)
+    /* Starting the receiver thread */
+    if(Config.input_queue_size > 0)
+    {
+        if(OS_StartReceiver(m_queue, Config.input_queue_size) < 0)
         {
-            ErrorExit(MEM_ERROR,ARGV0);
+            ErrorExit(THREAD_ERROR, ARGV0);
         }
+    }
+
+    /* Daemon loop */
+    while(1)
+    {
+        lf = Alloc_Eventinfo();
 
         DEBUG_MSG("%s: DEBUG: Waiting for msgs - %d ", ARGV0, (int)time(0));
 
 
-        /* Receive message from queue */
-        if((i = OS_RecvUnix(m_queue, OS_MAXSTR, msg)))
+        /* Receive message from queue (or from the receiver thread) */
+        if(Config.input_queue_size > 0)
+        {
+            i = OS_ReceiverGet(msg, OS_MAXSTR);
+        }
+        else
+        {
+            i = OS_ReceiverRead(m_queue, msg, OS_MAXSTR);
+        }
+
+        if(i)
         {
             RuleNode *rulenode_pt;
+            RuleNode **rules_pt;
 
             /* Getting the time we received the event */
             c_time = time(NULL);
@@ -861,6 +875,9 @@ void OS_ReadMSG_analysisd(int m_queue)
                 lf = Accumulate(lf);
             }
 
+            /* Parsing the ips once for all the rules */
+            Parse_EventIPs(lf);
+
             /* Firewall event */
             if(lf->decoder_info->type == FIREWALL)
             {
@@ -943,8 +960,24 @@ void OS_ReadMSG_analysisd(int m_queue)
             }
 
 
-            do
+            /* Only the rules that may match this decoder are checked.
+             * Alerts from other servers are not matched against the
+             * rules, so any rule will do for them.
+             */
+            if(lf->decoder_info->type == OSSEC_ALERT)
+            {
+                rules_pt = OS_GetRuleCandidates(NULL, RULES_ALL_DECODERS);
+            }
+            else
+            {
+                rules_pt = OS_GetRuleCandidates(NULL, lf->decoder_info->id);
+            }
+
+
+            for(; *rules_pt != NULL; rules_pt++)
             {
+                rulenode_pt = *rules_pt;
+
                 if(lf->decoder_info->type == OSSEC_ALERT)
                 {
                     if(!lf->generated_rule)
@@ -1133,12 +1166,13 @@ void OS_ReadMSG_analysisd(int m_queue)
                         i++;
                     }
                 }
+                OS_AddEventIndex(lf);
 
                 OS_AddEvent(lf);
 
                 break;
 
-            }while((rulenode_pt = rulenode_pt->next) != NULL);
+            }
 
 
             /* If configured to log all, do it */
@@ -1160,7 +1194,7 @@ void OS_ReadMSG_analysisd(int m_queue)
         }
         else
         {
-            free(lf);
+            Free_Eventinfo(lf);
         }
     }
     return;
@@ -1303,7 +1337,7 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node)
                 return(NULL);
             }
 
-            if(!OS_IPFoundList(lf->srcip, currently_rule->srcip))
+            if(!OS_IPFoundTreeAddr(lf->srcip_addr, currently_rule->srcip_tree))
             {
                 return(NULL);
             }
@@ -1320,7 +1354,7 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node)
                 return(NULL);
             }
 
-            if(!OS_IPFoundList(lf->dstip, currently_rule->dstip))
+            if(!OS_IPFoundTreeAddr(lf->dstip_addr, currently_rule->dstip_tree))
             {
                 return(NULL);
             }
@@ -1614,23 +1648,30 @@ RuleInfo *OS_CheckIfRuleMatch(Eventinfo *lf, RuleNode *curr_node)
     /* Search for dependent rules */
     if(curr_node->child)
     {
-        RuleNode *child_node = curr_node->child;
+        RuleNode **child_node;
         RuleInfo *child_rule = NULL;
+        int decoder_id = lf->decoder_info->id;
 
         #ifdef TESTRULE
         if(full_output && !alert_only)
-        print_out("       *Trying child rules.");
+        {
+            print_out("       *Trying child rules.");
+
+            /* Showing every child rule tried */
+            decoder_id = RULES_ALL_DECODERS;
+        }
         #endif
 
-        while(child_node)
+        child_node = OS_GetRuleCandidates(curr_node, decoder_id);
+        while(*child_node)
         {
-            child_rule = OS_CheckIfRuleMatch(lf, child_node);
+            child_rule = OS_CheckIfRuleMatch(lf, *child_node);
             if(child_rule != NULL)
             {
                 return(child_rule);
             }
 
-            child_node = child_node->next;
+            child_node++;
         }
     }
 
@@ -64,7 +64,7 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
     pieces++;
 
 
-    os_strdup(msg, lf->location);
+    lf->location = Dup_EventField(lf, msg, strlen(msg));
 
 
     /* Getting the log length */
@@ -72,7 +72,7 @@ int OS_CleanMSG(char *msg, Eventinfo *lf)
 
 
     /* Assigning the values in the strucuture (lf->full_log) */
-    os_malloc((2*loglen) +1, lf->full_log);
+    lf->full_log = Alloc_EventField(lf, (2*loglen) +1);
 
 
     /* Setting the whole message at full_log */
@@ -44,6 +44,7 @@ int GlobalConf(char * cfgfile)
     Config.picviz = 0;
     Config.prelude = 0;
     Config.memorysize = 1024;
+    Config.input_queue_size = 8192;
     Config.mailnotify = -1;
     Config.keeplogdate = 0;
     Config.syscheck_alert_new = 0;
@@ -827,7 +827,7 @@ int ReadDecodeXML(char *file)
         if(regex)
         {
             os_calloc(1, sizeof(OSRegex), pi->regex);
-            if(!OSRegex_Compile(regex, pi->regex, OS_RETURN_SUBSTRING))
+            if(!OSRegex_Compile(regex, pi->regex, OS_RETURN_OFFSET))
             {
                 merror(REGEX_COMPILE, ARGV0, regex, pi->regex->error);
                 return(0);
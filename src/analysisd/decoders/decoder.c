@@ -241,19 +241,17 @@ void DecodeEvent(Eventinfo *lf)
                 if(*regex_prev != '\0')
                     regex_prev++;
 
-                while(nnode->regex->sub_strings[i])
+                /* Copying the sub strings to the event storage
+                 * (only the ones we are going to use).
+                 */
+                while(nnode->regex->sub_offsets[i].offset != -1)
                 {
                     if(nnode->order[i])
                     {
-                        nnode->order[i](lf, nnode->regex->sub_strings[i]);
-                        nnode->regex->sub_strings[i] = NULL;
-                        i++;
-                        continue;
+                        nnode->order[i](lf, Dup_EventField(lf,
+                                     llog + nnode->regex->sub_offsets[i].offset,
+                                     nnode->regex->sub_offsets[i].size));
                     }
-
-                    /* We do not free any memory used above */
-                    os_free(nnode->regex->sub_strings[i]);
-                    nnode->regex->sub_strings[i] = NULL;
                     i++;
                 }
 
@@ -406,7 +404,7 @@ void *SystemName_FP(Eventinfo *lf, char *field)
 }
 void *None_FP(Eventinfo *lf, char *field)
 {
-    free(field);
+    /* The field is released with the event */
     return(NULL);
 }
 
@@ -118,7 +118,7 @@ void *OSSECAlert_Decoder_Exec(Eventinfo *lf)
     if(lf->hostname == lf->location)
     {
         snprintf(oa_newlocation, 255, "%s|%s", lf->location, oa_location);
-        free(lf->location);
+        Free_EventField(lf, lf->location);
         os_strdup(oa_newlocation, lf->location);
         lf->hostname = lf->location;
     }
@@ -126,7 +126,7 @@ void *OSSECAlert_Decoder_Exec(Eventinfo *lf)
     {
         snprintf(oa_newlocation, 255, "%s->%s|%s", lf->hostname,
                  lf->location, oa_location);
-        free(lf->location);
+        Free_EventField(lf, lf->location);
         os_strdup(oa_newlocation, lf->location);
         lf->hostname = lf->location;
     }
@@ -168,7 +168,7 @@ void *OSSECAlert_Decoder_Exec(Eventinfo *lf)
 
 
     /* Creating new full log. */
-    free(lf->full_log);
+    Free_EventField(lf, lf->full_log);
     os_strdup(tmp_str, lf->full_log);
     lf->log = lf->full_log;
 
@@ -674,7 +674,7 @@ int DB_Search(char *f_name, char *c_sum, Eventinfo *lf)
 
 
         /* Creating a new log message */
-        free(lf->full_log);
+        Free_EventField(lf, lf->full_log);
         os_strdup(sdb.comment, lf->full_log);
         lf->log = lf->full_log;
         lf->data = NULL;
@@ -708,7 +708,7 @@ int DB_Search(char *f_name, char *c_sum, Eventinfo *lf)
 
 
         /* Creating a new log message */
-        free(lf->full_log);
+        Free_EventField(lf, lf->full_log);
         os_strdup(sdb.comment, lf->full_log);
         lf->log = lf->full_log;
 
@@ -34,6 +34,7 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule)
     Eventinfo *lf;
     Eventinfo *first_lf;
     OSListNode *lf_node;
+    EventIndexNode *i_node = NULL;
 
 
     /* Setting frequency to 0 */
@@ -55,9 +56,33 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule)
     first_lf = (Eventinfo *)lf_node->data;
 
 
+    /* Only reading the events with the same context */
+    if(currently_rule->event_index)
+    {
+        i_node = OS_GetEventIndex(my_lf, currently_rule);
+        if(!i_node)
+        {
+            return(NULL);
+        }
+    }
+
+
     do
     {
-        lf = (Eventinfo *)lf_node->data;
+        if(i_node)
+        {
+            lf = i_node->event;
+
+            /* Newer events would have stopped the search */
+            if(!OS_IsEventIndexed(lf, currently_rule))
+            {
+                return(NULL);
+            }
+        }
+        else
+        {
+            lf = (Eventinfo *)lf_node->data;
+        }
 
         /* If time is outside the timeframe, return */
         if((c_time - lf->time) > currently_rule->timeframe)
@@ -91,6 +116,10 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule)
             if((!lf->srcip)||(!my_lf->srcip))
                 continue;
 
+            /* Different addresses can't be the same string */
+            if(lf->srcip_addr != my_lf->srcip_addr)
+                continue;
+
             if(strcmp(lf->srcip,my_lf->srcip) != 0)
                 continue;
         }
@@ -176,10 +205,14 @@ Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule)
         lf->matched = currently_rule->level;
         first_lf->matched = currently_rule->level;
 
+        OS_EventIndexMatched(lf);
+        OS_EventIndexMatched(first_lf);
+
         return(lf);
 
 
-    }while((lf_node = lf_node->prev) != NULL);
+    }while(i_node?((i_node = i_node->prev) != NULL):
+                  ((lf_node = lf_node->prev) != NULL));
 
     return(NULL);
 }
@@ -194,6 +227,7 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule)
     Eventinfo *lf;
     Eventinfo *first_lf;
     OSListNode *lf_node;
+    EventIndexNode *i_node = NULL;
 
 
     /* Setting frequency to 0 */
@@ -215,9 +249,33 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule)
     first_lf = (Eventinfo *)lf_node->data;
 
 
+    /* Only reading the events with the same context */
+    if(currently_rule->event_index)
+    {
+        i_node = OS_GetEventIndex(my_lf, currently_rule);
+        if(!i_node)
+        {
+            return(NULL);
+        }
+    }
+
+
     do
     {
-        lf = (Eventinfo *)lf_node->data;
+        if(i_node)
+        {
+            lf = i_node->event;
+
+            /* Newer events would have stopped the search */
+            if(!OS_IsEventIndexed(lf, currently_rule))
+            {
+                return(NULL);
+            }
+        }
+        else
+        {
+            lf = (Eventinfo *)lf_node->data;
+        }
 
         /* If time is outside the timeframe, return */
         if((c_time - lf->time) > currently_rule->timeframe)
@@ -251,6 +309,10 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule)
             if((!lf->srcip)||(!my_lf->srcip))
                 continue;
 
+            /* Different addresses can't be the same string */
+            if(lf->srcip_addr != my_lf->srcip_addr)
+                continue;
+
             if(strcmp(lf->srcip,my_lf->srcip) != 0)
                 continue;
         }
@@ -335,10 +397,14 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule)
         lf->matched = currently_rule->level;
         first_lf->matched = currently_rule->level;
 
+        OS_EventIndexMatched(lf);
+        OS_EventIndexMatched(first_lf);
+
         return(lf);
 
 
-    }while((lf_node = lf_node->prev) != NULL);
+    }while(i_node?((i_node = i_node->prev) != NULL):
+                  ((lf_node = lf_node->prev) != NULL));
 
     return(NULL);
 }
@@ -350,7 +416,7 @@ Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule)
  */
 Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule)
 {
-    EventNode *eventnode_pt;
+    int pos = 0;
     Eventinfo *lf;
     Eventinfo *first_lf;
 
@@ -359,8 +425,8 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule)
 
 
     /* Last events */
-    eventnode_pt = OS_GetLastEvent();
-    if(!eventnode_pt)
+    first_lf = OS_GetEvent(pos);
+    if(!first_lf)
     {
         /* Nothing found */
         return(NULL);
@@ -368,14 +434,12 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule)
 
     /* Setting frequency to 0 */
     currently_rule->__frequency = 0;
-    first_lf = (Eventinfo *)eventnode_pt->event;
+    lf = first_lf;
 
 
     /* Searching all previous events */
     do
     {
-        lf = eventnode_pt->event;
-
         /* If time is outside the timeframe, return */
         if((c_time - lf->time) > currently_rule->timeframe)
         {
@@ -435,6 +499,10 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule)
             if((!lf->srcip)||(!my_lf->srcip))
                 continue;
 
+            /* Different addresses can't be the same string */
+            if(lf->srcip_addr != my_lf->srcip_addr)
+                continue;
+
             if(strcmp(lf->srcip,my_lf->srcip) != 0)
                 continue;
         }
@@ -475,15 +543,54 @@ Eventinfo *Search_LastEvents(Eventinfo *my_lf, RuleInfo *currently_rule)
         lf->matched = currently_rule->level;
         first_lf->matched = currently_rule->level;
 
+        OS_EventIndexMatched(lf);
+        OS_EventIndexMatched(first_lf);
+
         return(lf);
 
-    }while((eventnode_pt = eventnode_pt->next) != NULL);
+    }while((lf = OS_GetEvent(++pos)) != NULL);
 
 
     return(NULL);
 }
 
 
+/* Released events, kept to be used again */
+static Eventinfo *_event_pool = NULL;
+static int _event_pool_size = 0;
+
+
+/* Get a new event. It comes from the pool when available,
+ * with its storage from the previous use (already empty).
+ */
+Eventinfo *Alloc_Eventinfo()
+{
+    Eventinfo *lf;
+    EventFields *fields;
+
+    if(!_event_pool)
+    {
+        os_calloc(1, sizeof(Eventinfo), lf);
+        return(lf);
+    }
+
+    lf = _event_pool;
+    _event_pool = lf->next_free;
+    _event_pool_size--;
+
+    fields = lf->fields;
+    memset(lf, 0, sizeof(Eventinfo));
+
+    lf->fields = fields;
+    if(lf->fields)
+    {
+        lf->fields->used = 0;
+    }
+
+    return(lf);
+}
+
+
 /* Zero the loginfo structure */
 void Zero_Eventinfo(Eventinfo *lf)
 {
@@ -508,8 +615,12 @@ void Zero_Eventinfo(Eventinfo *lf)
     lf->data = NULL;
     lf->systemname = NULL;
 
+    lf->srcip_addr = 0;
+    lf->dstip_addr = 0;
+
     lf->time = 0;
     lf->matched = 0;
+    lf->seq = 0;
 
     lf->year = 0;
     lf->mon[3] = '\0';
@@ -537,6 +648,28 @@ void Zero_Eventinfo(Eventinfo *lf)
     return;
 }
 
+/* Parse the srcip/dstip
+ * Done once, after the decoders, for the rules and the
+ * correlation to compare the addresses as integers.
+ */
+void Parse_EventIPs(Eventinfo *lf)
+{
+    lf->srcip_addr = 0;
+    lf->dstip_addr = 0;
+
+    if(lf->srcip)
+    {
+        lf->srcip_addr = inet_addr(lf->srcip);
+    }
+
+    if(lf->dstip)
+    {
+        lf->dstip_addr = inet_addr(lf->dstip);
+    }
+
+    return;
+}
+
 /* Free the loginfo structure */
 void Free_Eventinfo(Eventinfo *lf)
 {
@@ -546,63 +679,57 @@ void Free_Eventinfo(Eventinfo *lf)
         return;
     }
 
-    if(lf->full_log)
-        free(lf->full_log);
-    if(lf->location)
-        free(lf->location);
+    /* Removing from the correlation indexes (needs the fields) */
+    OS_RemoveEventIndex(lf);
+
+    /* The strings may be on the event storage */
+    Free_EventField(lf, lf->full_log);
+    Free_EventField(lf, lf->location);
+
+    Free_EventField(lf, lf->srcip);
+    Free_EventField(lf, lf->dstip);
+    Free_EventField(lf, lf->srcport);
+    Free_EventField(lf, lf->dstport);
+    Free_EventField(lf, lf->protocol);
+    Free_EventField(lf, lf->action);
+    Free_EventField(lf, lf->status);
+    Free_EventField(lf, lf->srcuser);
+    Free_EventField(lf, lf->dstuser);
+    Free_EventField(lf, lf->id);
+    Free_EventField(lf, lf->command);
+    Free_EventField(lf, lf->url);
+
+    Free_EventField(lf, lf->data);
+    Free_EventField(lf, lf->systemname);
+
+    Free_EventField(lf, lf->filename);
+    Free_EventField(lf, lf->md5_before);
+    Free_EventField(lf, lf->md5_after);
+    Free_EventField(lf, lf->sha1_before);
+    Free_EventField(lf, lf->sha1_after);
+    Free_EventField(lf, lf->size_before);
+    Free_EventField(lf, lf->size_after);
+    Free_EventField(lf, lf->owner_before);
+    Free_EventField(lf, lf->owner_after);
+    Free_EventField(lf, lf->gowner_before);
+    Free_EventField(lf, lf->gowner_after);
+
+    /* Freeing the event storage. Only the first block is
+     * kept (if it has the default size).
+     */
+    while(lf->fields)
+    {
+        EventFields *next = lf->fields->next;
 
-    if(lf->srcip)
-        free(lf->srcip);
-    if(lf->dstip)
-        free(lf->dstip);
-    if(lf->srcport)
-        free(lf->srcport);
-    if(lf->dstport)
-        free(lf->dstport);
-    if(lf->protocol)
-        free(lf->protocol);
-    if(lf->action)
-        free(lf->action);
-    if(lf->status)
-        free(lf->status);
-    if(lf->srcuser)
-        free(lf->srcuser);
-    if(lf->dstuser)
-        free(lf->dstuser);
-    if(lf->id)
-        free(lf->id);
-    if(lf->command)
-        free(lf->command);
-    if(lf->url)
-        free(lf->url);
-
-    if(lf->data)
-        free(lf->data);
-    if(lf->systemname)
-        free(lf->systemname);
-
-    if(lf->filename)
-        free(lf->filename);
-    if (lf->md5_before)
-        free(lf->md5_before);
-    if (lf->md5_after)
-        free(lf->md5_after);
-    if (lf->sha1_before)
-        free(lf->sha1_before);
-    if (lf->sha1_after)
-        free(lf->sha1_after);
-    if (lf->size_before)
-        free(lf->size_before);
-    if (lf->size_after)
-        free(lf->size_after);
-    if (lf->owner_before)
-        free(lf->owner_before);
-    if (lf->owner_after)
-        free(lf->owner_after);
-    if (lf->gowner_before)
-        free(lf->gowner_before);
-    if (lf->gowner_after)
-        free(lf->gowner_after);
+        if(!next && (lf->fields->size == EVENT_FIELDS_SIZE) &&
+           (_event_pool_size < EVENT_POOL_SIZE))
+        {
+            break;
+        }
+
+        free(lf->fields);
+        lf->fields = next;
+    }
 
     /* Freeing node to delete */
     if(lf->sid_node_to_delete)
@@ -625,10 +752,94 @@ void Free_Eventinfo(Eventinfo *lf)
      * fts
      * comment
      */
+
+    /* Keeping the event to be used again */
+    if(_event_pool_size < EVENT_POOL_SIZE)
+    {
+        lf->next_free = _event_pool;
+        _event_pool = lf;
+        _event_pool_size++;
+        return;
+    }
+
     free(lf);
     lf = NULL;
 
     return;
 }
 
+/* Get size bytes from the event storage.
+ * The storage grows (in a new block) if the event
+ * has too many strings.
+ */
+char *Alloc_EventField(Eventinfo *lf, int size)
+{
+    char *field;
+
+    if(!lf->fields || (lf->fields->used + size > lf->fields->size))
+    {
+        int b_size = EVENT_FIELDS_SIZE;
+        EventFields *block;
+
+        if(size > b_size)
+        {
+            b_size = size;
+        }
+
+        /* The block and its buffer on the same allocation */
+        os_malloc(sizeof(EventFields) + b_size, block);
+        block->buf = (char *)(block + 1);
+        block->size = b_size;
+        block->used = 0;
+        block->next = lf->fields;
+
+        lf->fields = block;
+    }
+
+    field = lf->fields->buf + lf->fields->used;
+    lf->fields->used += size;
+
+    return(field);
+}
+
+
+/* Copy a decoded field (size bytes of str) to the event storage */
+char *Dup_EventField(Eventinfo *lf, char *str, int size)
+{
+    char *field;
+
+    field = Alloc_EventField(lf, size + 1);
+    memcpy(field, str, size);
+    field[size] = '\0';
+
+    return(field);
+}
+
+
+/* Free a field of the event, unless it is on the event storage
+ * (it is going to be released with the event).
+ */
+void Free_EventField(Eventinfo *lf, char *field)
+{
+    EventFields *block = lf->fields;
+
+    if(!field)
+    {
+        return;
+    }
+
+    while(block)
+    {
+        if((field >= block->buf) && (field < block->buf + block->size))
+        {
+            return;
+        }
+        block = block->next;
+    }
+
+    free(field);
+    return;
+}
+
+
 /* EOF */
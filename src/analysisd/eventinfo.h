@@ -20,6 +20,28 @@
 #include "decoders/decoder.h"
 
 
+/* Default size of the storage for the event strings */
+#define EVENT_FIELDS_SIZE   2048
+
+
+/* Maximum number of released events kept for reuse */
+#define EVENT_POOL_SIZE     1024
+
+
+/* Storage for the strings of the event (the log and
+ * the fields extracted by the decoders).
+ * Each event has one (more if it gets full) and
+ * everything is released together with the event.
+ */
+typedef struct _EventFields
+{
+    char *buf;
+    int size;
+    int used;
+    struct _EventFields *next;
+}EventFields;
+
+
 /* Event Information structure */
 typedef struct _Eventinfo
 {
@@ -47,6 +69,10 @@ typedef struct _Eventinfo
     char *data;
     char *systemname;
 
+    /* srcip/dstip parsed once (network order, 0 if not an ip) */
+    unsigned int srcip_addr;
+    unsigned int dstip_addr;
+
 
     /* Pointer to the rule that generated it */
     RuleInfo *generated_rule;
@@ -57,6 +83,15 @@ typedef struct _Eventinfo
     /* Sid node to delete */
     OSListNode *sid_node_to_delete;
 
+    /* Strings storage */
+    EventFields *fields;
+
+    /* Next event on the pool (when released) */
+    struct _Eventinfo *next_free;
+
+    /* Order it was added to the previous events (0 if not) */
+    unsigned int seq;
+
     /* Extract when the event fires a rule */
     int size;
     int p_name_size;
@@ -88,13 +123,28 @@ typedef struct _Eventinfo
 }Eventinfo;
 
 
-/* Events List structure */
-typedef struct _EventNode
+
+/* Correlation index (events with the same context) */
+typedef struct _EventIndexNode
 {
     Eventinfo *event;
-    struct _EventNode *next;
-    struct _EventNode *prev;
-}EventNode;
+    struct _EventIndexNode *next;
+    struct _EventIndexNode *prev;
+}EventIndexNode;
+
+typedef struct _EventIndexKey
+{
+    EventIndexNode *first;
+    EventIndexNode *last;
+}EventIndexKey;
+
+typedef struct _EventIndex
+{
+    OSHash *keys;
+    OSList *list;
+    int has_barrier;
+    unsigned int barrier;
+}EventIndex;
 
 
 
@@ -138,22 +188,54 @@ Eventinfo *Search_LastEvents(Eventinfo *lf, RuleInfo *currently_rule);
 Eventinfo *Search_LastSids(Eventinfo *my_lf, RuleInfo *currently_rule);
 Eventinfo *Search_LastGroups(Eventinfo *my_lf, RuleInfo *currently_rule);
 
+/* Get a new event (reused if available) */
+Eventinfo *Alloc_Eventinfo();
+
 /* Zero the eventinfo structure */
 void Zero_Eventinfo(Eventinfo *lf);
 
+/* Parse the srcip/dstip (after the decoders) */
+void Parse_EventIPs(Eventinfo *lf);
+
 /* Free the eventinfo structure */
 void Free_Eventinfo(Eventinfo *lf);
 
+/* Get size bytes from the event storage */
+char *Alloc_EventField(Eventinfo *lf, int size);
+
+/* Copy a decoded field (size bytes of str) to the event storage */
+char *Dup_EventField(Eventinfo *lf, char *str, int size);
+
+/* Free a field of the event (if not on the event storage) */
+void Free_EventField(Eventinfo *lf, char *field);
+
 /* Add and event to the list of previous events */
 void OS_AddEvent(Eventinfo *lf);
 
-/* Return the last event from the Event list */
-EventNode *OS_GetLastEvent();
+/* Return the event at position pos (0 is the last one added) */
+Eventinfo *OS_GetEvent(int pos);
 
 /* Create the event list. Maxsize must be specified */
 void OS_CreateEventList(int maxsize);
 
 
+/* Create the correlation indexes (after the rules are read) */
+void OS_CreateEventIndexes();
+
+/* Add/remove an event to/from the indexes of its lists */
+void OS_AddEventIndex(Eventinfo *lf);
+void OS_RemoveEventIndex(Eventinfo *lf);
+
+/* Get the newest indexed event with the same context */
+EventIndexNode *OS_GetEventIndex(Eventinfo *my_lf, RuleInfo *rule);
+
+/* Check if the event is newer than the last one matched */
+int OS_IsEventIndexed(Eventinfo *lf, RuleInfo *rule);
+
+/* Update the indexes after the matched level changes */
+void OS_EventIndexMatched(Eventinfo *lf);
+
+
 /* Pointers to the event decoders */
 void *SrcUser_FP(Eventinfo *lf, char *field);
 void *DstUser_FP(Eventinfo *lf, char *field);
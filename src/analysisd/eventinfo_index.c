@@ -0,0 +1,502 @@
+/* @(#) $Id: ./src/analysisd/eventinfo_index.c, 2012/08/06 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All rights reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ *
+ * License details at the LICENSE file included with OSSEC or
+ * online at: http://www.ossec.net/en/licensing.html
+ */
+
+
+/* Correlation indexes.
+ * Rules with if_matched_sid/if_matched_group and same_* options
+ * keep their previous events indexed by these fields, so that
+ * Search_LastSids/Search_LastGroups only read the events with
+ * the same context (instead of the whole list).
+ */
+
+
+#include "shared.h"
+#include "rules.h"
+#include "eventinfo.h"
+
+
+/* Rules with an index */
+RuleInfo **_index_rules = NULL;
+int _index_rules_size = 0;
+
+/* Order of the events added to the lists */
+unsigned int _index_seq = 0;
+
+/* Released index nodes, to be used again */
+EventIndexNode *_index_free = NULL;
+
+
+/* Event "a" added to the lists before (or with) "b" */
+#define SEQ_BEFORE(a,b) ((int)((a) - (b)) <= 0)
+
+
+
+/* _OS_EventKey: Gets the key of the event (the fields
+ * the rule correlates on). Returns 0 if any of them
+ * is not set (the event never matches on this rule).
+ */
+static int _OS_EventKey(Eventinfo *lf, RuleInfo *rule, char *key, int size)
+{
+    int i = 0;
+    char *fields[6];
+    char *pt = key;
+
+    if(rule->context_opts & SAME_ID)
+    {
+        fields[i++] = lf->id;
+    }
+    if(rule->context_opts & SAME_SRCIP)
+    {
+        fields[i++] = lf->srcip;
+    }
+
+    if(rule->alert_opts & SAME_EXTRAINFO)
+    {
+        if(rule->context_opts & SAME_SRCPORT)
+        {
+            fields[i++] = lf->srcport;
+        }
+        if(rule->context_opts & SAME_DSTPORT)
+        {
+            fields[i++] = lf->dstport;
+        }
+        if(rule->context_opts & SAME_USER)
+        {
+            fields[i++] = lf->dstuser;
+        }
+        if(rule->context_opts & SAME_LOCATION)
+        {
+            fields[i++] = lf->hostname;
+        }
+    }
+
+
+    /* Fields are separated by '|'. Different events may get the
+     * same key (or a truncated one), so the search still
+     * compares all the fields.
+     */
+    while(i > 0)
+    {
+        int f_size;
+
+        i--;
+        if(!fields[i])
+        {
+            return(0);
+        }
+
+        f_size = snprintf(pt, size, "%s|", fields[i]);
+        if(f_size >= size)
+        {
+            break;
+        }
+
+        pt += f_size;
+        size -= f_size;
+    }
+
+    return(1);
+}
+
+
+
+/* _OS_IndexAdd: Adds the event to the end of the index */
+static void _OS_IndexAdd(RuleInfo *rule, Eventinfo *lf)
+{
+    char key[OS_SIZE_1024 +1];
+    EventIndexKey *i_key;
+    EventIndexNode *i_node;
+
+    /* Events before the last matched are never read */
+    if(lf->matched >= rule->level)
+    {
+        rule->event_index->barrier = lf->seq;
+        rule->event_index->has_barrier = 1;
+    }
+
+    if(!_OS_EventKey(lf, rule, key, OS_SIZE_1024))
+    {
+        return;
+    }
+
+    i_key = (EventIndexKey *)OSHash_Get(rule->event_index->keys, key);
+    if(!i_key)
+    {
+        os_calloc(1, sizeof(EventIndexKey), i_key);
+        if(OSHash_Add(rule->event_index->keys, key, i_key) != 2)
+        {
+            merror(MEM_ERROR, ARGV0);
+            free(i_key);
+            return;
+        }
+    }
+
+    if(_index_free)
+    {
+        i_node = _index_free;
+        _index_free = _index_free->next;
+    }
+    else
+    {
+        os_calloc(1, sizeof(EventIndexNode), i_node);
+    }
+
+    i_node->event = lf;
+    i_node->next = NULL;
+    i_node->prev = i_key->last;
+
+    if(i_key->last)
+    {
+        i_key->last->next = i_node;
+    }
+    else
+    {
+        i_key->first = i_node;
+    }
+    i_key->last = i_node;
+
+    return;
+}
+
+
+
+/* _OS_IndexRemove: Removes the event from the index */
+static void _OS_IndexRemove(RuleInfo *rule, Eventinfo *lf)
+{
+    char key[OS_SIZE_1024 +1];
+    EventIndexKey *i_key;
+    EventIndexNode *i_node;
+
+    if(!_OS_EventKey(lf, rule, key, OS_SIZE_1024))
+    {
+        return;
+    }
+
+    i_key = (EventIndexKey *)OSHash_Get(rule->event_index->keys, key);
+    if(!i_key)
+    {
+        return;
+    }
+
+    /* It is usually the oldest one */
+    i_node = i_key->first;
+    while(i_node && (i_node->event != lf))
+    {
+        i_node = i_node->next;
+    }
+
+    if(!i_node)
+    {
+        return;
+    }
+
+    if(i_node->prev)
+        i_node->prev->next = i_node->next;
+    else
+        i_key->first = i_node->next;
+
+    if(i_node->next)
+        i_node->next->prev = i_node->prev;
+    else
+        i_key->last = i_node->prev;
+
+    i_node->event = NULL;
+    i_node->prev = NULL;
+    i_node->next = _index_free;
+    _index_free = i_node;
+
+
+    /* No more events with this key */
+    if(!i_key->first)
+    {
+        OSHash_Delete(rule->event_index->keys, key);
+        free(i_key);
+    }
+
+    return;
+}
+
+
+
+/* _OS_CreateIndexes: Creates the index for the rules
+ * that can use one (and for its children).
+ */
+static void _OS_CreateIndexes(RuleNode *node)
+{
+    while(node)
+    {
+        RuleInfo *rule = node->ruleinfo;
+        OSList *list = NULL;
+
+        if(rule->event_search == (void *)Search_LastSids)
+        {
+            list = rule->sid_search;
+        }
+        else if(rule->event_search == (void *)Search_LastGroups)
+        {
+            list = rule->group_search;
+        }
+
+        /* Only if there is something to index on and no
+         * different_url (that is not an equality). A rule
+         * may be the child of many others (indexed only once).
+         */
+        if(list && !rule->event_index &&
+           !((rule->alert_opts & SAME_EXTRAINFO) &&
+             (rule->context_opts & DIFFERENT_URL)) &&
+           ((rule->context_opts & (SAME_ID|SAME_SRCIP)) ||
+            ((rule->alert_opts & SAME_EXTRAINFO) &&
+             (rule->context_opts & (SAME_SRCPORT|SAME_DSTPORT|
+                                    SAME_USER|SAME_LOCATION)))))
+        {
+            os_calloc(1, sizeof(EventIndex), rule->event_index);
+            rule->event_index->list = list;
+            rule->event_index->keys = OSHash_Create();
+            if(!rule->event_index->keys)
+            {
+                ErrorExit(MEM_ERROR, ARGV0);
+            }
+
+            os_realloc(_index_rules, (_index_rules_size +1) * sizeof(RuleInfo *),
+                       _index_rules);
+            _index_rules[_index_rules_size] = rule;
+            _index_rules_size++;
+        }
+
+        if(node->child)
+        {
+            _OS_CreateIndexes(node->child);
+        }
+
+        node = node->next;
+    }
+
+    return;
+}
+
+
+
+/* OS_CreateEventIndexes: Creates the correlation indexes.
+ * Must be called after all the rules are read.
+ */
+void OS_CreateEventIndexes()
+{
+    _OS_CreateIndexes(OS_GetFirstRule());
+
+    debug1("%s: DEBUG: Correlation indexes created: %d.", ARGV0,
+           _index_rules_size);
+    return;
+}
+
+
+
+/* OS_AddEventIndex: Adds the event to the indexes of the
+ * lists it was added to (the state memory of its rule).
+ */
+void OS_AddEventIndex(Eventinfo *lf)
+{
+    int i, j;
+    RuleInfo *rule = lf->generated_rule;
+
+    if(!_index_rules_size || !rule)
+    {
+        return;
+    }
+
+    _index_seq++;
+    if(_index_seq == 0)
+    {
+        _index_seq++;
+    }
+    lf->seq = _index_seq;
+
+    for(i = 0; i < _index_rules_size; i++)
+    {
+        OSList *list = _index_rules[i]->event_index->list;
+
+        if(lf->sid_node_to_delete)
+        {
+            if(list == rule->sid_prev_matched)
+            {
+                _OS_IndexAdd(_index_rules[i], lf);
+            }
+        }
+        else if(!rule->sid_prev_matched && rule->group_prev_matched)
+        {
+            for(j = 0; j < rule->group_prev_matched_sz; j++)
+            {
+                if(list == rule->group_prev_matched[j])
+                {
+                    _OS_IndexAdd(_index_rules[i], lf);
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+
+
+/* OS_RemoveEventIndex: Removes from the indexes the events
+ * that Free_Eventinfo is going to remove from the lists.
+ */
+void OS_RemoveEventIndex(Eventinfo *lf)
+{
+    int i, j;
+    RuleInfo *rule = lf->generated_rule;
+
+    if(!_index_rules_size || !rule)
+    {
+        return;
+    }
+
+    for(i = 0; i < _index_rules_size; i++)
+    {
+        OSList *list = _index_rules[i]->event_index->list;
+
+        if(lf->sid_node_to_delete)
+        {
+            if(list == rule->sid_prev_matched)
+            {
+                _OS_IndexRemove(_index_rules[i], lf);
+            }
+        }
+
+        /* The oldest event is removed from each group list */
+        else if(rule->group_prev_matched)
+        {
+            for(j = 0; j < rule->group_prev_matched_sz; j++)
+            {
+                if((list == rule->group_prev_matched[j]) &&
+                   list->first_node)
+                {
+                    _OS_IndexRemove(_index_rules[i],
+                                    (Eventinfo *)list->first_node->data);
+                }
+            }
+        }
+    }
+
+    return;
+}
+
+
+
+/* OS_GetEventIndex: Gets the newest event with the same
+ * context of my_lf. Returns NULL if there is none.
+ */
+EventIndexNode *OS_GetEventIndex(Eventinfo *my_lf, RuleInfo *rule)
+{
+    char key[OS_SIZE_1024 +1];
+    EventIndexKey *i_key;
+
+    if(!_OS_EventKey(my_lf, rule, key, OS_SIZE_1024))
+    {
+        return(NULL);
+    }
+
+    i_key = (EventIndexKey *)OSHash_Get(rule->event_index->keys, key);
+    if(!i_key)
+    {
+        return(NULL);
+    }
+
+    return(i_key->last);
+}
+
+
+
+/* OS_IsEventIndexed: Checks if the event is after the newest
+ * event (on the list) that matched a rule with the same
+ * or higher level. The list search stops on that one.
+ */
+int OS_IsEventIndexed(Eventinfo *lf, RuleInfo *rule)
+{
+    if(rule->event_index->has_barrier &&
+       SEQ_BEFORE(lf->seq, rule->event_index->barrier))
+    {
+        return(0);
+    }
+
+    return(1);
+}
+
+
+
+/* OS_EventIndexMatched: Must be called when the matched level
+ * of an event on the lists changes.
+ */
+void OS_EventIndexMatched(Eventinfo *lf)
+{
+    int i, j;
+    RuleInfo *rule = lf->generated_rule;
+
+    /* Not on the lists */
+    if(!_index_rules_size || !rule || !lf->seq)
+    {
+        return;
+    }
+
+    for(i = 0; i < _index_rules_size; i++)
+    {
+        OSList *list = _index_rules[i]->event_index->list;
+        int on_list = 0;
+
+        if(lf->matched < _index_rules[i]->level)
+        {
+            continue;
+        }
+
+        if(lf->sid_node_to_delete)
+        {
+            if(list == rule->sid_prev_matched)
+            {
+                on_list = 1;
+            }
+        }
+        else if(!rule->sid_prev_matched && rule->group_prev_matched)
+        {
+            for(j = 0; j < rule->group_prev_matched_sz; j++)
+            {
+                /* It may already have been removed (oldest first) */
+                if((list == rule->group_prev_matched[j]) &&
+                   list->first_node &&
+                   SEQ_BEFORE(((Eventinfo *)list->first_node->data)->seq,
+                              lf->seq))
+                {
+                    on_list = 1;
+                }
+            }
+        }
+
+        if(!on_list)
+        {
+            continue;
+        }
+
+        if(!_index_rules[i]->event_index->has_barrier ||
+           SEQ_BEFORE(_index_rules[i]->event_index->barrier, lf->seq))
+        {
+            _index_rules[i]->event_index->barrier = lf->seq;
+            _index_rules[i]->event_index->has_barrier = 1;
+        }
+    }
+
+    return;
+}
+
+
+/* EOF */
@@ -18,8 +18,13 @@
 #include "eventinfo.h"
 
 
-EventNode *eventnode;
-EventNode *lastnode;
+/* Previous events. Ring buffer with the newest event
+ * at _event_last and the oldest at _event_first.
+ */
+Eventinfo **_event_ring = NULL;
+int _event_ring_size = 0;
+int _event_first = 0;
+int _event_last = -1;
 
 int _memoryused = 0;
 int _memorymaxsize = 0;
@@ -29,94 +34,81 @@ int _max_freq = 0;
 /* Create the Event List */
 void OS_CreateEventList(int maxsize)
 {
-    eventnode = NULL;
-
     _memorymaxsize = maxsize;
 
+    /* The new event is added before removing the old ones */
+    _event_ring_size = maxsize + 1;
+    os_calloc(_event_ring_size, sizeof(Eventinfo *), _event_ring);
+
+    _event_first = 0;
+    _event_last = -1;
     _memoryused = 0;
 
     debug1("%s: OS_CreateEventList completed.", ARGV0);
     return;
 }
 
-/* Get the last event -- or first node */
-EventNode *OS_GetLastEvent()
+/* Get the event at position pos (0 is the last event added).
+ * Returns NULL if there are not that many events.
+ */
+Eventinfo *OS_GetEvent(int pos)
 {
-    EventNode *eventnode_pt = eventnode;
+    if(pos >= _memoryused)
+    {
+        return(NULL);
+    }
+
+    pos = _event_last - pos;
+    if(pos < 0)
+    {
+        pos += _event_ring_size;
+    }
 
-    return(eventnode_pt);
+    return(_event_ring[pos]);
 }
 
 /* Add an event to the list -- always to the begining */
 void OS_AddEvent(Eventinfo *lf)
 {
-    EventNode *tmp_node = eventnode;
-
-    if(tmp_node)
+    _event_last++;
+    if(_event_last == _event_ring_size)
     {
-        EventNode *new_node;
-        new_node = (EventNode *)calloc(1,sizeof(EventNode));
-
-        if(new_node == NULL)
-        {
-            ErrorExit(MEM_ERROR,ARGV0);
-        }
-
-        /* Always adding to the beginning of the list
-         * The new node will become the first node and
-         * new_node->next will be the previous first node
-         */
-        new_node->next = tmp_node;
-        new_node->prev = NULL;
-        tmp_node->prev = new_node;
+        _event_last = 0;
+    }
 
-        eventnode = new_node;
+    _event_ring[_event_last] = lf;
+    _memoryused++;
 
-        /* Adding the event to the node */
-        new_node->event = lf;
 
-        _memoryused++;
+    /* Need to remove the oldest events */
+    if(_memoryused > _memorymaxsize)
+    {
+        int i = 0;
+        Eventinfo *oldest;
 
-        /* Need to remove the last nodes */
-        if(_memoryused > _memorymaxsize)
+        /* Remove at least the last 10 events
+         * or the events that will not match anymore
+         * (higher than max frequency)
+         */
+        while((_memoryused > 1) &&
+              ((i < 10)||
+               ((lf->time - _event_ring[_event_first]->time) > _max_freq)))
         {
-            int i = 0;
-            EventNode *oldlast;
-
-            /* Remove at least the last 10 events
-             * or the events that will not match anymore
-             * (higher than max frequency)
-             */
-            while((i < 10)||((lf->time - lastnode->event->time) > _max_freq))
-            {
-                oldlast = lastnode;
-                lastnode = lastnode->prev;
-                lastnode->next = NULL;
-
-                /* Free event info */
-                Free_Eventinfo(oldlast->event);
-                free(oldlast);
+            oldest = _event_ring[_event_first];
+            _event_ring[_event_first] = NULL;
 
-                _memoryused--;
-                i++;
+            _event_first++;
+            if(_event_first == _event_ring_size)
+            {
+                _event_first = 0;
             }
-        }
-    }
 
-    else
-    {
-        /* Adding first node */
-        eventnode = (EventNode *)calloc(1,sizeof(EventNode));
-        if(eventnode == NULL)
-        {
-            ErrorExit(MEM_ERROR,ARGV0);
-        }
-
-        eventnode->prev = NULL;
-        eventnode->next = NULL;
-        eventnode->event = lf;
+            /* Free event info (it goes back to the pool) */
+            Free_Eventinfo(oldest);
 
-        lastnode = eventnode;
+            _memoryused--;
+            i++;
+        }
     }
 
     return;
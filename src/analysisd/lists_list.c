@@ -232,36 +232,40 @@ int OS_DBSeachKey(ListRule *lrule, char *key)
     return 0;
 }
 
+/* Looks for the address on the list: the single ip first, then the
+ * networks it is on, the longest first ("10.1.2.", "10.1.", "10.").
+ * The prefixes are searched in place (cdb takes the key size).
+ * Returns 1 if found (the cdb is left on the entry).
+ */
+static int _OS_DBSearchAddress(ListRule *lrule, char *key)
+{
+    int len = strlen(key);
+
+    if( cdb_find(&lrule->db->cdb, key, len) > 0 ) {
+        return 1;
+    }
+
+    for(; len > 0; len--)
+    {
+        if(key[len - 1] == '.')
+        {
+            if( cdb_find(&lrule->db->cdb, key, len) > 0 ) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
 int OS_DBSeachKeyAddress(ListRule *lrule, char *key)
 {
-    //char _ip[128];
-    //_ip[127] = "\0";
     if (lrule->db != NULL)
     {
         if(_OS_CDBOpen(lrule->db) == -1) return -1;
-        //snprintf(_ip,128,"%s",key);
-        //XXX Breka apart string on the . boundtrys a loop over to longest match.
 
-        if( cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
+        if(_OS_DBSearchAddress(lrule, key)) {
             return 1;
         }
-        else
-        {
-            char *tmpkey;
-            os_strdup(key, tmpkey);
-            while(strlen(tmpkey) > 0)
-            {
-                if(tmpkey[strlen(tmpkey) - 1] == '.')
-                {
-                    if( cdb_find(&lrule->db->cdb, tmpkey, strlen(tmpkey)) > 0 ) {
-                        free(tmpkey);
-                        return 1;
-                    }
-                }
-                tmpkey[strlen(tmpkey) - 1] = '\0';
-            }
-            free(tmpkey);
-        }
     }
     return 0;
 }
@@ -275,8 +279,8 @@ int OS_DBSearchKeyAddressValue(ListRule *lrule, char *key)
     {
         if(_OS_CDBOpen(lrule->db) == -1) return 0;
 
-        // First lookup for a single IP address
-        if(cdb_find(&lrule->db->cdb, key, strlen(key)) > 0 ) {
+        // Single IP address or matching subnets
+        if(_OS_DBSearchAddress(lrule, key)) {
             vpos = cdb_datapos(&lrule->db->cdb);
             vlen = cdb_datalen(&lrule->db->cdb);
             val = malloc(vlen);
@@ -284,29 +288,6 @@ int OS_DBSearchKeyAddressValue(ListRule *lrule, char *key)
             result = OSMatch_Execute(val, vlen, lrule->matcher);
             free(val);
             return result;
-        } else {
-            // IP address not found, look for matching subnets
-            char *tmpkey;
-            os_strdup(key, tmpkey);
-            while(strlen(tmpkey) > 0)
-            {
-                if(tmpkey[strlen(tmpkey) - 1] == '.')
-                {
-                    if( cdb_find(&lrule->db->cdb, tmpkey, strlen(tmpkey)) > 0 ) {
-                        vpos = cdb_datapos(&lrule->db->cdb);
-                        vlen = cdb_datalen(&lrule->db->cdb);
-                        val = malloc(vlen);
-                        cdb_read(&lrule->db->cdb, val, vlen, vpos);
-                        result = OSMatch_Execute(val, vlen, lrule->matcher);
-                        free(val);
-                        free(tmpkey);
-                        return result;
-                    }
-                }
-                tmpkey[strlen(tmpkey) - 1] = '\0';
-            }
-            free(tmpkey);
-            return 0;
         }
     }
     return 0;
@@ -0,0 +1,265 @@
+/* @(#) $Id: ./src/analysisd/receiver.c, 2012/07/26 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All rights reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation.
+ *
+ * License details at the LICENSE file included with OSSEC or
+ * online at: http://www.ossec.net/en/licensing.html
+ */
+
+
+/* Receiver stage of analysisd.
+ * A separate thread keeps reading the events from the
+ * queue/ossec/queue socket, while the main thread is busy
+ * decoding and analyzing the previous ones. The events are
+ * kept in a bounded in-memory queue (FIFO) between both.
+ *
+ * Only the reading is on its own thread. Decoding, rule matching
+ * and the alert output stay on the main thread, one event at a
+ * time: the decoders keep their captures in the shared OSRegex and
+ * the rule state (firedtimes, time_ignored, the sid/group lists and
+ * the previous events) is shared by all the agents, so sharded
+ * workers would change which alerts are generated.
+ */
+
+
+#include <pthread.h>
+
+#include "shared.h"
+#include "os_net/os_net.h"
+#include "receiver.h"
+
+
+/* Received events (circular buffer) */
+static char **_rcv_msgs = NULL;
+static int *_rcv_sizes = NULL;
+static int _rcv_queue_size = 0;
+static int _rcv_begin = 0;
+static int _rcv_count = 0;
+static int _rcv_full = 0;
+
+static int _rcv_socket = -1;
+
+
+/* pthread mutex variables */
+static pthread_mutex_t rcv_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rcv_available = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t rcv_space = PTHREAD_COND_INITIALIZER;
+
+
+
+/* OS_Receiver: Reads the events from the socket and
+ * adds them to the end of the queue. If the queue is
+ * full, waits for the main thread to consume them
+ * (the socket is going to hold the next ones).
+ * A datagram may have many events (batched mode on
+ * the sender), each one ending with a '\0'.
+ */
+static void *OS_Receiver(void *none)
+{
+    int i;
+    int size;
+    char *pt;
+    char *n_msg;
+    char msg[OS_MAXSTR +1];
+
+    memset(msg, '\0', OS_MAXSTR +1);
+
+    while(1)
+    {
+        if(!(i = OS_RecvUnix(_rcv_socket, OS_MAXSTR, msg)))
+        {
+            continue;
+        }
+
+
+        /* locking mutex */
+        if(pthread_mutex_lock(&rcv_mutex) != 0)
+        {
+            merror(MUTEX_ERROR, ARGV0);
+            continue;
+        }
+
+        pt = msg;
+        while(pt < msg + i)
+        {
+            size = strlen(pt) +1;
+
+            /* Empty event */
+            if(size == 1)
+            {
+                pt++;
+                continue;
+            }
+
+            os_malloc(size, n_msg);
+            memcpy(n_msg, pt, size);
+            pt += size;
+
+            while(_rcv_count >= _rcv_queue_size)
+            {
+                if(!_rcv_full)
+                {
+                    merror("%s: WARN: Input queue is full (%d events). "
+                           "Analysis is falling behind.", ARGV0, _rcv_count);
+                    _rcv_full = 1;
+                }
+                pthread_cond_wait(&rcv_space, &rcv_mutex);
+            }
+
+            _rcv_msgs[(_rcv_begin + _rcv_count) % _rcv_queue_size] = n_msg;
+            _rcv_sizes[(_rcv_begin + _rcv_count) % _rcv_queue_size] = size;
+            _rcv_count++;
+
+            /* Signal that new data is available */
+            pthread_cond_signal(&rcv_available);
+        }
+
+        /* Unlocking mutex */
+        if(pthread_mutex_unlock(&rcv_mutex) != 0)
+        {
+            merror(MUTEX_ERROR, ARGV0);
+        }
+    }
+
+    return(NULL);
+}
+
+
+
+/* OS_StartReceiver: Allocates the queue and
+ * starts the receiver thread.
+ */
+int OS_StartReceiver(int m_queue, int queue_size)
+{
+    if(queue_size < RECEIVER_MIN_QUEUE)
+    {
+        queue_size = RECEIVER_MIN_QUEUE;
+    }
+
+    os_calloc(queue_size, sizeof(char *), _rcv_msgs);
+    os_calloc(queue_size, sizeof(int), _rcv_sizes);
+
+    _rcv_queue_size = queue_size;
+    _rcv_socket = m_queue;
+    _rcv_begin = 0;
+    _rcv_count = 0;
+
+    if(CreateThread(OS_Receiver, NULL) != 0)
+    {
+        return(-1);
+    }
+
+    debug1("%s: DEBUG: Receiver thread started (queue size: %d).",
+           ARGV0, queue_size);
+
+    return(0);
+}
+
+
+
+/* OS_ReceiverGet: Removes the first event from
+ * the queue (waiting for one if needed).
+ */
+int OS_ReceiverGet(char *msg, int size)
+{
+    int i;
+    char *n_msg;
+
+
+    /* locking mutex */
+    if(pthread_mutex_lock(&rcv_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+        return(0);
+    }
+
+    while(_rcv_count == 0)
+    {
+        _rcv_full = 0;
+        pthread_cond_wait(&rcv_available, &rcv_mutex);
+    }
+
+    n_msg = _rcv_msgs[_rcv_begin];
+    i = _rcv_sizes[_rcv_begin];
+
+    _rcv_msgs[_rcv_begin] = NULL;
+    _rcv_begin = (_rcv_begin + 1) % _rcv_queue_size;
+    _rcv_count--;
+
+    /* Wake up the receiver if it is waiting for space */
+    pthread_cond_signal(&rcv_space);
+
+    /* Unlocking mutex */
+    if(pthread_mutex_unlock(&rcv_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+    }
+
+
+    /* Same semantics as OS_RecvUnix */
+    if(i > size -1)
+    {
+        i = size -1;
+    }
+    memcpy(msg, n_msg, i);
+    msg[i] = '\0';
+
+    free(n_msg);
+
+    return(i);
+}
+
+
+
+
+/* OS_ReceiverRead: Reads the next event from the socket,
+ * without the receiver thread (splitting the datagrams
+ * with many events).
+ */
+int OS_ReceiverRead(int m_queue, char *msg, int size)
+{
+    int i;
+    static char r_msg[OS_MAXSTR +1];
+    static int r_pos = 0;
+    static int r_size = 0;
+
+    /* Skipping the empty events */
+    while((r_pos < r_size) && (r_msg[r_pos] == '\0'))
+    {
+        r_pos++;
+    }
+
+    if(r_pos >= r_size)
+    {
+        r_pos = 0;
+        r_size = OS_RecvUnix(m_queue, OS_MAXSTR, r_msg);
+        if(!r_size)
+        {
+            return(0);
+        }
+    }
+
+    i = strlen(r_msg + r_pos) +1;
+
+    /* Same semantics as OS_RecvUnix */
+    if(i > size -1)
+    {
+        i = size -1;
+    }
+    memcpy(msg, r_msg + r_pos, i);
+    msg[i] = '\0';
+
+    r_pos += strlen(r_msg + r_pos) +1;
+
+    return(i);
+}
+
+
+/* EOF */
@@ -0,0 +1,44 @@
+/* @(#) $Id: ./src/analysisd/receiver.h, 2012/07/26 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+#ifndef _RECEIVER__H
+
+#define _RECEIVER__H
+
+
+/* Minimum size of the input queue (when enabled) */
+#define RECEIVER_MIN_QUEUE  16
+
+
+/* Starts the receiver thread. It reads the events from
+ * m_queue and stores them in memory (up to queue_size)
+ * until OS_ReceiverGet is called.
+ * Returns 0 on success or -1 on error.
+ */
+int OS_StartReceiver(int m_queue, int queue_size);
+
+
+/* Gets the next event received. Blocks until one is available.
+ * The event is copied to msg (up to size bytes).
+ * Returns the size of the event read.
+ */
+int OS_ReceiverGet(char *msg, int size);
+
+
+/* Reads the next event directly from m_queue (when there is
+ * no receiver thread). Returns the size of the event read.
+ */
+int OS_ReceiverRead(int m_queue, char *msg, int size);
+
+
+#endif /* _RECEIVER__H */
@@ -564,6 +564,11 @@ int Rules_OP_ReadRules(char * rulefile)
                             return(-1);
                         }
 
+                        /* Compiling the list again */
+                        OS_IPTreeFree(config_ruleinfo->srcip_tree);
+                        config_ruleinfo->srcip_tree =
+                                    OS_IPTreeCreate(config_ruleinfo->srcip);
+
                         if(!(config_ruleinfo->alert_opts & DO_PACKETINFO))
                             config_ruleinfo->alert_opts |= DO_PACKETINFO;
                     }
@@ -597,6 +602,11 @@ int Rules_OP_ReadRules(char * rulefile)
                             return(-1);
                         }
 
+                        /* Compiling the list again */
+                        OS_IPTreeFree(config_ruleinfo->dstip_tree);
+                        config_ruleinfo->dstip_tree =
+                                    OS_IPTreeCreate(config_ruleinfo->dstip);
+
                         if(!(config_ruleinfo->alert_opts & DO_PACKETINFO))
                             config_ruleinfo->alert_opts |= DO_PACKETINFO;
                     }
@@ -1668,6 +1678,8 @@ RuleInfo *zerorulemember(int id, int level,
     ruleinfo_pt->srcip = NULL;
     ruleinfo_pt->srcport = NULL;
     ruleinfo_pt->dstip = NULL;
+    ruleinfo_pt->srcip_tree = NULL;
+    ruleinfo_pt->dstip_tree = NULL;
     ruleinfo_pt->dstport = NULL;
     ruleinfo_pt->url = NULL;
     ruleinfo_pt->id = NULL;
@@ -1688,6 +1700,7 @@ RuleInfo *zerorulemember(int id, int level,
     ruleinfo_pt->group_search = NULL;
 
     ruleinfo_pt->event_search = NULL;
+    ruleinfo_pt->event_index = NULL;
     ruleinfo_pt->compiled_rule = NULL;
     ruleinfo_pt->lists = NULL;
 
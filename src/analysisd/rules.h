@@ -128,6 +128,11 @@ typedef struct _RuleInfo
     /* Function pointer to the event_search. */
     void *(*event_search)(void *lf, void *rule);
 
+    /* Index of the events on sid_search/group_search
+     * (by the same_* fields), if the rule has one.
+     */
+    struct _EventIndex *event_index;
+
 
     char *group;
     OSMatch *match;
@@ -139,6 +144,8 @@ typedef struct _RuleInfo
 
     os_ip **srcip;
     os_ip **dstip;
+    os_iptree *srcip_tree;
+    os_iptree *dstip_tree;
     OSMatch *srcport;
     OSMatch *dstport;
     OSMatch *user;
@@ -170,14 +177,31 @@ typedef struct _RuleInfo
 }RuleInfo;
 
 
+/* Rules that may match each decoder id (built on demand).
+ * Position 0 holds all the rules (RULES_ALL_DECODERS).
+ */
+typedef struct _RuleIndex
+{
+    int size;
+    struct _RuleNode ***candidates;
+}RuleIndex;
+
+
 typedef struct _RuleNode
 {
     RuleInfo *ruleinfo;
     struct _RuleNode *next;
     struct _RuleNode *child;
+
+    /* Index of the child rules */
+    RuleIndex child_index;
 }RuleNode;
 
 
+/* Decoder id to get all rules from the index */
+#define RULES_ALL_DECODERS  -1
+
+
 RuleInfo *currently_rule; /* */
 
 RuleInfoDetail *zeroinfodetails(int type, char *data);
@@ -218,6 +242,12 @@ int OS_MarkID(RuleNode *r_node, RuleInfo *orig_rule);
 /* Get first rule */
 RuleNode *OS_GetFirstRule();
 
+/* Get the rules (childs of r_node or the top level ones if r_node
+ * is NULL) that may match an event from the decoder id.
+ * Returns a NULL terminated array.
+ */
+RuleNode **OS_GetRuleCandidates(RuleNode *r_node, int decoder_id);
+
 
 /** Defition of the internal rule IDS **
  ** These SIGIDs cannot be used       **
@@ -17,6 +17,9 @@
 /* Rulenode global  */
 RuleNode *rulenode;
 
+/* Index of the top level rules */
+RuleIndex rootindex;
+
 /* _OS_Addrule: Internal AddRule */
 RuleNode *_OS_AddRule(RuleNode *_rulenode, RuleInfo *read_rule);
 
@@ -26,6 +29,9 @@ void OS_CreateRuleList()
 {
     rulenode = NULL;
 
+    rootindex.size = 0;
+    rootindex.candidates = NULL;
+
     return;
 }
 
@@ -39,6 +45,92 @@ RuleNode *OS_GetFirstRule()
 }
 
 
+/* _OS_BuildCandidates: Gets all the rules from the list that can
+ * match an event from this decoder id. Rules with decoded_as set
+ * for another decoder would fail on OS_CheckIfRuleMatch before
+ * any other check, so they are not needed.
+ */
+RuleNode **_OS_BuildCandidates(RuleNode *r_node, int decoder_id)
+{
+    int total = 0;
+    RuleNode *tmp_node;
+    RuleNode **candidates;
+
+    for(tmp_node = r_node; tmp_node; tmp_node = tmp_node->next)
+    {
+        total++;
+    }
+
+    os_calloc(total +1, sizeof(RuleNode *), candidates);
+
+    total = 0;
+    for(tmp_node = r_node; tmp_node; tmp_node = tmp_node->next)
+    {
+        if((decoder_id != RULES_ALL_DECODERS) &&
+           tmp_node->ruleinfo->decoded_as &&
+           (tmp_node->ruleinfo->decoded_as != decoder_id))
+        {
+            continue;
+        }
+
+        candidates[total] = tmp_node;
+        total++;
+    }
+    candidates[total] = NULL;
+
+    return(candidates);
+}
+
+
+/* Get the candidate rules for a decoder id (from the index) */
+RuleNode **OS_GetRuleCandidates(RuleNode *r_node, int decoder_id)
+{
+    RuleIndex *index;
+    RuleNode *list;
+    int pos = decoder_id +1;
+
+    if(r_node)
+    {
+        index = &r_node->child_index;
+        list = r_node->child;
+    }
+    else
+    {
+        index = &rootindex;
+        list = OS_GetFirstRule();
+    }
+
+    if(pos < 0)
+    {
+        pos = 0;
+        decoder_id = RULES_ALL_DECODERS;
+    }
+
+
+    /* Growing the index if this decoder was not seen yet */
+    if(pos >= index->size)
+    {
+        int i;
+
+        os_realloc(index->candidates, (pos +1) * sizeof(RuleNode **),
+                   index->candidates);
+
+        for(i = index->size; i <= pos; i++)
+        {
+            index->candidates[i] = NULL;
+        }
+        index->size = pos +1;
+    }
+
+    if(!index->candidates[pos])
+    {
+        index->candidates[pos] = _OS_BuildCandidates(list, decoder_id);
+    }
+
+    return(index->candidates[pos]);
+}
+
+
 /* Search all rules, including childs */
 int _AddtoRule(int sid, int level, int none, char *group,
                RuleNode *r_node, RuleInfo *read_rule)
@@ -354,6 +446,8 @@ int OS_AddRuleInfo(RuleNode *r_node, RuleInfo *newrule, int sid)
             r_node->ruleinfo->week_day = newrule->week_day;
             r_node->ruleinfo->srcip = newrule->srcip;
             r_node->ruleinfo->dstip = newrule->dstip;
+            r_node->ruleinfo->srcip_tree = newrule->srcip_tree;
+            r_node->ruleinfo->dstip_tree = newrule->dstip_tree;
             r_node->ruleinfo->srcport = newrule->srcport;
             r_node->ruleinfo->dstport = newrule->dstport;
             r_node->ruleinfo->user = newrule->user;
@@ -425,6 +425,7 @@ void OS_ReadMSG(int m_queue, char *ut_str)
 
     /* Creating the event list */
     OS_CreateEventList(Config.memorysize);
+    OS_CreateEventIndexes();
 
 
     /* Initiating the FTS list */
@@ -457,13 +458,7 @@ void OS_ReadMSG(int m_queue, char *ut_str)
     /* Daemon loop */
     while(1)
     {
-        lf = (Eventinfo *)calloc(1,sizeof(Eventinfo));
-
-        /* This shouldn't happen .. */
-        if(lf == NULL)
-        {
-            ErrorExit(MEM_ERROR,ARGV0);
-        }
+        lf = Alloc_Eventinfo();
 
 
         /* Fixing the msg. */
@@ -475,6 +470,7 @@ void OS_ReadMSG(int m_queue, char *ut_str)
         if(fgets(msg +8, OS_MAXSTR, stdin))
         {
             RuleNode *rulenode_pt;
+            RuleNode **rules_pt;
 
             /* Getting the time we received the event */
             c_time = time(NULL);
@@ -488,6 +484,7 @@ void OS_ReadMSG(int m_queue, char *ut_str)
             /* Make sure we ignore blank lines. */
             if(strlen(msg) < 10)
             {
+                Free_Eventinfo(lf);
                 continue;
             }
 
@@ -529,6 +526,9 @@ void OS_ReadMSG(int m_queue, char *ut_str)
                 lf = Accumulate(lf);
             }
 
+            /* Parsing the ips once for all the rules */
+            Parse_EventIPs(lf);
+
             /* Looping all the rules */
             rulenode_pt = OS_GetFirstRule();
             if(!rulenode_pt)
@@ -538,14 +538,32 @@ void OS_ReadMSG(int m_queue, char *ut_str)
             }
 
 
+            /* Only the rules that may match this decoder are checked.
+             * Alerts from other servers are not matched against the
+             * rules, so any rule will do for them. On verbose mode
+             * we show every rule tried.
+             */
+            if((lf->decoder_info->type == OSSEC_ALERT) ||
+               (full_output && !alert_only))
+            {
+                rules_pt = OS_GetRuleCandidates(NULL, RULES_ALL_DECODERS);
+            }
+            else
+            {
+                rules_pt = OS_GetRuleCandidates(NULL, lf->decoder_info->id);
+            }
+
+
             #ifdef TESTRULE
             if(full_output && !alert_only)
                 print_out("\n**Rule debugging:");
             #endif
 
 
-            do
+            for(; *rules_pt != NULL; rules_pt++)
             {
+                rulenode_pt = *rules_pt;
+
                 if(lf->decoder_info->type == OSSEC_ALERT)
                 {
                     if(!lf->generated_rule)
@@ -681,12 +699,13 @@ void OS_ReadMSG(int m_queue, char *ut_str)
                         i++;
                     }
                 }
+                OS_AddEventIndex(lf);
 
                 OS_AddEvent(lf);
 
                 break;
 
-            }while((rulenode_pt = rulenode_pt->next) != NULL);
+            }
 
             if(ut_str)
             {
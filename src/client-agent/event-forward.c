@@ -30,6 +30,7 @@
 void *EventForward()
 {
     int recv_b;
+    char *p;
     char msg[OS_MAXSTR +1];
 
 
@@ -42,9 +43,18 @@ void *EventForward()
     {
         msg[recv_b] = '\0';
 
-        send_msg(0, msg);
+        /* Batched datagrams have several messages */
+        for(p = msg; p < msg + recv_b; p += strlen(p) +1)
+        {
+            if(*p == '\0')
+            {
+                continue;
+            }
 
-        run_notify();
+            send_msg(0, p);
+
+            run_notify();
+        }
     }
 
     return(NULL);
@@ -157,6 +157,7 @@ int Read_Global(XML_NODE node, void *configp, void *mailp)
     char *xml_prelude_log_level = "prelude_log_level";
     char *xml_stats = "stats";
     char *xml_memorysize = "memory_size";
+    char *xml_input_queue_size = "input_queue_size";
     char *xml_white_list = "white_list";
     char *xml_compress_alerts = "compress_alerts";
     char *xml_custom_alert_output = "custom_alert_output";
@@ -398,6 +399,18 @@ int Read_Global(XML_NODE node, void *configp, void *mailp)
                 Config->memorysize = atoi(node[i]->content);
             }
         }
+        else if(strcmp(node[i]->element, xml_input_queue_size) == 0)
+        {
+            if(!OS_StrIsNum(node[i]->content))
+            {
+                merror(XML_VALUEERR,ARGV0,node[i]->element,node[i]->content);
+                return(OS_INVALID);
+            }
+            if(Config)
+            {
+                Config->input_queue_size = atoi(node[i]->content);
+            }
+        }
         /* whitelist */
         else if(strcmp(node[i]->element, xml_white_list) == 0)
         {
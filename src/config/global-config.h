@@ -58,6 +58,9 @@ typedef struct __Config
     /* For the correlation */
     int memorysize;
 
+    /* Events buffered by the receiver thread (0 to disable it) */
+    int input_queue_size;
+
     /* List of files to ignore (syscheck) */
     char **syscheck_ignore;
 
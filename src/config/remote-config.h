@@ -36,6 +36,10 @@ typedef struct _remoted
     int m_queue;
     int sock;
     socklen_t peer_size;
+
+    /* Secure receiver threads (and their sockets) */
+    int threads;
+    int *socks;
 }remoted;
 
 #endif
@@ -249,6 +249,8 @@
 #define AG_NOKEYS_EXIT "%s(4109): ERROR: Unable to start without auth keys. Exiting."
 #define AG_MAX_ERROR    "%s(4110): ERROR: Maximum number of agents '%d' reached."
 #define AG_AX_AGENTS     "%s(4111): INFO: Maximum number of agents allowed: '%d'."
+#define AG_DROP_WARN    "%s(4112): WARN: Agent '%s' over its event rate or queue size. Dropped %u events."
+#define SPOOL_FULL_WARN "%s(4113): WARN: Event spool full. Dropped %u events."
 
 
 /* Rules reading errors */
@@ -20,23 +20,32 @@
 #define _OS_HASHOP
 
 
-/* Node structure */
+/* Node structure (slot of the table).
+ * Empty slots have a NULL key.
+ */
 typedef struct _OSHashNode
 {
-    struct _OSHashNode *next;
-
     void *key;
     void *data;
+
+    unsigned int hash;
+    unsigned int key_size;
 }OSHashNode;
 
 
 typedef struct _OSHash
 {
     unsigned int rows;
+    unsigned int elements;
+    unsigned int used;
     unsigned int initial_seed;
-    unsigned int constant;
 
-    OSHashNode **table;
+    OSHashNode *table;
+
+    /* Previous table, while it is moved to the new one */
+    OSHashNode *old_table;
+    unsigned int old_rows;
+    unsigned int old_pos;
 }OSHash;
 
 
@@ -78,6 +87,16 @@ void *OSHash_Get(OSHash *self, char *key);
 
 int OSHash_setSize(OSHash *self, int new_size);
 
+
+
+/** OSHashNode *OSHash_Begin(OSHash *self, unsigned int *i)
+ * OSHashNode *OSHash_Next(OSHash *self, unsigned int *i)
+ * Iterate over the entries of the hash (NULL at the end).
+ * Entries may be deleted while iterating, but not added.
+ */
+OSHashNode *OSHash_Begin(OSHash *self, unsigned int *i);
+OSHashNode *OSHash_Next(OSHash *self, unsigned int *i);
+
 #endif
 
 /* EOF */
@@ -31,4 +31,18 @@ int StartMQ(char * key, short int type);
 
 int SendMSG(int queue, char * message, char *locmsg, char loc);
 
+/* Batched mode: several messages per datagram, sent after
+ * max_wait milliseconds at most (0 to disable).
+ * The wait is only checked by SendMSG. The caller must call
+ * FlushMSG before blocking (waiting for more messages), or the
+ * last batch is kept until the next one arrives.
+ */
+void SetMQBatch(int max_wait);
+
+/* Sends the messages waiting on the batch (if any). There is a
+ * single batch, for the queue of the process: after a reconnect
+ * the messages waiting go to the new queue.
+ */
+int FlushMSG(int queue);
+
 #endif
@@ -27,9 +27,15 @@ typedef struct _keyentry
     char *key;
     char *name;
 
+    /* Key schedule (from OS_BF_SetKey) */
+    void *bf_key;
+
     os_ip *ip;
     struct sockaddr_in peer_info;
-    FILE *fp;
+    int rids_slot;
+
+    /* Counter updates since the last flush of the table */
+    unsigned int rids_count;
 }keyentry;
 
 
@@ -68,8 +74,8 @@ void OS_FreeKeys(keystore *keys);
 /* Checks if key changed. */
 int OS_CheckUpdateKeys(keystore *keys);
 
-/* Update the keys if they changed on the system. */
-int OS_UpdateKeys(keystore *keys);
+/* Carries the state of the agents kept after a key reload. */
+void OS_CopyKeysState(keystore *keys, keystore *old_keys);
 
 
 /* Starts counter for all agents */
@@ -115,6 +121,7 @@ int CreateSecMSG(keystore *keys, char *msg, char *msg_encrypted, int id);
 #endif
 
 #define SENDER_COUNTER  "sender_counter"
+#define RIDS_TABLE      "counters"
 #define KEYSIZE         128
 
 
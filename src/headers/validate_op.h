@@ -28,6 +28,28 @@ typedef struct _os_ip
 }os_ip;
 
 
+/* Compiled list of ips (prefix tree) */
+typedef struct _os_iptree_node
+{
+    int child[2];
+    int index;
+}os_iptree_node;
+
+typedef struct _os_iptree
+{
+    os_iptree_node *nodes;
+    int size;
+    int used;
+
+    /* Position of the first negated ip on the list */
+    int first_negated;
+
+    /* Entries with a non contiguous netmask (checked one by one) */
+    os_ip **list;
+    int *others;
+}os_iptree;
+
+
 /* Getting the netmask based on the integer value. */
 int getNetmask(int mask, char *strmask, int size);
 
@@ -54,6 +76,39 @@ int OS_IPFoundList(char *ip_address, os_ip **list_of_ips);
 
 
 
+/** os_iptree *OS_IPTreeCreate(os_ip **list_of_ips)
+ * Compiles the list of ips into a prefix tree.
+ * The list is still used by the tree and must not be freed.
+ * Returns NULL if the list is NULL.
+ */
+os_iptree *OS_IPTreeCreate(os_ip **list_of_ips);
+
+
+
+/** void OS_IPTreeFree(os_iptree *tree)
+ * Frees the tree (the list is not touched).
+ */
+void OS_IPTreeFree(os_iptree *tree);
+
+
+
+/** int OS_IPFoundTree(char *ip_address, os_iptree *tree)
+ * Same as OS_IPFoundList, but in time proportional to
+ * the prefix size, no matter how big the list is.
+ * Returns 1 on success or 0 on failure.
+ */
+int OS_IPFoundTree(char *ip_address, os_iptree *tree);
+
+
+
+/** int OS_IPFoundTreeAddr(unsigned int ip_address, os_iptree *tree)
+ * Same as OS_IPFoundTree, for an address already parsed
+ * (inet_addr, network order).
+ */
+int OS_IPFoundTreeAddr(unsigned int ip_address, os_iptree *tree);
+
+
+
 /** int OS_IsValidIP(char *ip)
  * Validates if an ip address is in the right
  * format.
@@ -0,0 +1,292 @@
+/* @(#) $Id: ./src/logcollector/file_notify.c, 2012/03/28 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* File change notification (inotify) for the monitored files.
+ * Watched files are only read when they change. The others (no inotify,
+ * network file systems, logcollector.notify=0) are polled every
+ * loop_timeout seconds, as before.
+ */
+
+
+/* Before shared.h (it defines __name) */
+#ifdef USEINOTIFY
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
+
+#include "shared.h"
+
+#include "logcollector.h"
+
+
+#ifdef USEINOTIFY
+
+
+#define NOTIFY_FLAGS        IN_MODIFY|IN_MOVE_SELF|IN_DELETE_SELF|IN_ATTRIB
+#define NOTIFY_EVENT_SIZE   (sizeof (struct inotify_event))
+#define NOTIFY_BUFFER       (1024 * (NOTIFY_EVENT_SIZE + 16))
+
+
+/* Network file systems do not report the remote changes */
+static long notify_remote_fs[] =
+{
+    0x6969,         /* NFS */
+    0x517B,         /* SMB */
+    0xFF534D42,     /* CIFS */
+    0xFE534D42,     /* SMB2 */
+    0x73757245,     /* CODA */
+    0x5346414F,     /* AFS */
+    0x65735546,     /* FUSE */
+    0x01021997,     /* 9P */
+    0x00C36400,     /* CEPH */
+    0
+};
+
+
+static int *notify_fds = NULL;
+static int notify_readers = 0;
+static int notify_files = 0;
+static int *notify_wd = NULL;
+static char *notify_changed = NULL;
+
+
+
+/* notify_init: Starts the notifications for the logff files, one
+ * inotify instance per reader (logff_reader).
+ * Returns -1 if they are not available (polling only).
+ */
+int notify_init(int readers)
+{
+    int i;
+
+    if(getDefine_Int("logcollector", "notify", 0, 1) == 0)
+    {
+        return(-1);
+    }
+
+    for(notify_files = 0; logff[notify_files].file; notify_files++);
+
+    os_calloc(readers, sizeof(int), notify_fds);
+    for(i = 0; i < readers; i++)
+    {
+        notify_fds[i] = inotify_init();
+        if(notify_fds[i] < 0)
+        {
+            merror("%s: ERROR: Unable to initialize inotify. "
+                   "Polling the files.", ARGV0);
+
+            while(i > 0)
+            {
+                close(notify_fds[--i]);
+            }
+            free(notify_fds);
+            notify_fds = NULL;
+            return(-1);
+        }
+    }
+    notify_readers = readers;
+
+    os_calloc(notify_files +1, sizeof(int), notify_wd);
+    os_calloc(notify_files +1, sizeof(char), notify_changed);
+
+    for(i = 0; i <= notify_files; i++)
+    {
+        notify_wd[i] = -1;
+    }
+
+    return(0);
+}
+
+
+/* notify_fd: Returns the inotify descriptor of the reader (or -1).
+ */
+int notify_fd(int reader)
+{
+    if(!notify_fds || reader >= notify_readers)
+    {
+        return(-1);
+    }
+
+    return(notify_fds[reader]);
+}
+
+
+/* notify_watch: Watches the file opened at logff[i] (called every
+ * time it is opened again).
+ */
+void notify_watch(int i)
+{
+    struct statfs stfs;
+    int fd;
+    int r;
+
+    if(i >= notify_files || !logff[i].fp ||
+       (fd = notify_fd(logff_reader[i])) < 0)
+    {
+        return;
+    }
+
+    if(notify_wd[i] >= 0)
+    {
+        inotify_rm_watch(fd, notify_wd[i]);
+        notify_wd[i] = -1;
+    }
+
+    if(fstatfs(fileno(logff[i].fp), &stfs) == 0)
+    {
+        for(r = 0; notify_remote_fs[r]; r++)
+        {
+            if((unsigned long)stfs.f_type ==
+               (unsigned long)notify_remote_fs[r])
+            {
+                debug1("%s: DEBUG: Polling file on network file "
+                       "system: '%s'.", ARGV0, logff[i].file);
+                return;
+            }
+        }
+    }
+
+    notify_wd[i] = inotify_add_watch(fd, logff[i].file, NOTIFY_FLAGS);
+    if(notify_wd[i] < 0)
+    {
+        merror("%s: WARN: Unable to watch file '%s' (polling it). "
+               "errno: %d", ARGV0, logff[i].file, errno);
+        return;
+    }
+
+    /* Reading whatever was written before the watch */
+    notify_changed[i] = 1;
+}
+
+
+/* notify_watched: Returns 1 if logff[i] is read on notifications only.
+ */
+int notify_watched(int i)
+{
+    if(!notify_fds || i >= notify_files)
+    {
+        return(0);
+    }
+
+    return(notify_wd[i] >= 0);
+}
+
+
+/* notify_read: Reads the pending notifications of the reader,
+ * marking its files that changed.
+ */
+void notify_read(int reader)
+{
+    int len, i = 0, j;
+    char buf[NOTIFY_BUFFER +1];
+    struct inotify_event *event;
+
+    len = read(notify_fds[reader], buf, NOTIFY_BUFFER);
+    if(len < 0)
+    {
+        merror("%s: ERROR: Unable to read from inotify. errno: %d",
+               ARGV0, errno);
+        return;
+    }
+
+    while(i < len)
+    {
+        event = (struct inotify_event *) &buf[i];
+
+        /* Events lost. Everything must be read. */
+        if(event->mask & IN_Q_OVERFLOW)
+        {
+            for(j = 0; j < notify_files; j++)
+            {
+                if(logff_reader[j] == reader)
+                {
+                    notify_changed[j] = 1;
+                }
+            }
+        }
+
+        else
+        {
+            for(j = 0; j < notify_files; j++)
+            {
+                if(notify_wd[j] != event->wd || logff_reader[j] != reader)
+                {
+                    continue;
+                }
+
+                notify_changed[j] = 1;
+
+                /* The watch is gone with the file */
+                if(event->mask & IN_IGNORED)
+                {
+                    notify_wd[j] = -1;
+                }
+            }
+        }
+
+        i += NOTIFY_EVENT_SIZE + event->len;
+    }
+}
+
+
+/* notify_changed_file: Returns (and clears) if logff[i] changed.
+ */
+int notify_changed_file(int i)
+{
+    if(!notify_fds || i >= notify_files || !notify_changed[i])
+    {
+        return(0);
+    }
+
+    notify_changed[i] = 0;
+    return(1);
+}
+
+
+
+#else
+
+int notify_init(int readers)
+{
+    return(-1);
+}
+
+int notify_fd(int reader)
+{
+    return(-1);
+}
+
+void notify_watch(int i)
+{
+    return;
+}
+
+int notify_watched(int i)
+{
+    return(0);
+}
+
+void notify_read(int reader)
+{
+    return;
+}
+
+int notify_changed_file(int i)
+{
+    return(0);
+}
+
+#endif
+
+
+/* EOF */
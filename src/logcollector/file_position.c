@@ -0,0 +1,565 @@
+/* @(#) $Id: ./src/logcollector/file_position.c, 2012/03/28 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Read positions of the monitored files. They are saved to
+ * POSITION_FILE every logcollector.positions seconds, so after a restart
+ * the files are read from where they were left (instead of their end).
+ * Each entry has the device, inode and offset of the file, plus the md5
+ * of its first bytes (to know if it was replaced).
+ * An offset is only saved once the lines before it were sent by
+ * SendLogQueue. Nothing is lost on a restart, but the last lines
+ * may be sent again.
+ */
+
+
+#include "shared.h"
+#include "os_crypto/md5/md5.h"
+
+#include "logcollector.h"
+
+
+#ifndef WIN32
+#include <glob.h>
+#include <pthread.h>
+
+
+/* Bytes of the file in the fingerprint (md5) */
+#define POSITION_FPSIZE     512
+
+
+typedef struct _position
+{
+    int valid;
+    unsigned long seq;
+
+    unsigned long long dev;
+    unsigned long long ino;
+    unsigned long long offset;
+    int fp_size;
+    char fp_sum[33];
+}position;
+
+typedef struct _position_file
+{
+    /* Last read (latest), read before the previous save (pending)
+     * and sent (saved).
+     */
+    position latest;
+    position pending;
+    position saved;
+
+    /* Position at the start (from POSITION_FILE) */
+    position *loaded;
+    int restored;
+
+    /* File rotated while we were stopped (its rest is read first) */
+    FILE *rotated;
+}position_file;
+
+
+static int position_interval = 0;
+static int position_files = 0;
+static int position_dirty = 0;
+static time_t position_next = 0;
+static position_file *position_list = NULL;
+static OSHash *position_db = NULL;
+
+static pthread_mutex_t position_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/* _position_sum: md5 of the first size bytes of the file. Returns -1
+ * if the file is smaller.
+ */
+static int _position_sum(int fd, int size, char *sum)
+{
+    int i;
+    unsigned char buf[POSITION_FPSIZE];
+    unsigned char digest[16];
+    MD5_CTX ctx;
+
+    if(size > 0 && pread(fd, buf, size, 0) != size)
+    {
+        return(-1);
+    }
+
+    MD5Init(&ctx);
+    MD5Update(&ctx, buf, size);
+    MD5Final(digest, &ctx);
+
+    for(i = 0; i < 16; i++)
+    {
+        snprintf(sum + (i * 2), 3, "%02x", digest[i]);
+    }
+    sum[32] = '\0';
+
+    return(0);
+}
+
+
+/* _position_match: Checks if the file (fd/st) is the one at pos.
+ * The offset of the compressed files is not in the file size.
+ */
+static int _position_match(int fd, struct stat *st, position *pos,
+                           int compressed)
+{
+    char sum[33];
+
+    if((pos->dev != (unsigned long long)st->st_dev) ||
+       (pos->ino != (unsigned long long)st->st_ino) ||
+       (!compressed && pos->offset > (unsigned long long)st->st_size))
+    {
+        return(0);
+    }
+
+    if(_position_sum(fd, pos->fp_size, sum) < 0 ||
+       strcmp(sum, pos->fp_sum) != 0)
+    {
+        return(0);
+    }
+
+    return(1);
+}
+
+
+/* _position_rotated: Looks for the file at pos renamed (rotated) next
+ * to the original one (file.1, file-20120328, ...).
+ * Returns it opened at the position, or NULL.
+ */
+static FILE *_position_rotated(char *file, position *pos)
+{
+    unsigned int i;
+    char pattern[OS_FLSIZE +1];
+    FILE *fp = NULL;
+    struct stat st;
+    glob_t g;
+
+    snprintf(pattern, OS_FLSIZE, "%s?*", file);
+    if(glob(pattern, 0, NULL, &g) != 0)
+    {
+        return(NULL);
+    }
+
+    for(i = 0; i < g.gl_pathc && !fp; i++)
+    {
+        if(stat(g.gl_pathv[i], &st) < 0 ||
+           pos->ino != (unsigned long long)st.st_ino)
+        {
+            continue;
+        }
+
+        fp = fopen(g.gl_pathv[i], "r");
+        if(!fp)
+        {
+            continue;
+        }
+
+        if(fstat(fileno(fp), &st) < 0 ||
+           !_position_match(fileno(fp), &st, pos, 0) ||
+           fseeko(fp, pos->offset, SEEK_SET) < 0)
+        {
+            fclose(fp);
+            fp = NULL;
+            continue;
+        }
+
+        debug1("%s: DEBUG: Reading rotated file '%s' from %llu.",
+               ARGV0, g.gl_pathv[i], pos->offset);
+    }
+
+    globfree(&g);
+    return(fp);
+}
+
+
+/* position_init: Reads the positions saved. Disabled if
+ * logcollector.positions is 0 (the files are read from their end).
+ */
+void position_init(int files)
+{
+    char buf[OS_MAXSTR +1];
+    char *file;
+    position *pos;
+    FILE *fp;
+
+    position_interval = getDefine_Int("logcollector", "positions", 0, 3600);
+    if(!position_interval)
+    {
+        return;
+    }
+
+    position_files = files;
+    os_calloc(files +1, sizeof(position_file), position_list);
+
+    position_db = OSHash_Create();
+    if(!position_db)
+    {
+        ErrorExit(MEM_ERROR, ARGV0);
+    }
+
+    fp = fopen(POSITION_FILE, "r");
+    if(!fp)
+    {
+        return;
+    }
+
+    buf[OS_MAXSTR] = '\0';
+    while(fgets(buf, OS_MAXSTR, fp) != NULL)
+    {
+        int n = 0;
+
+        file = strchr(buf, '\n');
+        if(!file)
+        {
+            continue;
+        }
+        *file = '\0';
+
+        os_calloc(1, sizeof(position), pos);
+        if(sscanf(buf, "%llu %llu %llu %d %32s %n",
+                  &pos->dev, &pos->ino, &pos->offset,
+                  &pos->fp_size, pos->fp_sum, &n) != 5 ||
+           n == 0 || pos->fp_size < 0 || pos->fp_size > POSITION_FPSIZE)
+        {
+            merror("%s: WARN: Invalid entry at '%s': %s", ARGV0,
+                   POSITION_FILE, buf);
+            free(pos);
+            continue;
+        }
+        pos->valid = 1;
+
+        if(OSHash_Add(position_db, buf + n, pos) != 2)
+        {
+            free(pos);
+        }
+    }
+
+    fclose(fp);
+}
+
+
+/* position_open: Called when the file at i is opened. If it is the
+ * first time, it is set at the position saved (returns 1). Returns 0
+ * if it is not known and the file must be read from its end (do_fseek).
+ * position_update must be called after it.
+ */
+int position_open(int i, struct stat *st, int do_fseek)
+{
+    int ret = 0;
+    int fd;
+    position *pos;
+
+    if(!position_interval || i >= position_files || !S_ISREG(st->st_mode))
+    {
+        return(0);
+    }
+
+    fd = fileno(logff[i].fp);
+    pos = (position *)OSHash_Get(position_db, logff[i].file);
+
+    pthread_mutex_lock(&position_mutex);
+
+    if(do_fseek && pos && !position_list[i].restored)
+    {
+        position_list[i].restored = 1;
+        position_list[i].loaded = pos;
+
+        /* Compressed: the offset is in the data decompressed */
+        if(logff[i].read == (void *)read_gzip)
+        {
+            if(_position_match(fd, st, pos, 1))
+            {
+                debug1("%s: DEBUG: Reading '%s' from %llu (decompressed).",
+                       ARGV0, logff[i].file, pos->offset);
+                read_gzip_skip(i, pos->offset);
+            }
+            ret = 1;
+        }
+
+        else if(_position_match(fd, st, pos, 0))
+        {
+            if(fseeko(logff[i].fp, pos->offset, SEEK_SET) == 0)
+            {
+                debug1("%s: DEBUG: Reading '%s' from %llu.", ARGV0,
+                       logff[i].file, pos->offset);
+                ret = 1;
+            }
+        }
+
+        /* Replaced while we were stopped. The new file is read from
+         * the start, after the rest of the old one (if found).
+         */
+        else
+        {
+            position_list[i].rotated = _position_rotated(logff[i].file,
+                                                         pos);
+            ret = 1;
+        }
+    }
+
+    /* Offset from now on */
+    position_list[i].latest.valid = 0;
+    position_list[i].latest.dev = st->st_dev;
+    position_list[i].latest.ino = st->st_ino;
+    position_list[i].latest.fp_size = -1;
+
+    pthread_mutex_unlock(&position_mutex);
+
+    return(ret);
+}
+
+
+/* position_update: Sets the offset of the file at i, after it is read.
+ * It is saved once all the messages read are sent.
+ */
+void position_update(int i)
+{
+    off_t offset, read_offset;
+    position *pos;
+
+    if(!position_interval || i >= position_files || !logff[i].fp ||
+       position_list[i].rotated)
+    {
+        return;
+    }
+
+    read_offset = offset = ftello(logff[i].fp);
+    if(offset < 0)
+    {
+        return;
+    }
+
+    /* Incomplete line at the end (not sent yet) */
+    if(logff[i].read == (void *)read_syslog)
+    {
+        offset -= read_syslog_pending(i);
+    }
+    else if(logff[i].read == (void *)read_gzip)
+    {
+        offset = read_gzip_offset(i);
+    }
+
+    pos = &position_list[i].latest;
+
+    /* Fingerprint of the first bytes (only until they are all read) */
+    if(pos->fp_size < POSITION_FPSIZE && pos->fp_size < read_offset)
+    {
+        int size = read_offset < POSITION_FPSIZE?read_offset:POSITION_FPSIZE;
+        char sum[33];
+
+        if(_position_sum(fileno(logff[i].fp), size, sum) < 0)
+        {
+            return;
+        }
+
+        pthread_mutex_lock(&position_mutex);
+        pos->fp_size = size;
+        strncpy(pos->fp_sum, sum, 33);
+        pthread_mutex_unlock(&position_mutex);
+    }
+
+    pthread_mutex_lock(&position_mutex);
+
+    if(pos->fp_size >= 0)
+    {
+        pos->offset = offset;
+        pos->seq = SendLogAdded();
+        pos->valid = 1;
+        position_dirty = 1;
+    }
+
+    pthread_mutex_unlock(&position_mutex);
+}
+
+
+/* position_read_rotated: Reads the rest of the file at i that was
+ * rotated while we were stopped, before the new one.
+ */
+void position_read_rotated(int i)
+{
+    int r = 0;
+    FILE *fp;
+
+    if(!position_interval || i >= position_files ||
+       !position_list[i].rotated || !logff[i].fp)
+    {
+        return;
+    }
+
+    /* The last line of the rotated file is complete even
+     * without a new line (it will not grow anymore).
+     */
+    fp = logff[i].fp;
+    logff[i].fp = position_list[i].rotated;
+    logff[i].read(i, &r, 0);
+    read_syslog_flush(i, 0);
+    fclose(logff[i].fp);
+    logff[i].fp = fp;
+
+    pthread_mutex_lock(&position_mutex);
+    position_list[i].rotated = NULL;
+    pthread_mutex_unlock(&position_mutex);
+
+    verbose("%s: INFO: Read the rest of rotated file: '%s'.", ARGV0,
+            logff[i].file);
+
+    /* Now the new one */
+    position_update(i);
+}
+
+
+/* position_fname: Changes the name of the file at i (files with a
+ * date). The names are read by position_save, on the sender thread.
+ */
+void position_fname(int i, char *file)
+{
+    pthread_mutex_lock(&position_mutex);
+
+    os_free(logff[i].file);
+    os_strdup(file, logff[i].file);
+
+    pthread_mutex_unlock(&position_mutex);
+}
+
+
+/* position_due: If the positions must be saved (the messages sent
+ * must be flushed before).
+ */
+int position_due()
+{
+    return(position_interval && position_dirty &&
+           time(0) >= position_next);
+}
+
+
+/* position_save: Saves the positions of the messages already sent
+ * (up to the sent one) to POSITION_FILE.
+ */
+void position_save(unsigned long sent)
+{
+    int i;
+    position *pos;
+    FILE *fp;
+
+    if(!position_interval)
+    {
+        return;
+    }
+
+    position_next = time(0) + position_interval;
+
+    fp = fopen(POSITION_FILE ".tmp", "w");
+    if(!fp)
+    {
+        merror(FOPEN_ERROR, ARGV0, POSITION_FILE ".tmp");
+        return;
+    }
+
+    pthread_mutex_lock(&position_mutex);
+
+    position_dirty = 0;
+    for(i = 0; i < position_files; i++)
+    {
+        position_file *pf = &position_list[i];
+
+        if(!logff[i].file)
+        {
+            continue;
+        }
+
+        /* Latest sent. Otherwise, the one read before the
+         * last save (sent by now, most likely).
+         */
+        if(pf->latest.valid && pf->latest.seq <= sent)
+        {
+            pf->saved = pf->latest;
+            pf->pending.valid = 0;
+        }
+        else
+        {
+            if(pf->pending.valid && pf->pending.seq <= sent)
+            {
+                pf->saved = pf->pending;
+            }
+            pf->pending = pf->latest;
+            position_dirty |= pf->latest.valid;
+        }
+
+        /* Not read yet -- keeping the one loaded */
+        pos = &pf->saved;
+        if(!pos->valid)
+        {
+            pos = pf->loaded;
+            if(!pos && !pf->restored)
+            {
+                pos = (position *)OSHash_Get(position_db, logff[i].file);
+            }
+            if(!pos)
+            {
+                continue;
+            }
+        }
+
+        if(strchr(logff[i].file, '\n'))
+        {
+            continue;
+        }
+
+        fprintf(fp, "%llu %llu %llu %d %s %s\n", pos->dev, pos->ino,
+                pos->offset, pos->fp_size, pos->fp_sum, logff[i].file);
+    }
+
+    pthread_mutex_unlock(&position_mutex);
+
+    if(fclose(fp) != 0 || rename(POSITION_FILE ".tmp", POSITION_FILE) < 0)
+    {
+        merror(RENAME_ERROR, ARGV0, POSITION_FILE);
+        unlink(POSITION_FILE ".tmp");
+    }
+}
+
+
+
+#else
+
+/* Not on Windows (the files are read from their end) */
+void position_init(int files)
+{
+    return;
+}
+
+int position_open(int i, struct stat *st, int do_fseek)
+{
+    return(0);
+}
+
+void position_update(int i)
+{
+    return;
+}
+
+void position_read_rotated(int i)
+{
+    return;
+}
+
+void position_fname(int i, char *file)
+{
+    os_free(logff[i].file);
+    os_strdup(file, logff[i].file);
+}
+
+#endif
+
+
+/* EOF */
@@ -17,9 +17,19 @@
 
 #include "logcollector.h"
 
-int _cday = 0;
+int *_cday = NULL;
 int update_fname(int i);
 
+/* Files (and commands) at logff */
+static int max_file = 0;
+
+/* Readers: the files are spread over logr_threads readers and
+ * the commands have their own (the last one).
+ */
+static int readers = 1;
+
+static void *LogCollectorRead(void *reader_id);
+
 
 char *rand_keepalive_str(char *dst, int size)
 {
@@ -43,23 +53,12 @@ char *rand_keepalive_str(char *dst, int size)
 void LogCollectorStart()
 {
     int i = 0, r = 0;
-    int max_file = 0;
-    int f_check = 0;
-    int curr_time = 0;
-    char keepalive[1024];
-
-
-
-    /* To check for inode changes */
-    struct stat tmp_stat;
-
-
-    #ifndef WIN32
+    int files = 0;
+    int commands = 0;
+    int *reader_ids = NULL;
 
-    int int_error = 0;
-    struct timeval fp_timeout;
 
-    #else
+    #ifdef WIN32
 
     /* Checking if we are on vista. */
     checkVista();
@@ -76,6 +75,68 @@ void LogCollectorStart()
     debug1("%s: DEBUG: Entering LogCollectorStart().", ARGV0);
 
 
+    /* Spreading the files over the readers. The commands
+     * go to the last one, so they never hold the files.
+     */
+    for(max_file = 0; logff[max_file].file; max_file++)
+    {
+        if(logff[max_file].logformat &&
+           ((strcmp(logff[max_file].logformat, "command") == 0) ||
+            (strcmp(logff[max_file].logformat, "full_command") == 0)))
+        {
+            commands++;
+        }
+        else
+        {
+            files++;
+        }
+    }
+
+    #ifndef WIN32
+    readers = logr_threads;
+    if(readers > files)
+    {
+        readers = files;
+    }
+    if(readers < 1)
+    {
+        readers = 1;
+    }
+    #else
+    /* Only one (this thread) on Windows */
+    readers = 1;
+    commands = 0;
+    #endif
+
+    os_calloc(max_file +1, sizeof(int), logff_reader);
+    os_calloc(readers +1, sizeof(int), _cday);
+
+    for(i = 0, files = 0; i < max_file; i++)
+    {
+        if(commands && logff[i].logformat &&
+           ((strcmp(logff[i].logformat, "command") == 0) ||
+            (strcmp(logff[i].logformat, "full_command") == 0)))
+        {
+            logff_reader[i] = readers;
+        }
+        else
+        {
+            logff_reader[i] = files++ % readers;
+        }
+    }
+
+
+    #ifndef WIN32
+    /* Watching the files (handle_file adds them) */
+    notify_init(readers);
+    #endif
+
+    SendLogInit();
+
+    /* Where the files were left (handle_file uses them) */
+    position_init(max_file);
+
+
     /* Initializing each file and structure */
     for(i = 0;;i++)
     {
@@ -165,28 +226,6 @@ void LogCollectorStart()
             logff[i].command = NULL;
 
 
-            /* Initializing the files */
-            if(logff[i].ffile)
-            {
-                /* Day must be zero for all files to be initialized */
-                _cday = 0;
-                if(update_fname(i))
-                {
-                    handle_file(i, 1, 1);
-                }
-                else
-                {
-                    ErrorExit(PARSE_ERROR, ARGV0, logff[i].ffile);
-                }
-
-            }
-            else
-            {
-                handle_file(i, 1, 1);
-            }
-
-            verbose(READING_FILE, ARGV0, logff[i].file);
-
             /* Getting the log type */
             if(strcmp("snort-full", logff[i].logformat) == 0)
             {
@@ -215,6 +254,51 @@ void LogCollectorStart()
                 logff[i].read = (void *)read_postgresql_log;
             }
             else if(strcmp("djb-multilog", logff[i].logformat) == 0)
+            {
+                logff[i].read = (void *)read_djbmultilog;
+            }
+            else if(logff[i].logformat[0] >= '0' && logff[i].logformat[0] <= '9')
+            {
+                logff[i].read = (void *)read_multiline;
+            }
+            else
+            {
+                logff[i].read = (void *)read_syslog;
+            }
+
+
+            /* Compressed files (rotated logs) are decompressed as they
+             * are read. Only for the formats read by lines.
+             */
+            if(logff[i].read == (void *)read_syslog && read_gzip_check(i))
+            {
+                logff[i].read = (void *)read_gzip;
+            }
+
+
+            /* Initializing the files */
+            if(logff[i].ffile)
+            {
+                /* Day must be zero for all files to be initialized */
+                _cday[logff_reader[i]] = 0;
+                if(update_fname(i))
+                {
+                    handle_file(i, 1, 1);
+                }
+                else
+                {
+                    ErrorExit(PARSE_ERROR, ARGV0, logff[i].ffile);
+                }
+
+            }
+            else
+            {
+                handle_file(i, 1, 1);
+            }
+
+            verbose(READING_FILE, ARGV0, logff[i].file);
+
+            if(logff[i].read == (void *)read_djbmultilog)
             {
                 if(!init_djbmultilog(i))
                 {
@@ -226,15 +310,6 @@ void LogCollectorStart()
                     }
                     logff[i].file = NULL;
                 }
-                logff[i].read = (void *)read_djbmultilog;
-            }
-            else if(logff[i].logformat[0] >= '0' && logff[i].logformat[0] <= '9')
-            {
-                logff[i].read = (void *)read_multiline;
-            }
-            else
-            {
-                logff[i].read = (void *)read_syslog;
             }
 
             /* More tweaks for Windows. For some reason IIS places
@@ -277,6 +352,74 @@ void LogCollectorStart()
     }
 
 
+    #ifndef WIN32
+    /* Starting the readers. This thread sends their messages. */
+    os_calloc(readers +1, sizeof(int), reader_ids);
+    for(r = 0; r <= readers; r++)
+    {
+        reader_ids[r] = r;
+
+        /* The commands reader is only needed if there are commands */
+        if(r == readers && !commands)
+        {
+            break;
+        }
+
+        if(CreateThread(LogCollectorRead, (void *)&reader_ids[r]) != 0)
+        {
+            ErrorExit(THREAD_ERROR, ARGV0);
+        }
+    }
+
+    debug1("%s: DEBUG: Log readers: %d (commands: %d).", ARGV0,
+           readers, commands);
+
+    SendLogQueue(NULL);
+
+    #else
+    r = 0;
+    LogCollectorRead((void *)&r);
+    #endif
+}
+
+
+
+/* LogCollectorRead: Reads the files (or the commands) of one reader.
+ * Never returns.
+ */
+static void *LogCollectorRead(void *reader_id)
+{
+    int i = 0, r = 0;
+    int reader = *(int *)reader_id;
+    int f_check = 0;
+    int curr_time = 0;
+    int do_poll = 1;
+    char keepalive[1024];
+
+
+    /* To check for inode changes */
+    struct stat tmp_stat;
+
+
+    #ifndef WIN32
+    int int_error = 0;
+    int fd = notify_fd(reader);
+    time_t poll_time = 0;
+    fd_set fdset;
+    struct timeval fp_timeout;
+    #endif
+
+
+    /* Lines left in the files rotated while we were stopped */
+    for(i = 0; i <= max_file; i++)
+    {
+        if(logff_reader[i] == reader && logff[i].file && logff[i].fp)
+        {
+            position_read_rotated(i);
+        }
+    }
+
+
     /* Daemon loop */
     while(1)
     {
@@ -284,8 +427,14 @@ void LogCollectorStart()
         fp_timeout.tv_sec = loop_timeout;
         fp_timeout.tv_usec = 0;
 
-        /* Waiting for the select timeout */
-        if ((r = select(0, NULL, NULL, NULL, &fp_timeout)) < 0)
+        FD_ZERO(&fdset);
+        if(fd >= 0)
+        {
+            FD_SET(fd, &fdset);
+        }
+
+        /* Waiting for the select timeout (or for a file change) */
+        if ((r = select(fd +1, &fdset, NULL, NULL, &fp_timeout)) < 0)
         {
             merror(SELECT_ERROR, ARGV0);
             int_error++;
@@ -296,6 +445,23 @@ void LogCollectorStart()
             }
             continue;
         }
+
+        if(r > 0)
+        {
+            notify_read(reader);
+        }
+
+
+        /* The commands and the files not watched are only
+         * polled every loop_timeout.
+         */
+        do_poll = 0;
+        if((r == 0) || (time(0) - poll_time >= loop_timeout))
+        {
+            do_poll = 1;
+            poll_time = time(0);
+        }
+
         #else
 
         /* Windows don't like select that way */
@@ -306,16 +472,25 @@ void LogCollectorStart()
         win_readel();
         #endif
 
-        f_check++;
+        if(do_poll)
+        {
+            f_check++;
+        }
 
 
         /* Checking which file is available */
         for(i = 0; i <= max_file; i++)
         {
+            /* Read by another reader */
+            if(logff_reader[i] != reader)
+            {
+                continue;
+            }
+
             if(!logff[i].fp)
             {
                 /* Run the command. */
-                if(logff[i].command && (f_check %2))
+                if(logff[i].command && do_poll && (f_check %2))
                 {
                     curr_time = time(0);
                     if((curr_time - logff[i].size) >= logff[i].ign)
@@ -327,6 +502,19 @@ void LogCollectorStart()
                 continue;
             }
 
+            /* Watched files are only read when they change */
+            if(notify_watched(i))
+            {
+                if(!notify_changed_file(i))
+                {
+                    continue;
+                }
+            }
+            else if(!do_poll)
+            {
+                continue;
+            }
+
             /* Windows with IIS logs is very strange.
              * For some reason it always returns 0 (not EOF)
              * the fgetc. To solve this problem, we always
@@ -334,17 +522,24 @@ void LogCollectorStart()
              */
             #ifndef WIN32
             /* We check for the end of file. If is returns EOF,
-             * we don't attempt to read it.
+             * we don't attempt to read it (unless there are lines
+             * left from a compressed file).
              */
             if((r = fgetc(logff[i].fp)) == EOF)
             {
                 clearerr(logff[i].fp);
-                continue;
+                if(!read_gzip_pending(i))
+                {
+                    continue;
+                }
             }
 
 
             /* If it is not EOF, we need to return the read character */
-            ungetc(r, logff[i].fp);
+            else
+            {
+                ungetc(r, logff[i].fp);
+            }
             #endif
 
 
@@ -363,6 +558,9 @@ void LogCollectorStart()
                 {
                     logff[i].ign++;
                 }
+
+                /* Saved once the lines are sent */
+                position_update(i);
             }
             /* If ferror is set */
             else
@@ -410,14 +608,16 @@ void LogCollectorStart()
 
 
         /* Only check bellow if check > VCHECK_FILES */
-        if(f_check <= VCHECK_FILES)
+        if(!do_poll || f_check <= VCHECK_FILES)
             continue;
 
 
-        /* Send keep alive message */
-
-        rand_keepalive_str(keepalive, 700);
-        SendMSG(logr_queue, keepalive, "ossec-keepalive", LOCALFILE_MQ);
+        /* Send keep alive message (first reader only) */
+        if(reader == 0)
+        {
+            rand_keepalive_str(keepalive, 700);
+            SendLogMSG(keepalive, "ossec-keepalive", LOCALFILE_MQ);
+        }
 
 
         /* Zeroing f_check */
@@ -428,7 +628,7 @@ void LogCollectorStart()
         for(i = 0; i <= max_file; i++)
         {
             /* These are the windows logs or ignored files */
-            if(!logff[i].file)
+            if(!logff[i].file || logff_reader[i] != reader)
                 continue;
 
 
@@ -508,12 +708,15 @@ void LogCollectorStart()
                                              logff[i].file);
 
                     /* Send message about log rotated  */
-                    SendMSG(logr_queue, msg_alert,
-                            "ossec-logcollector", LOCALFILE_MQ);
+                    SendLogMSG(msg_alert, "ossec-logcollector", LOCALFILE_MQ);
 
                     debug1("%s: DEBUG: File inode changed. %s",
                             ARGV0, logff[i].file);
 
+                    /* Reading what was left in the old one */
+                    logff[i].read(i, &r, 0);
+                    read_syslog_flush(i, 0);
+
                     fclose(logff[i].fp);
 
                     #ifdef WIN32
@@ -538,8 +741,7 @@ void LogCollectorStart()
                                              logff[i].file);
 
                     /* Send message about log rotated  */
-                    SendMSG(logr_queue, msg_alert,
-                            "ossec-logcollector", LOCALFILE_MQ);
+                    SendLogMSG(msg_alert, "ossec-logcollector", LOCALFILE_MQ);
 
                     debug1("%s: DEBUG: File size reduced. %s",
                             ARGV0, logff[i].file);
@@ -622,6 +824,8 @@ void LogCollectorStart()
             }
         }
     }
+
+    return(NULL);
 }
 
 
@@ -635,12 +839,17 @@ int update_fname(int i)
     char lfile[OS_FLSIZE + 1];
     size_t ret;
 
+    #ifndef WIN32
+    struct tm tm_result;
 
+    p = localtime_r(&__ctime, &tm_result);
+    #else
     p = localtime(&__ctime);
+    #endif
 
 
-    /* Handle file */
-    if(p->tm_mday == _cday)
+    /* Handle file (_cday is per reader) */
+    if(p->tm_mday == _cday[logff_reader[i]])
     {
         return(0);
     }
@@ -657,25 +866,25 @@ int update_fname(int i)
     /* Update the file name */
     if(strcmp(lfile, logff[i].file) != 0)
     {
-        os_free(logff[i].file);
-
-        os_strdup(lfile, logff[i].file);
+        position_fname(i, lfile);
 
         verbose(VAR_LOG_MON, ARGV0, logff[i].file);
 
         /* Setting cday to zero because other files may need
          * to be changed.
          */
-        _cday = 0;
+        _cday[logff_reader[i]] = 0;
         return(1);
     }
 
-    _cday = p->tm_mday;
+    _cday[logff_reader[i]] = p->tm_mday;
     return(0);
 }
 
 
-/* handle_file: Open, get the fileno, seek to the end and update mtime */
+/* handle_file: Open, get the fileno, seek to the end (or to where it was
+ * left before a restart) and update mtime
+ */
 int handle_file(int i, int do_fseek, int do_log)
 {
     int fd;
@@ -757,8 +966,19 @@ int handle_file(int i, int do_fseek, int do_log)
     #endif
 
 
-    /* Only seek the end of the file if set to. */
-    if(do_fseek == 1 && S_ISREG(stat_fd.st_mode))
+    /* Anything left from the file opened before is dropped */
+    read_syslog_flush(i, 1);
+
+
+    /* Only seek the end of the file if set to. The compressed ones
+     * are read from the start.
+     */
+    if(position_open(i, &stat_fd, do_fseek))
+    {
+        /* At the saved position */
+    }
+    else if(do_fseek == 1 && S_ISREG(stat_fd.st_mode) &&
+            logff[i].read != (void *)read_gzip)
     {
         /* Windows and fseek causes some weird issues.. */
         #ifndef WIN32
@@ -771,6 +991,16 @@ int handle_file(int i, int do_fseek, int do_log)
         }
         #endif
     }
+    position_update(i);
+
+
+    /* Watching it for changes (the compressed files are polled,
+     * so they are read at logcollector.gzip_rate).
+     */
+    if(logff[i].read != (void *)read_gzip)
+    {
+        notify_watch(i);
+    }
 
 
     /* Setting ignore to zero */
@@ -26,6 +26,10 @@
 #include "config/config.h"
 
 
+/* Read positions of the files */
+#define POSITION_FILE   DEFAULTDIR "/queue/logcollector/positions"
+
+
 
 
 /*** Function prototypes ***/
@@ -40,8 +44,40 @@ void LogCollectorStart();
 /* Handle files */
 int handle_file(int i, int do_fseek, int do_log);
 
+/* File change notifications */
+int notify_init(int readers);
+int notify_fd(int reader);
+void notify_watch(int i);
+int notify_watched(int i);
+void notify_read(int reader);
+int notify_changed_file(int i);
+
+/* Queue of messages (from all the readers) */
+void SendLogInit();
+int SendLogMSG(char *message, char *locmsg, char loc);
+unsigned long SendLogAdded();
+void *SendLogQueue(void *none);
+
+/* Read positions (saved for the restarts) */
+void position_init(int files);
+int position_open(int i, struct stat *st, int do_fseek);
+void position_update(int i);
+void position_read_rotated(int i);
+void position_fname(int i, char *file);
+int position_due();
+void position_save(unsigned long sent);
+
 /* Read syslog file */
 void *read_syslog(int pos, int *rc, int drop_it);
+int read_syslog_pending(int pos);
+void read_syslog_flush(int pos, int drop_it);
+
+/* Read compressed (gzip) syslog file */
+void *read_gzip(int pos, int *rc, int drop_it);
+int read_gzip_check(int pos);
+int read_gzip_pending(int pos);
+unsigned long long read_gzip_offset(int pos);
+void read_gzip_skip(int pos, unsigned long long offset);
 
 /* Read snort full file */
 void *read_snortfull(int pos, int *rc, int drop_it);
@@ -89,7 +125,11 @@ void win_read_vista_sec();
 int loop_timeout;
 int logr_queue;
 int open_file_attempts;
+int logr_threads;
 logreader *logff;
 
+/* Reader (thread) of each logff entry */
+int *logff_reader;
+
 
 #endif
@@ -118,12 +118,20 @@ int main(int argc, char **argv)
     open_file_attempts = getDefine_Int("logcollector", "open_attempts",
                                        2, 998);
 
+    logr_threads = getDefine_Int("logcollector", "threads", 1, 64);
+
     debug_flag = getDefine_Int("logcollector",
                                "debug",
                                0,2);
     accept_manager_commands = getDefine_Int("logcollector", "remote_commands",
                                        0, 1);
 
+    #ifndef WIN32
+    /* Several lines per message to the queue */
+    SetMQBatch(getDefine_Int("logcollector", "mq_batch_wait", 0, 1000));
+    #endif
+
+
     /* Getting debug values */
     while(debug_flag != 0)
     {
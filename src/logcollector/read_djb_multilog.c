@@ -214,14 +214,7 @@ void *read_djbmultilog(int pos, int *rc, int drop_it)
         /* Sending message to queue */
         if(drop_it == 0)
         {
-            if(SendMSG(logr_queue, buffer, logff[pos].file, MYSQL_MQ) < 0)
-            {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
-            }
+            SendLogMSG(buffer, logff[pos].file, MYSQL_MQ);
         }
 
         continue;
@@ -92,16 +92,9 @@ void *read_fullcommand(int pos, int *rc, int drop_it)
         /* Sending message to queue */
         if(drop_it == 0)
         {
-            if(SendMSG(logr_queue,strfinal,
-                        (NULL != logff[pos].alias) ? logff[pos].alias : logff[pos].command,
-                        LOCALFILE_MQ) < 0)
-            {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
-            }
+            SendLogMSG(strfinal,
+                       (NULL != logff[pos].alias) ? logff[pos].alias : logff[pos].command,
+                       LOCALFILE_MQ);
         }
     }
 
@@ -0,0 +1,434 @@
+/* @(#) $Id: ./src/logcollector/read_gzip.c, 2012/03/28 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Read compressed (gzip) files, like the rotated logs. They are read
+ * from the start and decompressed as they are read, line by line (as
+ * read_syslog). To not flood the manager when old logs are read, at
+ * most logcollector.gzip_rate lines per second are sent (from all the
+ * compressed files).
+ */
+
+
+#include "shared.h"
+#include "logcollector.h"
+
+
+#ifndef WIN32
+#include <pthread.h>
+#include "zlib.h"
+
+
+/* Compressed data read at a time */
+#define GZIP_BLOCK      65536
+
+/* Longest line sent. Larger ones are truncated. */
+#define GZIP_MAXLINE    (OS_MAXSTR - OS_LOG_HEADER - 1)
+
+
+typedef struct _gzip_file
+{
+    FILE *fp;
+    z_stream strm;
+
+    /* Lines left (not sent because of the rate) */
+    int pending;
+
+    /* Output left in zlib (the last inflate filled the buffer) */
+    int more;
+
+    /* Rest of a line that was too large */
+    int skip_line;
+
+    /* Data decompressed up to the last line sent, and to
+     * skip (already sent before a restart).
+     */
+    unsigned long long offset;
+    unsigned long long skip;
+
+    /* Decompressed, not sent yet */
+    int size;
+    int start;
+
+    char in[GZIP_BLOCK];
+    char out[GZIP_MAXLINE + GZIP_BLOCK +1];
+}gzip_file;
+
+static gzip_file **gzip_files = NULL;
+static int gzip_nfiles = 0;
+
+/* Lines that can be sent now (rate) */
+static int gzip_rate = -1;
+static long gzip_tokens = 0;
+static time_t gzip_time = 0;
+
+static pthread_mutex_t gzip_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/* _gzip_file: Returns the state of the compressed file at pos. It
+ * starts again if the file was opened again.
+ */
+static gzip_file *_gzip_file(int pos)
+{
+    gzip_file *gz;
+
+    /* Each file is read by one thread, but the array is shared */
+    pthread_mutex_lock(&gzip_mutex);
+
+    if(pos >= gzip_nfiles)
+    {
+        os_realloc(gzip_files, (pos +1) * sizeof(gzip_file *), gzip_files);
+        while(gzip_nfiles <= pos)
+        {
+            gzip_files[gzip_nfiles++] = NULL;
+        }
+    }
+
+    gz = gzip_files[pos];
+    if(!gz)
+    {
+        os_calloc(1, sizeof(gzip_file), gz);
+
+        /* zlib or gzip header */
+        if(inflateInit2(&gz->strm, 32 + MAX_WBITS) != Z_OK)
+        {
+            ErrorExit(MEM_ERROR, ARGV0);
+        }
+
+        gzip_files[pos] = gz;
+    }
+
+    pthread_mutex_unlock(&gzip_mutex);
+
+    if(gz->fp != logff[pos].fp)
+    {
+        inflateReset(&gz->strm);
+        gz->strm.avail_in = 0;
+        gz->fp = logff[pos].fp;
+        gz->pending = 0;
+        gz->more = 0;
+        gz->skip_line = 0;
+        gz->offset = 0;
+        gz->skip = 0;
+        gz->size = 0;
+        gz->start = 0;
+    }
+
+    return(gz);
+}
+
+
+/* _gzip_tokens: Takes the lines that can be sent now (-1 if
+ * unlimited). The ones not used must be given back.
+ */
+static int _gzip_tokens(int give_back)
+{
+    int tokens;
+    long max_tokens;
+    time_t now;
+
+    pthread_mutex_lock(&gzip_mutex);
+
+    now = time(0);
+    if(gzip_rate < 0)
+    {
+        gzip_rate = getDefine_Int("logcollector", "gzip_rate", 0, 1000000);
+        gzip_time = now;
+    }
+
+    if(!gzip_rate)
+    {
+        pthread_mutex_unlock(&gzip_mutex);
+        return(-1);
+    }
+
+    /* The files are read every loop_timeout (at most). The clock
+     * may go back, and a long time may overflow (never negative,
+     * that would be unlimited).
+     */
+    max_tokens = (long)gzip_rate * loop_timeout;
+    if(now > gzip_time && (now - gzip_time) < loop_timeout +1)
+    {
+        gzip_tokens += (long)gzip_rate * (long)(now - gzip_time);
+    }
+    else if(now > gzip_time)
+    {
+        gzip_tokens = max_tokens;
+    }
+    gzip_tokens += give_back;
+
+    if(gzip_tokens > max_tokens)
+    {
+        gzip_tokens = max_tokens;
+    }
+    else if(gzip_tokens < 0)
+    {
+        gzip_tokens = 0;
+    }
+    gzip_time = now;
+
+    tokens = 0;
+    if(!give_back)
+    {
+        tokens = (int)gzip_tokens;
+        gzip_tokens = 0;
+    }
+
+    pthread_mutex_unlock(&gzip_mutex);
+
+    return(tokens);
+}
+
+
+/* _gzip_line: Sends one line (str is changed), unless it was
+ * sent before a restart.
+ */
+static void _gzip_line(int pos, gzip_file *gz, char *str, int size,
+                       int drop_it)
+{
+    int len = size;
+
+    if(gz->skip_line)
+    {
+        gz->skip_line = 0;
+        gz->offset += size +1;
+        return;
+    }
+
+    /* Message size > maximum allowed */
+    if(size >= GZIP_MAXLINE)
+    {
+        merror("%s: Large message size(length=%d) from '%s'.", ARGV0,
+               size, logff[pos].file);
+        size = GZIP_MAXLINE;
+    }
+    str[size] = '\0';
+
+    gz->offset += len +1;
+    if(gz->offset <= gz->skip)
+    {
+        return;
+    }
+
+    debug2("%s: DEBUG: Reading compressed message: '%s'", ARGV0, str);
+
+    if(drop_it == 0)
+    {
+        SendLogMSG(str, logff[pos].file, LOCALFILE_MQ);
+    }
+}
+
+
+/* read_gzip_check: If the file at pos is compressed (.gz). */
+int read_gzip_check(int pos)
+{
+    int len;
+
+    if(!logff[pos].file)
+    {
+        return(0);
+    }
+
+    len = strlen(logff[pos].file);
+    if(len > 3 && strcmp(logff[pos].file + len - 3, ".gz") == 0)
+    {
+        return(1);
+    }
+
+    return(0);
+}
+
+
+/* read_gzip_pending: If there are lines left (the file may be at its
+ * end already).
+ */
+int read_gzip_pending(int pos)
+{
+    int pending = 0;
+
+    pthread_mutex_lock(&gzip_mutex);
+
+    if(pos < gzip_nfiles && gzip_files[pos] &&
+       gzip_files[pos]->fp == logff[pos].fp)
+    {
+        pending = gzip_files[pos]->pending;
+    }
+
+    pthread_mutex_unlock(&gzip_mutex);
+
+    return(pending);
+}
+
+
+/* read_gzip_offset: Data decompressed up to the last line sent
+ * (the position of the file).
+ */
+unsigned long long read_gzip_offset(int pos)
+{
+    gzip_file *gz = _gzip_file(pos);
+
+    return(gz->offset > gz->skip?gz->offset:gz->skip);
+}
+
+
+/* read_gzip_skip: Skips the data (decompressed) already sent. */
+void read_gzip_skip(int pos, unsigned long long offset)
+{
+    gzip_file *gz = _gzip_file(pos);
+
+    gz->skip = offset;
+}
+
+
+/* Read compressed syslog files */
+void *read_gzip(int pos, int *rc, int drop_it)
+{
+    int n, ret;
+    int tokens;
+    char *str, *end, *nl;
+    gzip_file *gz;
+
+    *rc = 0;
+
+    gz = _gzip_file(pos);
+    tokens = _gzip_tokens(0);
+    gz->pending = 0;
+
+    while(1)
+    {
+        /* Lines already decompressed */
+        str = gz->out + gz->start;
+        end = gz->out + gz->size;
+
+        while(tokens != 0 && (nl = memchr(str, '\n', end - str)) != NULL)
+        {
+            if(gz->offset >= gz->skip && !gz->skip_line && tokens > 0)
+            {
+                tokens--;
+            }
+
+            _gzip_line(pos, gz, str, nl - str, drop_it);
+            str = nl + 1;
+        }
+        gz->start = str - gz->out;
+
+        /* Waiting for the next read (rate) */
+        if(tokens == 0)
+        {
+            gz->pending = 1;
+            break;
+        }
+
+        /* Message not complete. Keeping it at the start. */
+        gz->size = end - str;
+        memmove(gz->out, str, gz->size);
+        gz->start = 0;
+
+        if(gz->size >= GZIP_MAXLINE)
+        {
+            if(!gz->skip_line)
+            {
+                _gzip_line(pos, gz, gz->out, gz->size, drop_it);
+                gz->offset -= 1;
+                gz->skip_line = 1;
+            }
+            else
+            {
+                gz->offset += gz->size;
+            }
+            gz->size = 0;
+        }
+
+
+        /* Decompressing some more */
+        if(gz->strm.avail_in == 0 && !gz->more)
+        {
+            n = fread(gz->in, 1, GZIP_BLOCK, logff[pos].fp);
+            if(n <= 0)
+            {
+                break;
+            }
+
+            gz->strm.next_in = (Bytef *)gz->in;
+            gz->strm.avail_in = n;
+        }
+
+        gz->strm.next_out = (Bytef *)(gz->out + gz->size);
+        gz->strm.avail_out = GZIP_BLOCK;
+
+        ret = inflate(&gz->strm, Z_NO_FLUSH);
+        gz->size += GZIP_BLOCK - gz->strm.avail_out;
+        gz->more = (gz->strm.avail_out == 0);
+
+        /* Files can have more than one stream (cat a.gz b.gz) */
+        if(ret == Z_STREAM_END)
+        {
+            inflateReset(&gz->strm);
+        }
+        else if(ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            merror("%s: ERROR: Unable to decompress '%s': %s.", ARGV0,
+                   logff[pos].file,
+                   gz->strm.msg?gz->strm.msg:"invalid data");
+
+            /* Ignoring the rest of it */
+            fseek(logff[pos].fp, 0, SEEK_END);
+            gz->strm.avail_in = 0;
+            gz->more = 0;
+            gz->size = 0;
+            break;
+        }
+    }
+
+    if(tokens > 0)
+    {
+        _gzip_tokens(tokens);
+    }
+
+    return(NULL);
+}
+
+
+
+#else
+
+/* Not on Windows (the files are opened as text) */
+int read_gzip_check(int pos)
+{
+    return(0);
+}
+
+int read_gzip_pending(int pos)
+{
+    return(0);
+}
+
+unsigned long long read_gzip_offset(int pos)
+{
+    return(0);
+}
+
+void read_gzip_skip(int pos, unsigned long long offset)
+{
+    return;
+}
+
+void *read_gzip(int pos, int *rc, int drop_it)
+{
+    *rc = 0;
+    return(NULL);
+}
+
+#endif
+
+/* EOF */
@@ -28,14 +28,7 @@ void __send_mssql_msg(int pos, int drop_it, char *buffer)
     debug2("%s: DEBUG: Reading MSSQL message: '%s'", ARGV0, buffer);
     if(drop_it == 0)
     {
-        if(SendMSG(logr_queue, buffer, logff[pos].file, LOCALFILE_MQ) < 0)
-        {
-            merror(QUEUE_SEND, ARGV0);
-            if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-            {
-                ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-            }
-        }
+        SendLogMSG(buffer, logff[pos].file, LOCALFILE_MQ);
     }
 }
 
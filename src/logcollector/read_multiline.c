@@ -97,15 +97,7 @@ void *read_multiline(int pos, int *rc, int drop_it)
         /* Sending message to queue */
         if(drop_it == 0)
         {
-            if(SendMSG(logr_queue, buffer, logff[pos].file,
-                        LOCALFILE_MQ) < 0)
-            {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
-            }
+            SendLogMSG(buffer, logff[pos].file, LOCALFILE_MQ);
         }
 
         buffer[0] = '\0';
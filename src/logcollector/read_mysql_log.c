@@ -19,9 +19,58 @@
 #include "shared.h"
 #include "logcollector.h"
 
+#ifndef WIN32
+#include <pthread.h>
+#endif
 
-/* Starting last time */
-char __mysql_last_time[18] = {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
+
+/* Last time seen on each file (the next events may
+ * only have the message).
+ */
+#define MYSQL_TIMESIZE  18
+
+static char **mysql_last_times = NULL;
+static int mysql_ntimes = 0;
+
+#ifndef WIN32
+static pthread_mutex_t mysql_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+
+/* _mysql_last_time: Returns the last time of the file at pos.
+ */
+static char *_mysql_last_time(int pos)
+{
+    char *last_time;
+
+    #ifndef WIN32
+    /* Each file is read by one thread, but the array is shared */
+    pthread_mutex_lock(&mysql_mutex);
+    #endif
+
+    if(pos >= mysql_ntimes)
+    {
+        os_realloc(mysql_last_times, (pos +1) * sizeof(char *),
+                   mysql_last_times);
+        while(mysql_ntimes <= pos)
+        {
+            mysql_last_times[mysql_ntimes++] = NULL;
+        }
+    }
+
+    if(!mysql_last_times[pos])
+    {
+        os_calloc(MYSQL_TIMESIZE, sizeof(char), mysql_last_times[pos]);
+    }
+    last_time = mysql_last_times[pos];
+
+    #ifndef WIN32
+    pthread_mutex_unlock(&mysql_mutex);
+    #endif
+
+    return(last_time);
+}
 
 
 
@@ -31,12 +80,15 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
     int str_len = 0;
     int need_clear = 0;
     char *p;
+    char *last_time;
     char str[OS_MAXSTR + 1];
     char buffer[OS_MAXSTR + 1];
 
     str[OS_MAXSTR]= '\0';
     *rc = 0;
 
+    last_time = _mysql_last_time(pos);
+
 
     /* Getting new entry */
     while(fgets(str, OS_MAXSTR - OS_LOG_HEADER, logff[pos].fp) != NULL)
@@ -103,8 +155,8 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
            isdigit((int)str[8]))
         {
             /* Saving last time */
-            strncpy(__mysql_last_time, str, 16);
-            __mysql_last_time[15] = '\0';
+            strncpy(last_time, str, 16);
+            last_time[15] = '\0';
 
 
             /* Removing spaces and tabs */
@@ -117,7 +169,7 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
 
             /* Valid MySQL message */
             snprintf(buffer, OS_MAXSTR, "MySQL log: %s %s",
-                                        __mysql_last_time, p);
+                                        last_time, p);
         }
 
 
@@ -125,7 +177,7 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
          * time stamp.
          * 0909 2020 2020 2020 20
          */
-        else if((str_len > 10) && (__mysql_last_time[0] != '\0') &&
+        else if((str_len > 10) && (last_time[0] != '\0') &&
                 (str[0] == 0x09) &&
                 (str[1] == 0x09) &&
                 (str[2] == 0x20) &&
@@ -146,7 +198,7 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
 
             /* Valid MySQL message */
             snprintf(buffer, OS_MAXSTR, "MySQL log: %s %s",
-                                        __mysql_last_time, p);
+                                        last_time, p);
         }
         else
         {
@@ -160,14 +212,7 @@ void *read_mysql_log(int pos, int *rc, int drop_it)
         /* Sending message to queue */
         if(drop_it == 0)
         {
-            if(SendMSG(logr_queue, buffer, logff[pos].file, MYSQL_MQ) < 0)
-            {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
-            }
+            SendLogMSG(buffer, logff[pos].file, MYSQL_MQ);
         }
 
         continue;
@@ -294,15 +294,7 @@ void *read_nmapg(int pos, int *rc, int drop_it)
         if(drop_it == 0)
         {
             /* Sending message to queue */
-            if(SendMSG(logr_queue, final_msg, logff[pos].file,
-                        HOSTINFO_MQ) < 0)
-            {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
-            }
+            SendLogMSG(final_msg, logff[pos].file, HOSTINFO_MQ);
         }
 
 
@@ -92,15 +92,7 @@ void *read_snortfull(int pos, int *rc, int drop_it)
                     /* Sending the message */
                     if(drop_it == 0)
                     {
-                        if(SendMSG(logr_queue,f_msg, logff[pos].file,
-                                    LOCALFILE_MQ) < 0)
-                        {
-                            merror(QUEUE_SEND, ARGV0);
-                            if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                            {
-                                ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                            }
-                        }
+                        SendLogMSG(f_msg, logff[pos].file, LOCALFILE_MQ);
                     }
 
                     f_msg[0] = '\0';
@@ -124,15 +116,7 @@ void *read_snortfull(int pos, int *rc, int drop_it)
                     /* Sending the message */
                     if(drop_it == 0)
                     {
-                        if(SendMSG(logr_queue,f_msg, logff[pos].file,
-                                    LOCALFILE_MQ) < 0)
-                        {
-                            merror(QUEUE_SEND, ARGV0);
-                            if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                            {
-                                ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                            }
-                        }
+                        SendLogMSG(f_msg, logff[pos].file, LOCALFILE_MQ);
                     }
 
                     f_msg[0] = '\0';
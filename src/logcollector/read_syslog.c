@@ -16,115 +16,301 @@
 #include "shared.h"
 #include "logcollector.h"
 
+#ifndef WIN32
+#include <pthread.h>
+#endif
 
 
-/* v0.3 (2005/08/24): Using fgets instead of fgetc
+
+/* v0.4 (2012/03/28): Reading blocks instead of lines
+ * v0.3 (2005/08/24): Using fgets instead of fgetc
  * v0.2 (2005/04/04)
  */
 
-/* Read syslog files/snort fast/apache files */
-void *read_syslog(int pos, int *rc, int drop_it)
+
+/* Size of each read. The incomplete line at the end of a block
+ * is kept (per file) until the next one.
+ */
+#define SYSLOG_BLOCK    65536
+
+/* Longest line sent. Larger ones are truncated. */
+#define SYSLOG_MAXLINE  (OS_MAXSTR - OS_LOG_HEADER - 1)
+
+
+typedef struct _syslog_carry
 {
-    int __ms = 0;
-    char *p;
-    char str[OS_MAXSTR+1];
+    FILE *fp;
+    off_t offset;
+    int regular;
+    int size;
+    int skip;
+    char buf[SYSLOG_MAXLINE +1];
+}syslog_carry;
 
-    fpos_t fp_pos;
+static syslog_carry **syslog_carries = NULL;
+static int syslog_ncarries = 0;
 
-    str[OS_MAXSTR]= '\0';
-    *rc = 0;
+#ifndef WIN32
+static pthread_mutex_t syslog_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+
+/* _syslog_carry: Returns the incomplete line left for the file at pos.
+ * It is dropped if the file was opened again or moved (seek).
+ * Only regular files are read in blocks (fread would wait for the
+ * whole block on a pipe).
+ */
+static syslog_carry *_syslog_carry(int pos)
+{
+    syslog_carry *carry;
 
-    /* Getting initial file location */
-    fgetpos(logff[pos].fp, &fp_pos);
+    #ifndef WIN32
+    /* Each file is read by one thread, but the array is shared */
+    pthread_mutex_lock(&syslog_mutex);
+    #endif
 
-    while(fgets(str, OS_MAXSTR - OS_LOG_HEADER, logff[pos].fp) != NULL)
+    if(pos >= syslog_ncarries)
     {
-        /* Getting the last occurence of \n */
-        if ((p = strrchr(str, '\n')) != NULL)
+        os_realloc(syslog_carries, (pos +1) * sizeof(syslog_carry *),
+                   syslog_carries);
+        while(syslog_ncarries <= pos)
         {
-            *p = '\0';
+            syslog_carries[syslog_ncarries++] = NULL;
         }
+    }
 
-        /* If we didn't get the new line, because the
-         * size is large, send what we got so far.
-         */
-        else if(strlen(str) >= (OS_MAXSTR - OS_LOG_HEADER - 2))
+    if(!syslog_carries[pos])
+    {
+        os_calloc(1, sizeof(syslog_carry), syslog_carries[pos]);
+    }
+    carry = syslog_carries[pos];
+
+    #ifndef WIN32
+    pthread_mutex_unlock(&syslog_mutex);
+    #endif
+
+    if(carry->size || carry->skip)
+    {
+        if((carry->fp != logff[pos].fp) ||
+           (ftello(logff[pos].fp) != carry->offset))
         {
-            /* Message size > maximum allowed */
-            __ms = 1;
+            carry->size = 0;
+            carry->skip = 0;
         }
-        else
+    }
+
+    if(carry->fp != logff[pos].fp)
+    {
+        struct stat st;
+
+        carry->fp = logff[pos].fp;
+        carry->regular = 0;
+        if((fstat(fileno(carry->fp), &st) == 0) && S_ISREG(st.st_mode))
         {
-            /* Message not complete. Return. */
-            debug1("%s: Message not complete. Trying again: '%s'", ARGV0,str);
-            fsetpos(logff[pos].fp, &fp_pos);
-            break;
+            carry->regular = 1;
         }
+    }
 
-        #ifdef WIN32
-        if ((p = strrchr(str, '\r')) != NULL)
+    return(carry);
+}
+
+
+/* _syslog_line: Sends one line (str is changed).
+ */
+static void _syslog_line(int pos, char *str, int size, int drop_it)
+{
+    #ifdef WIN32
+    char *p;
+    #endif
+
+    /* Message size > maximum allowed */
+    if(size >= SYSLOG_MAXLINE)
+    {
+        // truncate str before logging to ossec.log
+#define OUTSIZE 4096
+        char buf[OUTSIZE + 1];
+        buf[OUTSIZE] = '\0';
+
+        size = SYSLOG_MAXLINE;
+        str[size] = '\0';
+        snprintf(buf, OUTSIZE, "%s", str);
+        merror("%s: Large message size(length=%d): '%s...'", ARGV0, size, buf);
+    }
+
+    str[size] = '\0';
+
+    #ifdef WIN32
+    if ((p = strrchr(str, '\r')) != NULL)
+    {
+        *p = '\0';
+    }
+
+    /* Looking for empty string (only on windows) */
+    if(strlen(str) <= 2)
+    {
+        return;
+    }
+
+    /* Windows can have comment on their logs */
+    if(str[0] == '#')
+    {
+        return;
+    }
+    #endif
+
+    debug2("%s: DEBUG: Reading syslog message: '%s'", ARGV0, str);
+
+
+    /* Sending message to queue */
+    if(drop_it == 0)
+    {
+        SendLogMSG(str, logff[pos].file, LOCALFILE_MQ);
+    }
+
+    return;
+}
+
+
+/* Read syslog files/snort fast/apache files */
+void *read_syslog(int pos, int *rc, int drop_it)
+{
+    int size, n;
+    char *str, *end, *nl;
+    char syslog_block[SYSLOG_MAXLINE + SYSLOG_BLOCK +1];
+    syslog_carry *carry;
+
+    *rc = 0;
+
+    carry = _syslog_carry(pos);
+
+    do
+    {
+        /* Incomplete line from the last read goes first */
+        size = carry->size;
+        memcpy(syslog_block, carry->buf, size);
+        carry->size = 0;
+
+        if(carry->regular)
         {
-            *p = '\0';
+            n = fread(syslog_block + size, 1, SYSLOG_BLOCK, logff[pos].fp);
         }
-
-        /* Looking for empty string (only on windows) */
-        if(strlen(str) <= 2)
+        else if(fgets(syslog_block + size, SYSLOG_BLOCK, logff[pos].fp))
         {
-            fgetpos(logff[pos].fp, &fp_pos);
-            continue;
+            n = strlen(syslog_block + size);
         }
-
-        /* Windows can have comment on their logs */
-        if(str[0] == '#')
+        else
         {
-            fgetpos(logff[pos].fp, &fp_pos);
-            continue;
+            n = 0;
         }
-        #endif
 
-        debug2("%s: DEBUG: Reading syslog message: '%s'", ARGV0, str);
+        if(n <= 0)
+        {
+            carry->size = size;
+            break;
+        }
 
+        str = syslog_block;
+        end = syslog_block + size + n;
 
-        /* Sending message to queue */
-        if(drop_it == 0)
+        while((nl = memchr(str, '\n', end - str)) != NULL)
         {
-            if(SendMSG(logr_queue,str,logff[pos].file,
-                        LOCALFILE_MQ) < 0)
+            /* End of a line that was too large */
+            if(carry->skip)
             {
-                merror(QUEUE_SEND, ARGV0);
-                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
-                {
-                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
-                }
+                carry->skip = 0;
             }
+            else
+            {
+                _syslog_line(pos, str, nl - str, drop_it);
+            }
+            str = nl + 1;
         }
 
-        /* Incorrectly message size */
-        if(__ms)
+        /* Message not complete. Waiting for the rest. */
+        size = end - str;
+        if(carry->skip)
         {
-            // strlen(str) >= (OS_MAXSTR - OS_LOG_HEADER - 2)
-            // truncate str before logging to ossec.log
-#define OUTSIZE 4096
-            char buf[OUTSIZE + 1];
-            buf[OUTSIZE] = '\0';
-            snprintf(buf, OUTSIZE, "%s", str);
-            merror("%s: Large message size(length=%d): '%s...'", ARGV0, (int)strlen(str), buf);
-            while(fgets(str, OS_MAXSTR - 2, logff[pos].fp) != NULL)
-            {
-                /* Getting the last occurence of \n */
-                if ((p = strrchr(str, '\n')) != NULL)
-                {
-                    break;
-                }
-            }
-            __ms = 0;
+            size = 0;
+        }
+        else if(size >= SYSLOG_MAXLINE)
+        {
+            _syslog_line(pos, str, size, drop_it);
+            carry->skip = 1;
+            size = 0;
         }
 
-        fgetpos(logff[pos].fp, &fp_pos);
-        continue;
-    }
+        memcpy(carry->buf, str, size);
+        carry->size = size;
+
+    }while(carry->regular?(n == SYSLOG_BLOCK):(n > 0));
+
+    carry->offset = ftello(logff[pos].fp);
 
     return(NULL);
 }
 
+
+/* read_syslog_pending: Bytes read from the file at pos that were not
+ * sent yet (the incomplete line at the end).
+ */
+int read_syslog_pending(int pos)
+{
+    int size = 0;
+
+    #ifndef WIN32
+    pthread_mutex_lock(&syslog_mutex);
+    #endif
+
+    if(pos < syslog_ncarries && syslog_carries[pos] &&
+       syslog_carries[pos]->fp == logff[pos].fp &&
+       !syslog_carries[pos]->skip)
+    {
+        size = syslog_carries[pos]->size;
+    }
+
+    #ifndef WIN32
+    pthread_mutex_unlock(&syslog_mutex);
+    #endif
+
+    return(size);
+}
+
+
+/* read_syslog_flush: Sends (unless drop_it) the incomplete line left
+ * from the file at pos and forgets it. Must be called before the file
+ * is closed (a new one may get the same FILE pointer).
+ */
+void read_syslog_flush(int pos, int drop_it)
+{
+    syslog_carry *carry = NULL;
+
+    #ifndef WIN32
+    pthread_mutex_lock(&syslog_mutex);
+    #endif
+
+    if(pos < syslog_ncarries)
+    {
+        carry = syslog_carries[pos];
+    }
+
+    #ifndef WIN32
+    pthread_mutex_unlock(&syslog_mutex);
+    #endif
+
+    if(!carry)
+    {
+        return;
+    }
+
+    if(carry->size && !carry->skip && carry->fp == logff[pos].fp)
+    {
+        _syslog_line(pos, carry->buf, carry->size, drop_it);
+    }
+
+    carry->fp = NULL;
+    carry->size = 0;
+    carry->skip = 0;
+}
+
 /* EOF */
@@ -0,0 +1,207 @@
+/* @(#) $Id: ./src/logcollector/sendlog.c, 2012/03/28 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Queue of the messages read by all the readers (threads). They are
+ * sent to the queue (analysisd/agentd) by a single thread, since
+ * SendMSG is not thread safe. When it is full (logcollector.queue_size),
+ * the readers wait.
+ */
+
+
+#include "shared.h"
+
+#include "logcollector.h"
+
+
+#ifndef WIN32
+#include <pthread.h>
+
+
+/* Messages sent at a time */
+#define SENDLOG_BATCH   64
+
+
+static char **sendlog_queue = NULL;
+static int sendlog_size = 0;
+static int sendlog_head = 0;
+static int sendlog_count = 0;
+static unsigned long sendlog_added = 0;
+
+static pthread_mutex_t sendlog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sendlog_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sendlog_space = PTHREAD_COND_INITIALIZER;
+
+
+
+/* SendLogInit: Allocates the queue.
+ */
+void SendLogInit()
+{
+    sendlog_size = getDefine_Int("logcollector", "queue_size", 16, 100000);
+    os_calloc(sendlog_size, sizeof(char *), sendlog_queue);
+}
+
+
+/* SendLogMSG: Adds a message to the queue (waiting if it is full).
+ * Each entry is the loc, followed by locmsg and message.
+ */
+int SendLogMSG(char *message, char *locmsg, char loc)
+{
+    int loc_size = strlen(locmsg) +1;
+    int msg_size = strlen(message) +1;
+    char *entry;
+
+    os_malloc(1 + loc_size + msg_size, entry);
+    entry[0] = loc;
+    memcpy(entry + 1, locmsg, loc_size);
+    memcpy(entry + 1 + loc_size, message, msg_size);
+
+    pthread_mutex_lock(&sendlog_mutex);
+
+    while(sendlog_count == sendlog_size)
+    {
+        pthread_cond_wait(&sendlog_space, &sendlog_mutex);
+    }
+
+    sendlog_queue[(sendlog_head + sendlog_count) % sendlog_size] = entry;
+    sendlog_count++;
+    sendlog_added++;
+
+    pthread_cond_signal(&sendlog_cond);
+    pthread_mutex_unlock(&sendlog_mutex);
+
+    return(0);
+}
+
+
+/* SendLogAdded: Messages added to the queue so far. */
+unsigned long SendLogAdded()
+{
+    unsigned long added;
+
+    pthread_mutex_lock(&sendlog_mutex);
+    added = sendlog_added;
+    pthread_mutex_unlock(&sendlog_mutex);
+
+    return(added);
+}
+
+
+/* SendLogQueue: Sends the messages from the queue. Never returns.
+ * The batched ones (logcollector.mq_batch_wait) are flushed
+ * when the queue is empty, or before the read positions are saved.
+ */
+void *SendLogQueue(void *none)
+{
+    int i, n;
+    int empty, save;
+    unsigned long sent = 0;
+    char *entry;
+    char *entries[SENDLOG_BATCH];
+    struct timespec wait_time;
+
+    while(1)
+    {
+        pthread_mutex_lock(&sendlog_mutex);
+
+        /* Waking up every second to save the positions */
+        while(sendlog_count == 0)
+        {
+            wait_time.tv_sec = time(0) + 1;
+            wait_time.tv_nsec = 0;
+            if(pthread_cond_timedwait(&sendlog_cond, &sendlog_mutex,
+                                      &wait_time) == ETIMEDOUT)
+            {
+                break;
+            }
+        }
+
+        for(n = 0; n < SENDLOG_BATCH && sendlog_count; n++)
+        {
+            entries[n] = sendlog_queue[sendlog_head];
+            sendlog_head = (sendlog_head + 1) % sendlog_size;
+            sendlog_count--;
+        }
+        empty = (sendlog_count == 0);
+
+        pthread_cond_broadcast(&sendlog_space);
+        pthread_mutex_unlock(&sendlog_mutex);
+
+
+        for(i = 0; i < n; i++)
+        {
+            entry = entries[i];
+
+            if(SendMSG(logr_queue, entry + 1 + strlen(entry + 1) + 1,
+                       entry + 1, entry[0]) < 0)
+            {
+                merror(QUEUE_SEND, ARGV0);
+                if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
+                {
+                    ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
+                }
+            }
+
+            free(entry);
+        }
+        sent += n;
+
+
+        /* Sending the batched messages */
+        save = position_due();
+        if((empty || save) && FlushMSG(logr_queue) < 0)
+        {
+            merror(QUEUE_SEND, ARGV0);
+            if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
+            {
+                ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
+            }
+        }
+
+        if(save)
+        {
+            position_save(sent);
+        }
+    }
+
+    return(NULL);
+}
+
+
+
+#else
+
+/* On Windows, the messages are sent directly (single reader) */
+void SendLogInit()
+{
+    return;
+}
+
+int SendLogMSG(char *message, char *locmsg, char loc)
+{
+    if(SendMSG(logr_queue, message, locmsg, loc) < 0)
+    {
+        merror(QUEUE_SEND, ARGV0);
+        if((logr_queue = StartMQ(DEFAULTQPATH,WRITE)) < 0)
+        {
+            ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQPATH);
+        }
+    }
+
+    return(0);
+}
+
+#endif
+
+
+/* EOF */
@@ -0,0 +1,176 @@
+/* Read positions of logcollector: a file rotated in the middle of a
+ * line while logcollector was stopped. The rest of the old file (with
+ * its last line, even without a new line) must be sent before the new
+ * file. Run it from an empty directory.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "shared.h"
+#include "../logcollector.h"
+
+
+#define MAX_SENT    64
+
+static char *sent[MAX_SENT];
+static int sent_n = 0;
+
+
+/* Stubs of the rest of logcollector */
+int SendLogMSG(char *message, char *locmsg, char loc)
+{
+    if(sent_n < MAX_SENT)
+    {
+        sent[sent_n++] = strdup(message);
+    }
+    return(0);
+}
+
+unsigned long SendLogAdded()
+{
+    return(sent_n);
+}
+
+int getDefine_Int(char *high_name, char *low_name, int min, int max)
+{
+    return(5);
+}
+
+void *read_gzip(int pos, int *rc, int drop_it)
+{
+    return(NULL);
+}
+
+unsigned long long read_gzip_offset(int pos)
+{
+    return(0);
+}
+
+void read_gzip_skip(int pos, unsigned long long offset)
+{
+    return;
+}
+
+
+static void write_file(char *file, char *mode, char *data)
+{
+    FILE *fp = fopen(file, mode);
+
+    if(!fp)
+    {
+        ErrorExit("position_test: Unable to open '%s'.", file);
+    }
+    fputs(data, fp);
+    fclose(fp);
+}
+
+
+/* Opens the file at 0 (as handle_file) and reads it */
+static void start(int do_read)
+{
+    int r = 0;
+    struct stat st;
+
+    position_init(1);
+
+    os_calloc(1, sizeof(logreader), logff);
+    os_strdup("test.log", logff[0].file);
+    logff[0].read = (void *)read_syslog;
+    logff[0].fp = fopen(logff[0].file, "r");
+    if(!logff[0].fp || fstat(fileno(logff[0].fp), &st) < 0)
+    {
+        ErrorExit("position_test: Unable to open '%s'.", logff[0].file);
+    }
+
+    read_syslog_flush(0, 1);
+    position_open(0, &st, 1);
+    position_update(0);
+
+    /* As LogCollectorRead */
+    if(do_read)
+    {
+        position_read_rotated(0);
+        read_syslog(0, &r, 0);
+        position_update(0);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    int i, status;
+    int failed = 0;
+    char *expected[] = {"partial 3", "line 4", "line 5", "line 6", NULL};
+    pid_t pid;
+
+    if(mkdir("queue", 0700) < 0 || mkdir("queue/logcollector", 0700) < 0)
+    {
+        ErrorExit("position_test: Unable to create the queue directory.");
+    }
+
+
+    /* First run: from the start, stopped in the middle of a line */
+    write_file("test.log", "w", "line 1\nline 2\npart");
+
+    pid = fork();
+    if(pid == 0)
+    {
+        int r = 0;
+
+        start(0);
+        read_syslog(0, &r, 0);
+        position_update(0);
+        position_save(SendLogAdded());
+
+        for(i = 0; i < sent_n; i++)
+        {
+            printf("first run: '%s'\n", sent[i]);
+        }
+        exit(sent_n == 2?0:1);
+    }
+    if(pid < 0 || waitpid(pid, &status, 0) != pid || status != 0)
+    {
+        printf("FAIL: first run.\n");
+        return(1);
+    }
+
+
+    /* While stopped: the line is completed, another one is left
+     * incomplete and the file is rotated.
+     */
+    write_file("test.log", "a", "ial 3\nline 4");
+    if(rename("test.log", "test.log.1") < 0)
+    {
+        ErrorExit("position_test: Unable to rotate the file.");
+    }
+    write_file("test.log", "w", "line 5\nline 6\n");
+
+
+    /* Second run: the rest of test.log.1, then test.log */
+    start(1);
+
+    for(i = 0; i < sent_n || expected[i]; i++)
+    {
+        if(i >= sent_n || !expected[i] || strcmp(sent[i], expected[i]) != 0)
+        {
+            printf("FAIL: expected '%s', sent '%s'.\n",
+                   expected[i]?expected[i]:"(nothing)",
+                   i < sent_n?sent[i]:"(nothing)");
+            failed = 1;
+            continue;
+        }
+        printf("second run: '%s'\n", sent[i]);
+    }
+
+    if(failed)
+    {
+        return(1);
+    }
+
+    printf("OK\n");
+    return(0);
+}
+
+
+/* EOF */
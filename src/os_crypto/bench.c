@@ -0,0 +1,269 @@
+/* @(#) $Id: ./src/os_crypto/bench.c, 2011/09/08 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Micro benchmark of the agent message decryption (what remoted does
+ * for each event): Blowfish-CBC decryption plus the MD5 checksum.
+ * Three columns:
+ *  - before: the code replaced (key set on every message, one block
+ *    at a time CBC decryption, MD5 copying every chunk and snprintf
+ *    for the digest). It is kept here only for the comparison.
+ *  - per-message key: OS_BF_Str and OS_MD5_Str (the new kernels,
+ *    still setting the key on every message).
+ *  - after: OS_BF_StrKey (key schedule set once) and OS_MD5_Str.
+ * Usage: ./bench [messages]
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "blowfish/bf_op.h"
+#include "blowfish/blowfish.h"
+#include "md5/md5_op.h"
+#include "md5/md5.h"
+
+
+#define BENCH_MSGS  100000
+
+
+static char *bench_key = "1e4a1f5c6a1c0fde8a4c2e5e7e1ad7bd0123456789abcdef";
+
+static unsigned char bench_iv[8]={0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
+
+/* Same as md5.c (nothing to reverse on little endian) */
+#ifdef __BYTE_ORDER
+#if __BYTE_ORDER == __BIG_ENDIAN
+    #define HIGHFIRST
+#endif
+#endif
+
+#ifndef HIGHFIRST
+#define byteReverse(buf, len)
+#else
+void byteReverse(unsigned char *buf, unsigned longs);
+#endif
+
+/* Big endian load/store (n2l/l2n of bf_locl.h) */
+#define BENCH_N2L(c)    (((BF_LONG)(c)[0] << 24) | ((BF_LONG)(c)[1] << 16) | \
+                         ((BF_LONG)(c)[2] << 8) | ((BF_LONG)(c)[3]))
+#define BENCH_L2N(l,c)  ((c)[0] = (unsigned char)(((l) >> 24) & 0xff), \
+                         (c)[1] = (unsigned char)(((l) >> 16) & 0xff), \
+                         (c)[2] = (unsigned char)(((l) >> 8) & 0xff), \
+                         (c)[3] = (unsigned char)((l) & 0xff))
+
+
+/* _bench_time: Seconds since the epoch (with the microseconds). */
+static double _bench_time()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return((double)tv.tv_sec + (double)tv.tv_usec / 1000000.0);
+}
+
+
+/* _bench_bf_before: Blowfish-CBC decryption as it was done before:
+ * key set for the message, one block at a time (size must be a
+ * multiple of 8).
+ */
+static void _bench_bf_before(char *input, char *output, long size)
+{
+    long l;
+    BF_KEY key;
+    BF_LONG tin[2];
+    BF_LONG xor0, xor1, tin0, tin1;
+    unsigned char *in = (unsigned char *)input;
+    unsigned char *out = (unsigned char *)output;
+
+    BF_set_key(&key, strlen(bench_key), (unsigned char *)bench_key);
+
+    xor0 = BENCH_N2L(bench_iv);
+    xor1 = BENCH_N2L(bench_iv + 4);
+
+    for(l = 0; l < size; l += 8)
+    {
+        tin0 = BENCH_N2L(in + l);
+        tin1 = BENCH_N2L(in + l + 4);
+        tin[0] = tin0;
+        tin[1] = tin1;
+        BF_decrypt(tin, &key);
+        BENCH_L2N(tin[0] ^ xor0, out + l);
+        BENCH_L2N(tin[1] ^ xor1, out + l + 4);
+        xor0 = tin0;
+        xor1 = tin1;
+    }
+}
+
+
+/* _bench_md5_before: OS_MD5_Str as it was done before: every 64 bytes
+ * chunk copied (and reversed) before the transform, and the digest
+ * written with snprintf.
+ */
+static void _bench_md5_before(char *str, char *output)
+{
+    int n;
+    unsigned len = strlen(str);
+    unsigned char *buf = (unsigned char *)str;
+    unsigned char digest[16];
+    MD5_CTX ctx;
+
+    MD5Init(&ctx);
+
+    ctx.bits[0] = (uint32)len << 3;
+    ctx.bits[1] = len >> 29;
+
+    while(len >= 64)
+    {
+        memcpy(ctx.in, buf, 64);
+        byteReverse(ctx.in, 16);
+        MD5Transform(ctx.buf, (uint32 *)ctx.in);
+        buf += 64;
+        len -= 64;
+    }
+    memcpy(ctx.in, buf, len);
+
+    MD5Final(digest, &ctx);
+
+    output[32] = '\0';
+    for(n = 0; n < 16; n++)
+    {
+        snprintf(output, 3, "%02x", digest[n]);
+        output += 2;
+    }
+}
+
+
+/* _bench_run: Decrypts (and checks) msgs messages of size bytes.
+ * Returns the messages per second.
+ */
+static double _bench_run(char *input, char *clear, long size,
+                         void *key, int before, int msgs)
+{
+    int i;
+    char sum[33];
+    double start;
+
+    start = _bench_time();
+    for(i = 0; i < msgs; i++)
+    {
+        if(before)
+        {
+            _bench_bf_before(input, clear, size);
+        }
+        else if(key)
+        {
+            OS_BF_StrKey(input, clear, key, size, OS_DECRYPT);
+        }
+        else
+        {
+            OS_BF_Str(input, clear, bench_key, size, OS_DECRYPT);
+        }
+
+        /* Checksum of the message, after the md5 itself */
+        clear[size -1] = '\0';
+        if(before)
+        {
+            _bench_md5_before(clear + 32, sum);
+        }
+        else
+        {
+            OS_MD5_Str(clear + 32, sum);
+        }
+    }
+
+    return((double)msgs / (_bench_time() - start));
+}
+
+
+int main(int argc, char **argv)
+{
+    int i;
+    int msgs = BENCH_MSGS;
+    long sizes[] = {128, 512, 2048, 6144, 0};
+    void *key;
+    char sum[33], sum2[33];
+    char *msg, *enc, *clear, *clear2;
+
+
+    if(argc > 1)
+    {
+        msgs = atoi(argv[1]);
+        if(msgs <= 0)
+        {
+            printf("%s: [messages]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    key = OS_BF_SetKey(bench_key);
+    msg = malloc(8192);
+    enc = malloc(8192);
+    clear = malloc(8192);
+    clear2 = malloc(8192);
+    if(!key || !msg || !enc || !clear || !clear2)
+    {
+        printf("%s: memory error\n", argv[0]);
+        exit(1);
+    }
+
+    printf("%-6s %16s %16s %16s\n", "size", "before",
+           "per-message key", "after");
+
+    for(i = 0; sizes[i]; i++)
+    {
+        double before, per_msg, after;
+
+        memset(msg, 'a', sizes[i]);
+        memcpy(msg + 32, "1:ossec: benchmark event ", 25);
+        msg[sizes[i] -1] = '\0';
+
+        OS_BF_Str(msg, enc, bench_key, sizes[i], OS_ENCRYPT);
+
+        /* All must give the same message (and checksum) back */
+        _bench_bf_before(enc, clear, sizes[i]);
+        OS_BF_StrKey(enc, clear2, key, sizes[i], OS_DECRYPT);
+        if(memcmp(msg, clear, sizes[i]) || memcmp(msg, clear2, sizes[i]))
+        {
+            printf("%s: decryption error (size %ld)\n", argv[0], sizes[i]);
+            exit(1);
+        }
+
+        OS_BF_Str(enc, clear, bench_key, sizes[i], OS_DECRYPT);
+        _bench_md5_before(msg + 32, sum);
+        OS_MD5_Str(msg + 32, sum2);
+        if(memcmp(msg, clear, sizes[i]) || strcmp(sum, sum2))
+        {
+            printf("%s: checksum error (size %ld)\n", argv[0], sizes[i]);
+            exit(1);
+        }
+
+        before = _bench_run(enc, clear, sizes[i], NULL, 1, msgs);
+        per_msg = _bench_run(enc, clear, sizes[i], NULL, 0, msgs);
+        after = _bench_run(enc, clear, sizes[i], key, 0, msgs);
+
+        printf("%-6ld %12.0f/sec %12.0f/sec %12.0f/sec\n", sizes[i],
+               before, per_msg, after);
+    }
+
+    free(key);
+    free(msg);
+    free(enc);
+    free(clear);
+    free(clear2);
+
+    return(0);
+}
+
+/* EOF */
@@ -221,13 +221,87 @@ void BF_decrypt(BF_LONG *data, const BF_KEY *key)
 #endif
 	}
 
+#ifndef BF_PTR2
+/* Decrypts two independent blocks (data[0..1] and data[2..3]) with
+ * their rounds interleaved, so the S-box lookups of one block are done
+ * while the other is waiting for its own (used by the CBC decryption).
+ */
+static void BF_decrypt2(BF_LONG *data, const BF_KEY *key)
+	{
+	register const BF_LONG *p,*s;
+	register BF_LONG l,r,l2,r2;
+
+	p=key->P;
+	s= &(key->S[0]);
+	l=data[0];
+	r=data[1];
+	l2=data[2];
+	r2=data[3];
+
+	l^=p[BF_ROUNDS+1];
+	l2^=p[BF_ROUNDS+1];
+#if BF_ROUNDS == 20
+	BF_ENC(r,l,s,p[20]);
+	BF_ENC(r2,l2,s,p[20]);
+	BF_ENC(l,r,s,p[19]);
+	BF_ENC(l2,r2,s,p[19]);
+	BF_ENC(r,l,s,p[18]);
+	BF_ENC(r2,l2,s,p[18]);
+	BF_ENC(l,r,s,p[17]);
+	BF_ENC(l2,r2,s,p[17]);
+#endif
+	BF_ENC(r,l,s,p[16]);
+	BF_ENC(r2,l2,s,p[16]);
+	BF_ENC(l,r,s,p[15]);
+	BF_ENC(l2,r2,s,p[15]);
+	BF_ENC(r,l,s,p[14]);
+	BF_ENC(r2,l2,s,p[14]);
+	BF_ENC(l,r,s,p[13]);
+	BF_ENC(l2,r2,s,p[13]);
+	BF_ENC(r,l,s,p[12]);
+	BF_ENC(r2,l2,s,p[12]);
+	BF_ENC(l,r,s,p[11]);
+	BF_ENC(l2,r2,s,p[11]);
+	BF_ENC(r,l,s,p[10]);
+	BF_ENC(r2,l2,s,p[10]);
+	BF_ENC(l,r,s,p[ 9]);
+	BF_ENC(l2,r2,s,p[ 9]);
+	BF_ENC(r,l,s,p[ 8]);
+	BF_ENC(r2,l2,s,p[ 8]);
+	BF_ENC(l,r,s,p[ 7]);
+	BF_ENC(l2,r2,s,p[ 7]);
+	BF_ENC(r,l,s,p[ 6]);
+	BF_ENC(r2,l2,s,p[ 6]);
+	BF_ENC(l,r,s,p[ 5]);
+	BF_ENC(l2,r2,s,p[ 5]);
+	BF_ENC(r,l,s,p[ 4]);
+	BF_ENC(r2,l2,s,p[ 4]);
+	BF_ENC(l,r,s,p[ 3]);
+	BF_ENC(l2,r2,s,p[ 3]);
+	BF_ENC(r,l,s,p[ 2]);
+	BF_ENC(r2,l2,s,p[ 2]);
+	BF_ENC(l,r,s,p[ 1]);
+	BF_ENC(l2,r2,s,p[ 1]);
+	r^=p[0];
+	r2^=p[0];
+
+	data[1]=l&0xffffffffL;
+	data[0]=r&0xffffffffL;
+	data[3]=l2&0xffffffffL;
+	data[2]=r2&0xffffffffL;
+	}
+#endif
+
 void BF_cbc_encrypt(const unsigned char *in, unsigned char *out, long length,
 	     const BF_KEY *schedule, unsigned char *ivec, int encrypt)
 	{
 	register BF_LONG tin0,tin1;
+#ifndef BF_PTR2
+	register BF_LONG tin2,tin3;
+#endif
 	register BF_LONG tout0,tout1,xor0,xor1;
 	register long l=length;
-	BF_LONG tin[2];
+	BF_LONG tin[4];
 
 	if (encrypt)
 		{
@@ -269,6 +343,33 @@ void BF_cbc_encrypt(const unsigned char *in, unsigned char *out, long length,
 		n2l(ivec,xor0);
 		n2l(ivec,xor1);
 		ivec-=8;
+#ifndef BF_PTR2
+		/* Each block only depends on its own ciphertext and the
+		 * previous one, so two are decrypted at a time. */
+		for (l-=16; l>=0; l-=16)
+			{
+			n2l(in,tin0);
+			n2l(in,tin1);
+			n2l(in,tin2);
+			n2l(in,tin3);
+			tin[0]=tin0;
+			tin[1]=tin1;
+			tin[2]=tin2;
+			tin[3]=tin3;
+			BF_decrypt2(tin,schedule);
+			tout0=tin[0]^xor0;
+			tout1=tin[1]^xor1;
+			l2n(tout0,out);
+			l2n(tout1,out);
+			tout0=tin[2]^tin0;
+			tout1=tin[3]^tin1;
+			l2n(tout0,out);
+			l2n(tout1,out);
+			xor0=tin2;
+			xor1=tin3;
+			}
+		l+=16;
+#endif
 		for (l-=8; l>=0; l-=8)
 			{
 			n2l(in,tin0);
@@ -300,7 +401,10 @@ void BF_cbc_encrypt(const unsigned char *in, unsigned char *out, long length,
 		l2n(xor1,ivec);
 		}
 	tin0=tin1=tout0=tout1=xor0=xor1=0;
-	tin[0]=tin[1]=0;
+	tin[0]=tin[1]=tin[2]=tin[3]=0;
+#ifndef BF_PTR2
+	tin2=tin3=0;
+#endif
 	}
 
 #endif
@@ -27,21 +27,51 @@
 
 typedef unsigned char uchar;
 
-int OS_BF_Str(char *input, char *output, char *charkey,
-                long size, short int action)
+static unsigned char cbc_iv[8]={0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
+
+
+/* OS_BF_SetKey: Expands charkey into a key schedule, to be used by
+ * OS_BF_StrKey (setting the key is a lot more expensive than encrypting
+ * a message). Returns NULL on error. It must be freed by the caller.
+ */
+void *OS_BF_SetKey(char *charkey)
+{
+    BF_KEY *key;
+
+    key = (BF_KEY *)calloc(1, sizeof(BF_KEY));
+    if(!key)
+    {
+        return(NULL);
+    }
+
+    BF_set_key(key, strlen(charkey), (uchar *)charkey);
+
+    return(key);
+}
+
+
+int OS_BF_StrKey(char *input, char *output, void *key,
+                 long size, short int action)
 {
-    BF_KEY key;
-    static unsigned char cbc_iv [8]={0xfe,0xdc,0xba,0x98,0x76,0x54,0x32,0x10};
     unsigned char iv[8];
 
     memcpy(iv,cbc_iv,sizeof(iv));
 
-    BF_set_key(&key, strlen(charkey), (uchar *)charkey);
-
     BF_cbc_encrypt((uchar *)input, (uchar *)output, size,
-            &key, iv, action);
+            (BF_KEY *)key, iv, action);
 
     return(1);
 }
 
+
+int OS_BF_Str(char *input, char *output, char *charkey,
+                long size, short int action)
+{
+    BF_KEY key;
+
+    BF_set_key(&key, strlen(charkey), (uchar *)charkey);
+
+    return(OS_BF_StrKey(input, output, &key, size, action));
+}
+
 /* EOF */
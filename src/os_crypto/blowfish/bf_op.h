@@ -24,6 +24,11 @@
 int OS_BF_Str(char * input, char *output, char *charkey,
                             long size, short int action);
 
+/* Same as OS_BF_Str, with a key from OS_BF_SetKey */
+void *OS_BF_SetKey(char *charkey);
+int OS_BF_StrKey(char *input, char *output, void *key,
+                 long size, short int action);
+
 #endif
 
 /* EOF */
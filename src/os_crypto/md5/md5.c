@@ -101,6 +101,15 @@ void MD5Update(struct MD5Context *ctx, unsigned char const *buf, unsigned len)
     /* Process data in 64-byte chunks */
 
     while (len >= 64) {
+#ifndef HIGHFIRST
+	/* Aligned blocks are used in place (nothing to reverse) */
+	if (((unsigned long) buf & 3) == 0) {
+	    MD5Transform(ctx->buf, (uint32 const *) buf);
+	    buf += 64;
+	    len -= 64;
+	    continue;
+	}
+#endif
 	memcpy(ctx->in, buf, 64);
 	byteReverse(ctx->in, 16);
 	MD5Transform(ctx->buf, (uint32 *) ctx->in);
@@ -155,7 +164,7 @@ void MD5Final(unsigned char digest[16], struct MD5Context *ctx)
     MD5Transform(ctx->buf, (uint32 *) ctx->in);
     byteReverse((unsigned char *) ctx->buf, 4);
     memcpy(digest, ctx->buf, 16);
-    memset(ctx, 0, sizeof(ctx));	/* In case it's sensitive */
+    memset(ctx, 0, sizeof(*ctx));	/* In case it's sensitive */
 }
 
 #ifndef ASM_MD5
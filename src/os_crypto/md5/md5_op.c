@@ -22,6 +22,23 @@
 #include <string.h>
 #include "md5.h"
 
+
+/* _md5_hex: Writes the digest as 32 hex chars (plus the '\0').
+ */
+static void _md5_hex(unsigned char *digest, char *output)
+{
+    static const char hex[] = "0123456789abcdef";
+    int n;
+
+    for(n = 0;n < 16;n++)
+    {
+        *output++ = hex[digest[n] >> 4];
+        *output++ = hex[digest[n] & 0x0f];
+    }
+    *output = '\0';
+}
+
+
 int OS_MD5_File(char * fname, char * output)
 {
     FILE *fp;
@@ -48,11 +65,7 @@ int OS_MD5_File(char * fname, char * output)
 
     MD5Final(digest, &ctx);
 
-    for(n = 0;n < 16; n++)
-    {
-        snprintf(output, 3, "%02x", digest[n]);
-        output+=2;
-    }
+    _md5_hex(digest, output);
 
     /* Closing it */
     fclose(fp);
@@ -65,8 +78,6 @@ int OS_MD5_Str(char * str, char * output)
 {
     unsigned char digest[16];
 
-    int n;
-
     MD5_CTX ctx;
 
     MD5Init(&ctx);
@@ -75,12 +86,7 @@ int OS_MD5_Str(char * str, char * output)
 
     MD5Final(digest, &ctx);
 
-    output[32] = '\0';
-    for(n = 0;n < 16;n++)
-    {
-        snprintf(output, 3, "%02x", digest[n]);
-        output+=2;
-    }
+    _md5_hex(digest, output);
 
     return(0);
 }
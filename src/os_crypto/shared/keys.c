@@ -88,7 +88,7 @@ void __chash(keystore *keys, char *id, char *name, char *ip, char *key)
     keys->keyentries[keys->keysize]->local = 0;
     keys->keyentries[keys->keysize]->keyid = keys->keysize;
     keys->keyentries[keys->keysize]->global = 0;
-    keys->keyentries[keys->keysize]->fp = NULL;
+    keys->keyentries[keys->keysize]->rids_slot = -1;
 
 	
 
@@ -121,6 +121,13 @@ void __chash(keystore *keys, char *id, char *name, char *ip, char *key)
     /* Final key is 48 * 4 = 192bits */
     os_strdup(_finalstr, keys->keyentries[keys->keysize]->key);
 
+    /* Setting the key once, instead of on every message */
+    keys->keyentries[keys->keysize]->bf_key = OS_BF_SetKey(_finalstr);
+    if(!keys->keyentries[keys->keysize]->bf_key)
+    {
+        ErrorExit(MEM_ERROR, __local_name);
+    }
+
 
 	/* Cleaning final string from memory */
 	memset(_finalstr,'\0', sizeof(_finalstr));
@@ -319,6 +326,7 @@ void OS_ReadKeys(keystore *keys)
 
     /* Adding additional entry for sender == keysize */
     os_calloc(1, sizeof(keyentry), keys->keyentries[keys->keysize]);
+    keys->keyentries[keys->keysize]->rids_slot = -1;
 
 
     return;
@@ -371,13 +379,12 @@ void OS_FreeKeys(keystore *keys)
             if(keys->keyentries[i]->key)
                 free(keys->keyentries[i]->key);
 
+            if(keys->keyentries[i]->bf_key)
+                free(keys->keyentries[i]->bf_key);
+
             if(keys->keyentries[i]->name)
                 free(keys->keyentries[i]->name);
 
-            /* Closing counter */
-            if(keys->keyentries[i]->fp)
-                fclose(keys->keyentries[i]->fp);
-
             free(keys->keyentries[i]);
             keys->keyentries[i] = NULL;
         }
@@ -403,32 +410,38 @@ int OS_CheckUpdateKeys(keystore *keys)
 }
 
 
-/* OS_UpdateKeys(keystore *keys)
- * Update the keys if changed.
+/* OS_CopyKeysState(keystore *keys, keystore *old_keys)
+ * Carries the counters, the last peer and the counter slot of the
+ * agents (and sender) still present from the old keys to the new
+ * ones. The agents added are left for OS_StartCounter.
  */
-int OS_UpdateKeys(keystore *keys)
+void OS_CopyKeysState(keystore *keys, keystore *old_keys)
 {
-    if(keys->file_change !=  File_DateofChange(KEYS_FILE))
-    {
-        merror(ENCFILE_CHANGED, __local_name);
-        debug1("%s: DEBUG: Freekeys", __local_name);
-
-        OS_FreeKeys(keys);
-        debug1("%s: DEBUG: OS_ReadKeys", __local_name);
-
-        /* Reading keys */
-        verbose(ENC_READ, __local_name);
+    int i;
+    keyentry *old_entry;
 
+    for(i = 0; i < keys->keysize; i++)
+    {
+        old_entry = OSHash_Get(old_keys->keyhash_id, keys->keyentries[i]->id);
+        if(!old_entry)
+        {
+            continue;
+        }
 
-        OS_ReadKeys(keys);
-        debug1("%s: DEBUG: OS_StartCounter", __local_name);
+        keys->keyentries[i]->rcvd = old_entry->rcvd;
+        keys->keyentries[i]->local = old_entry->local;
+        keys->keyentries[i]->global = old_entry->global;
+        keys->keyentries[i]->rids_slot = old_entry->rids_slot;
+        memcpy(&keys->keyentries[i]->peer_info, &old_entry->peer_info,
+               sizeof(struct sockaddr_in));
+    }
 
-        OS_StartCounter(keys);
-        debug1("%s: DEBUG: OS_UpdateKeys completed", __local_name);
 
-        return(1);
-    }
-    return(0);
+    /* Sender counter */
+    old_entry = old_keys->keyentries[old_keys->keysize];
+    keys->keyentries[keys->keysize]->local = old_entry->local;
+    keys->keyentries[keys->keysize]->global = old_entry->global;
+    keys->keyentries[keys->keysize]->rids_slot = old_entry->rids_slot;
 }
 
 
@@ -15,6 +15,10 @@
 
 
 
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
 #include "shared.h"
 #include "headers/sec.h"
 
@@ -30,7 +34,6 @@ unsigned int local_count  = 0;
 
 /** Average compression rates **/
 int evt_count = 0;
-int rcv_count = 0;
 unsigned int c_orig_size = 0;
 unsigned int c_comp_size = 0;
 
@@ -42,101 +45,415 @@ int _s_recv_flush = 0;
 int _s_verify_counter = 1;
 
 
+/** Counter table.
+ * All the counters are kept in a single file at RIDS_DIR/RIDS_TABLE,
+ * one fixed size record per agent (plus one for the sender counter).
+ * On Unix the table is memory mapped, so storing a counter is just a
+ * memory write and the file is only msync'ed every recv_counter_flush
+ * updates of an agent. On Windows each update is written through to
+ * the file.
+ *
+ * The table is only resized (remapped) by OS_StartCounter, which
+ * remoted calls with the keys write locked and sendmsg_mutex held.
+ * The agent counters are stored (ReadSecMSG) with the keys read locked
+ * and the sender counter (CreateSecMSG) with sendmsg_mutex held.
+ */
+#define RIDS_MAGIC      "OSRIDS1"
+#define RIDS_IDSIZE     32
+
+typedef struct _rids_header
+{
+    char magic[8];
+    unsigned int slots;
+    unsigned int reserved;
+}rids_header;
+
+typedef struct _rids_entry
+{
+    char id[RIDS_IDSIZE];
+    unsigned int global;
+    unsigned int local;
+}rids_entry;
+
+#define RIDS_SIZE(x)    (sizeof(rids_header) + (x) * sizeof(rids_entry))
+#define RIDS_HDR        ((rids_header *)_rids_map)
+#define RIDS_ENTRY(x)   (((rids_entry *)(_rids_map + sizeof(rids_header))) + (x))
+
+static char *_rids_map = NULL;
+static size_t _rids_mapsize = 0;
+
+#ifndef WIN32
+static int _rids_fd = -1;
+#else
+static FILE *_rids_fp = NULL;
+#endif
+
+
+/* _rids_resize: Grows (or creates) the table to hold slots records.
+ * New records are zeroed.
+ */
+static void _rids_resize(char *rids_file, unsigned int slots)
+{
+    size_t new_size = RIDS_SIZE(slots);
+
+    #ifndef WIN32
+    if(_rids_map)
+    {
+        munmap(_rids_map, _rids_mapsize);
+        _rids_map = NULL;
+    }
+
+    if(ftruncate(_rids_fd, new_size) < 0)
+    {
+        ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+    }
+
+    _rids_map = mmap(NULL, new_size, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     _rids_fd, 0);
+    if(_rids_map == MAP_FAILED)
+    {
+        _rids_map = NULL;
+        merror("%s: Unable to map counter table. errno: %d",
+               __local_name, errno);
+        ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+    }
+    #else
+    _rids_map = realloc(_rids_map, new_size);
+    if(!_rids_map)
+    {
+        ErrorExit(MEM_ERROR, __local_name);
+    }
+    if(new_size > _rids_mapsize)
+    {
+        memset(_rids_map + _rids_mapsize, '\0', new_size - _rids_mapsize);
+    }
+    #endif
+
+    _rids_mapsize = new_size;
+    strncpy(RIDS_HDR->magic, RIDS_MAGIC, sizeof(RIDS_HDR->magic));
+    RIDS_HDR->slots = slots;
+
+    #ifdef WIN32
+    fseek(_rids_fp, 0, SEEK_SET);
+    if(fwrite(_rids_map, _rids_mapsize, 1, _rids_fp) != 1)
+    {
+        ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+    }
+    fflush(_rids_fp);
+    #endif
+}
+
+
+/* _rids_open: Opens (or creates) the counter table.
+ * An invalid table is discarded and started from scratch.
+ */
+static void _rids_open()
+{
+    unsigned int slots = 0;
+    char rids_file[OS_FLSIZE +1];
+    rids_header hdr;
+    struct stat st;
+
+    if(_rids_map)
+    {
+        return;
+    }
+
+    memset(&st, '\0', sizeof(st));
+    rids_file[OS_FLSIZE] = '\0';
+    snprintf(rids_file, OS_FLSIZE, "%s/%s", RIDS_DIR, RIDS_TABLE);
+
+
+    #ifndef WIN32
+    _rids_fd = open(rids_file, O_RDWR|O_CREAT, 0640);
+    if(_rids_fd < 0)
+    {
+        merror("%s: Unable to open counter table. errno: %d",
+               __local_name, errno);
+        ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+    }
+
+    if((fstat(_rids_fd, &st) == 0) &&
+       (st.st_size >= (off_t)sizeof(rids_header)) &&
+       (read(_rids_fd, &hdr, sizeof(hdr)) == sizeof(hdr)) &&
+       (memcmp(hdr.magic, RIDS_MAGIC, sizeof(RIDS_MAGIC)) == 0))
+    {
+        /* Never trust more records than the file really holds */
+        slots = (st.st_size - sizeof(rids_header)) / sizeof(rids_entry);
+        if(hdr.slots < slots)
+        {
+            slots = hdr.slots;
+        }
+    }
+    else if(st.st_size != 0)
+    {
+        merror("%s: Invalid counter table '%s'. Starting a new one.",
+               __local_name, rids_file);
+        if(ftruncate(_rids_fd, 0) < 0)
+        {
+            ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+        }
+    }
+
+    _rids_resize(rids_file, slots);
+
+    #else
+    _rids_fp = fopen(rids_file, "r+b");
+    if(!_rids_fp)
+    {
+        _rids_fp = fopen(rids_file, "w+b");
+        if(!_rids_fp)
+        {
+            ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+        }
+    }
+
+    if((fstat(fileno(_rids_fp), &st) == 0) &&
+       (st.st_size >= (off_t)sizeof(rids_header)) &&
+       (fread(&hdr, sizeof(hdr), 1, _rids_fp) == 1) &&
+       (memcmp(hdr.magic, RIDS_MAGIC, sizeof(RIDS_MAGIC)) == 0))
+    {
+        slots = (st.st_size - sizeof(rids_header)) / sizeof(rids_entry);
+        if(hdr.slots < slots)
+        {
+            slots = hdr.slots;
+        }
+    }
+
+    _rids_mapsize = RIDS_SIZE(slots);
+    os_calloc(1, _rids_mapsize, _rids_map);
+    strncpy(RIDS_HDR->magic, RIDS_MAGIC, sizeof(RIDS_HDR->magic));
+    RIDS_HDR->slots = slots;
+
+    /* Reading all records in one shot */
+    if(slots)
+    {
+        fseek(_rids_fp, sizeof(rids_header), SEEK_SET);
+        if(fread(RIDS_ENTRY(0), sizeof(rids_entry), slots, _rids_fp) != slots)
+        {
+            merror("%s: Invalid counter table '%s'. Starting a new one.",
+                   __local_name, rids_file);
+            memset(RIDS_ENTRY(0), '\0', slots * sizeof(rids_entry));
+        }
+    }
+
+    fseek(_rids_fp, 0, SEEK_SET);
+    if(fwrite(_rids_map, _rids_mapsize, 1, _rids_fp) != 1)
+    {
+        ErrorExit(FOPEN_ERROR, __local_name, rids_file);
+    }
+    fflush(_rids_fp);
+    #endif
+}
+
+
+/* _rids_store: Writes the record of an entry to the table.
+ * The flush count is kept per entry, since the receiver threads
+ * store the counters of different agents at the same time.
+ */
+static void _rids_store(keyentry *key_entry,
+                        unsigned int global, unsigned int local)
+{
+    int slot = key_entry->rids_slot;
+
+    if(slot < 0 || !_rids_map)
+    {
+        return;
+    }
+
+    RIDS_ENTRY(slot)->global = global;
+    RIDS_ENTRY(slot)->local = local;
+
+    #ifdef WIN32
+    fseek(_rids_fp, RIDS_SIZE(slot), SEEK_SET);
+    fwrite(RIDS_ENTRY(slot), sizeof(rids_entry), 1, _rids_fp);
+    #endif
+
+
+    /* Flushing the table to disk from time to time */
+    key_entry->rids_count++;
+    if(key_entry->rids_count >= (unsigned int)_s_recv_flush)
+    {
+        #ifndef WIN32
+        msync(_rids_map, _rids_mapsize, MS_ASYNC);
+        #else
+        fflush(_rids_fp);
+        #endif
+
+        key_entry->rids_count = 0;
+    }
+}
+
+
+/* _rids_legacy: Imports (and removes) the old per agent counter file.
+ * Returns 1 if a counter was imported.
+ */
+static int _rids_legacy(char *id, rids_entry *entry)
+{
+    int ret = 0;
+    FILE *fp;
+    unsigned int g_c = 0, l_c = 0;
+    char rids_file[OS_FLSIZE +1];
+
+    rids_file[OS_FLSIZE] = '\0';
+    snprintf(rids_file, OS_FLSIZE, "%s/%s", RIDS_DIR, id);
+
+    fp = fopen(rids_file, "r");
+    if(!fp)
+    {
+        return(0);
+    }
+
+    if(fscanf(fp, "%u:%u", &g_c, &l_c) == 2)
+    {
+        entry->global = g_c;
+        entry->local = l_c;
+        ret = 1;
+    }
+
+    fclose(fp);
+    unlink(rids_file);
+
+    return(ret);
+}
+
+
 /** OS_StartCounter.
  * Read counters for each agent.
  */
 void OS_StartCounter(keystore *keys)
 {
     int i;
+    int new_sender;
+    unsigned int slot;
+    unsigned int missing = 0;
+    unsigned int free_slots = 0;
     char rids_file[OS_FLSIZE +1];
 
     rids_file[OS_FLSIZE] = '\0';
+    snprintf(rids_file, OS_FLSIZE, "%s/%s", RIDS_DIR, RIDS_TABLE);
 
 
     debug1("%s: OS_StartCounter: keysize: %d", __local_name, keys->keysize);
 
 
-    /* Starting receiving counter */
+    /* Opening the table (kept open across key reloads) */
+    _rids_open();
+
+
+    /* On a reload, only the agents added have no slot yet
+     * (the others were kept by OS_CopyKeysState).
+     */
     for(i = 0; i<=keys->keysize; i++)
     {
-        /* On i == keysize, we deal with the
-         * sender counter.
-         */
-        if(i == keys->keysize)
+        if(keys->keyentries[i]->rids_slot == -1)
         {
-            snprintf(rids_file, OS_FLSIZE, "%s/%s",
-                                            RIDS_DIR,
-                                            SENDER_COUNTER);
+            missing++;
+        }
+    }
+
+    new_sender = (keys->keyentries[keys->keysize]->rids_slot == -1);
+
+
+    /* Assigning the stored records. The last entry (keysize)
+     * is the sender counter.
+     */
+    for(slot = 0; missing && slot < RIDS_HDR->slots; slot++)
+    {
+        keyentry *key_entry;
+        rids_entry *entry = RIDS_ENTRY(slot);
+
+        if(entry->id[0] == '\0')
+        {
+            free_slots++;
+            continue;
+        }
+        entry->id[RIDS_IDSIZE -1] = '\0';
+
+        if(strcmp(entry->id, SENDER_COUNTER) == 0)
+        {
+            key_entry = keys->keyentries[keys->keysize];
         }
         else
         {
-            snprintf(rids_file, OS_FLSIZE, "%s/%s",
-                                           RIDS_DIR,
-                                           keys->keyentries[i]->id);
+            key_entry = OSHash_Get(keys->keyhash_id, entry->id);
+        }
+
+        if(!key_entry || key_entry->rids_slot != -1)
+        {
+            continue;
         }
 
-        keys->keyentries[i]->fp = fopen(rids_file, "r+");
+        key_entry->rids_slot = slot;
+        key_entry->global = entry->global;
+        key_entry->local = entry->local;
+        missing--;
+    }
 
-        /* If nothing is there, try to open as write only */
-        if(!keys->keyentries[i]->fp)
+
+    /* Growing the table for the agents without a record */
+    if(missing > free_slots)
+    {
+        _rids_resize(rids_file, RIDS_HDR->slots + (missing - free_slots));
+    }
+
+
+    /* Creating the new records, importing the old counter files */
+    slot = 0;
+    for(i = 0; i<=keys->keysize; i++)
+    {
+        char *id;
+        rids_entry *entry;
+
+        if(keys->keyentries[i]->rids_slot != -1)
         {
-            keys->keyentries[i]->fp = fopen(rids_file, "w");
-            if(!keys->keyentries[i]->fp)
-            {
-                int my_error = errno;
-
-                /* Just in case we run out of file descriptiors */
-                if((keys->keyentries[i -1]->fp) && (i > 10))
-                {
-                    fclose(keys->keyentries[i -1]->fp);
-
-                    if(keys->keyentries[i -2]->fp)
-                    {
-                        fclose(keys->keyentries[i -2]->fp);
-                    }
-                }
-
-                merror("%s: Unable to open agent file. errno: %d",
-                       __local_name, my_error);
-                ErrorExit(FOPEN_ERROR, __local_name, rids_file);
-            }
+            continue;
         }
-        else
+
+        while(RIDS_ENTRY(slot)->id[0] != '\0')
         {
-            unsigned int g_c = 0, l_c = 0;
-            if(fscanf(keys->keyentries[i]->fp,"%u:%u", &g_c, &l_c) != 2)
-            {
-                if(i == keys->keysize)
-                {
-                    verbose("%s: INFO: No previous sender counter.", __local_name);
-                }
-                else
-                {
-                    verbose("%s: INFO: No previous counter available for '%s'.",
-                                            __local_name,
-                                            keys->keyentries[i]->name);
-                }
-
-                g_c = 0;
-                l_c = 0;
-            }
+            slot++;
+        }
 
-            if(i == keys->keysize)
-            {
-                verbose("%s: INFO: Assigning sender counter: %d:%d",
-                            __local_name, g_c, l_c);
-                global_count = g_c;
-                local_count = l_c;
-            }
-            else
-            {
-                verbose("%s: INFO: Assigning counter for agent %s: '%d:%d'.",
-                            __local_name, keys->keyentries[i]->name, g_c, l_c);
+        id = (i == keys->keysize)?SENDER_COUNTER:keys->keyentries[i]->id;
 
-                keys->keyentries[i]->global = g_c;
-                keys->keyentries[i]->local = l_c;
-            }
+        entry = RIDS_ENTRY(slot);
+        memset(entry, '\0', sizeof(rids_entry));
+        strncpy(entry->id, id, RIDS_IDSIZE -1);
+
+        if(_rids_legacy(id, entry))
+        {
+            debug1("%s: DEBUG: Imported old counter file for '%s'.",
+                   __local_name, id);
+        }
+        else if(i == keys->keysize)
+        {
+            verbose("%s: INFO: No previous sender counter.", __local_name);
         }
+        else
+        {
+            debug1("%s: DEBUG: No previous counter available for '%s'.",
+                   __local_name, keys->keyentries[i]->name);
+        }
+
+        keys->keyentries[i]->rids_slot = slot;
+        keys->keyentries[i]->global = entry->global;
+        keys->keyentries[i]->local = entry->local;
+
+        #ifdef WIN32
+        fseek(_rids_fp, RIDS_SIZE(slot), SEEK_SET);
+        fwrite(entry, sizeof(rids_entry), 1, _rids_fp);
+        #endif
+    }
+
+
+    /* Sender counter (already running on a reload) */
+    if(new_sender)
+    {
+        global_count = keys->keyentries[keys->keysize]->global;
+        local_count = keys->keyentries[keys->keysize]->local;
+        verbose("%s: INFO: Assigning sender counter: %d:%d",
+                __local_name, global_count, local_count);
     }
 
     debug2("%s: DEBUG: Stored counter.", __local_name);
@@ -165,12 +482,55 @@ void OS_StartCounter(keystore *keys)
 
 /** OS_RemoveCounter(char *id)
  * Remove the ID counter.
+ * Called by manage_agents, so the table is not mapped here.
  */
 void OS_RemoveCounter(char *id)
 {
+    FILE *fp;
+    rids_header hdr;
+    rids_entry entry;
+    unsigned int slot;
     char rids_file[OS_FLSIZE +1];
+
+    rids_file[OS_FLSIZE] = '\0';
+
+    /* Old per agent file */
     snprintf(rids_file, OS_FLSIZE, "%s/%s",RIDS_DIR, id);
     unlink(rids_file);
+
+
+    snprintf(rids_file, OS_FLSIZE, "%s/%s",RIDS_DIR, RIDS_TABLE);
+    fp = fopen(rids_file, "r+b");
+    if(!fp)
+    {
+        return;
+    }
+
+    if((fread(&hdr, sizeof(hdr), 1, fp) != 1) ||
+       (memcmp(hdr.magic, RIDS_MAGIC, sizeof(RIDS_MAGIC)) != 0))
+    {
+        fclose(fp);
+        return;
+    }
+
+    for(slot = 0; slot < hdr.slots; slot++)
+    {
+        if(fread(&entry, sizeof(entry), 1, fp) != 1)
+        {
+            break;
+        }
+
+        entry.id[RIDS_IDSIZE -1] = '\0';
+        if(strcmp(entry.id, id) == 0)
+        {
+            memset(&entry, '\0', sizeof(entry));
+            fseek(fp, RIDS_SIZE(slot), SEEK_SET);
+            fwrite(&entry, sizeof(entry), 1, fp);
+            break;
+        }
+    }
+
+    fclose(fp);
 }
 
 
@@ -179,9 +539,7 @@ void OS_RemoveCounter(char *id)
  */
 void StoreSenderCounter(keystore *keys, int global, int local)
 {
-    /* Writting at the beginning of the file */
-    fseek(keys->keyentries[keys->keysize]->fp, 0, SEEK_SET);
-    fprintf(keys->keyentries[keys->keysize]->fp, "%u:%u:", global, local);
+    _rids_store(keys->keyentries[keys->keysize], global, local);
 }
 
 
@@ -190,12 +548,9 @@ void StoreSenderCounter(keystore *keys, int global, int local)
  */
 void StoreCounter(keystore *keys, int id, int global, int local)
 {
-    /* Writting at the beginning of the file */
-    fseek(keys->keyentries[id]->fp, 0, SEEK_SET);
-    fprintf(keys->keyentries[id]->fp, "%u:%u:", global, local);
+    _rids_store(keys->keyentries[id], global, local);
 }
 
-
 /* CheckSum v0.1: 2005/02/15
  * Verify the checksum of the message.
  * Returns NULL on error or the message on success.
@@ -245,8 +600,8 @@ char *ReadSecMSG(keystore *keys, char *buffer, char *cleartext,
     }
 
     /* Decrypting message */
-    if(!OS_BF_Str(buffer, cleartext, keys->keyentries[id]->key,
-                  buffer_size, OS_DECRYPT))
+    if(!OS_BF_StrKey(buffer, cleartext, keys->keyentries[id]->bf_key,
+                     buffer_size, OS_DECRYPT))
     {
         merror(ENCKEY_ERROR, __local_name, keys->keyentries[id]->ip->ip);
         return(NULL);
@@ -309,12 +664,7 @@ char *ReadSecMSG(keystore *keys, char *buffer, char *cleartext,
             /* Updating currently counts */
             keys->keyentries[id]->global = msg_global;
             keys->keyentries[id]->local = msg_local;
-            if(rcv_count >= _s_recv_flush)
-            {
-                StoreCounter(keys, id, msg_global, msg_local);
-                rcv_count = 0;
-            }
-            rcv_count++;
+            StoreCounter(keys, id, msg_global, msg_local);
             return(f_msg);
         }
 
@@ -326,13 +676,7 @@ char *ReadSecMSG(keystore *keys, char *buffer, char *cleartext,
             /* Updating currently counts */
             keys->keyentries[id]->global = msg_global;
             keys->keyentries[id]->local = msg_local;
-
-            if(rcv_count >= _s_recv_flush)
-            {
-                StoreCounter(keys, id, msg_global, msg_local);
-                rcv_count = 0;
-            }
-            rcv_count++;
+            StoreCounter(keys, id, msg_global, msg_local);
             return(f_msg);
         }
 
@@ -445,6 +789,8 @@ char *ReadSecMSG(keystore *keys, char *buffer, char *cleartext,
 
 
 /* Creat a encrypted message.
+ * The sender counter is global, so the callers on many threads
+ * must serialize the calls (remoted uses sendmsg_mutex).
  * Returns the size of it
  */
 int CreateSecMSG(keystore *keys, char *msg, char *msg_encrypted, int id)
@@ -569,8 +915,8 @@ int CreateSecMSG(keystore *keys, char *msg, char *msg_encrypted, int id)
      */
 
     /* Encrypting everything */
-    OS_BF_Str(_tmpmsg + (7 - bfsize), msg_encrypted + msg_size,
-                                      keys->keyentries[id]->key,
+    OS_BF_StrKey(_tmpmsg + (7 - bfsize), msg_encrypted + msg_size,
+                                      keys->keyentries[id]->bf_key,
                                       cmp_size,
                                       OS_ENCRYPT);
 
@@ -46,7 +46,8 @@ int ENOBUFS = 0;
  * Bind a specific port
  * v0.2: Added REUSEADDR.
  */
-int OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip, int ipv6)
+static int _OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip,
+                        int ipv6, int reuseport)
 {
     int ossock;
     struct sockaddr_in server;
@@ -57,6 +58,13 @@ int OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip, int ipv6)
     ipv6 = 0;
     #endif
 
+    #ifndef SO_REUSEPORT
+    if(reuseport)
+    {
+        return(OS_SOCKTERR);
+    }
+    #endif
+
 
     if(_proto == IPPROTO_UDP)
     {
@@ -64,6 +72,22 @@ int OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip, int ipv6)
         {
             return OS_SOCKTERR;
         }
+
+        /* Many sockets on the same port (the kernel
+         * distributes the datagrams between them).
+         */
+        #ifdef SO_REUSEPORT
+        if(reuseport)
+        {
+            int flag = 1;
+            if(setsockopt(ossock, SOL_SOCKET, SO_REUSEPORT,
+                                  (char *)&flag,  sizeof(flag)) < 0)
+            {
+                close(ossock);
+                return(OS_SOCKTERR);
+            }
+        }
+        #endif
     }
     else if(_proto == IPPROTO_TCP)
     {
@@ -133,6 +157,12 @@ int OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip, int ipv6)
 }
 
 
+int OS_Bindport(unsigned int _port, unsigned int _proto, char *_ip, int ipv6)
+{
+    return(_OS_Bindport(_port, _proto, _ip, ipv6, 0));
+}
+
+
 /* OS_Bindporttcp v 0.1
  * Bind a TCP port, using the OS_Bindport
  */
@@ -150,6 +180,16 @@ int OS_Bindportudp(unsigned int _port, char *_ip, int ipv6)
     return(OS_Bindport(_port, IPPROTO_UDP, _ip, ipv6));
 }
 
+
+/* OS_BindportudpReuse
+ * Bind a UDP port with SO_REUSEPORT (it can be bound many times).
+ * Returns OS_SOCKTERR if it is not supported.
+ */
+int OS_BindportudpReuse(unsigned int _port, char *_ip, int ipv6)
+{
+    return(_OS_Bindport(_port, IPPROTO_UDP, _ip, ipv6, 1));
+}
+
 #ifndef WIN32
 /* OS_BindUnixDomain v0.1, 2004/07/29
  * Bind to a Unix domain, using DGRAM sockets
@@ -27,6 +27,12 @@
 int OS_Bindporttcp(unsigned int _port, char *_ip, int ipv6);
 int OS_Bindportudp(unsigned int _port, char *_ip, int ipv6);
 
+/* OS_BindportudpReuse
+ * Same as OS_Bindportudp, with SO_REUSEPORT set. Each socket
+ * bound to the port gets part of the datagrams.
+ */
+int OS_BindportudpReuse(unsigned int _port, char *_ip, int ipv6);
+
 /* OS_BindUnixDomain
  * Bind to a specific file, using the "mode" permissions in
  * a Unix Domain socket.
@@ -0,0 +1,260 @@
+/*   $OSSEC, os_match_ac.c, v0.1, 2012/08/02, Daniel B. Cid$   */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Multi pattern matching for OSMatch (Aho-Corasick).
+ * When a pattern has many sub patterns (abc|def|ghi...),
+ * the ones that can match anywhere in the string are
+ * merged in a single automaton, so the string is only
+ * read once, no matter the number of sub patterns.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "os_regex.h"
+#include "os_regex_internal.h"
+
+
+/** OSMatchAC *_OS_MatchAC_Build(char **patterns, int count) v0.1
+ * Builds the automaton for the "count" first patterns.
+ * The patterns must be already on the final case (charmap).
+ * Returns NULL on error (out of memory).
+ */
+OSMatchAC *_OS_MatchAC_Build(char **patterns, int count)
+{
+    int i, c;
+    int max_states = 1;
+    int nstates = 1;
+    int q_begin = 0, q_end = 0;
+
+    int *fail = NULL;
+    int *queue = NULL;
+    uchar classes[256];
+
+    OSMatchAC *ac;
+
+
+    ac = calloc(1, sizeof(OSMatchAC));
+    if(!ac)
+    {
+        return(NULL);
+    }
+
+
+    /* Each character used by the patterns gets its own class.
+     * Class 0 is for everything else.
+     */
+    memset(classes, 0, sizeof(classes));
+    ac->nclasses = 1;
+
+    for(i = 0; i < count; i++)
+    {
+        uchar *pt = (uchar *)patterns[i];
+        while(*pt != '\0')
+        {
+            if(classes[*pt] == 0)
+            {
+                classes[*pt] = ac->nclasses++;
+            }
+            max_states++;
+            pt++;
+        }
+    }
+
+
+    /* The states must fit in the transition table */
+    if(max_states > 65535)
+    {
+        free(ac);
+        return(NULL);
+    }
+
+
+    /* The string is read with charmap, so we already map
+     * each character to the class of its lower case.
+     */
+    for(i = 0; i < 256; i++)
+    {
+        ac->classmap[i] = classes[charmap[i]];
+    }
+
+
+    ac->delta = calloc(max_states * ac->nclasses, sizeof(unsigned short));
+    ac->final = calloc(max_states, sizeof(uchar));
+    ac->own = calloc(max_states, sizeof(uchar));
+    ac->depth = calloc(max_states, sizeof(int));
+    fail = calloc(max_states, sizeof(int));
+    queue = calloc(max_states, sizeof(int));
+
+    if(!ac->delta || !ac->final || !ac->own || !ac->depth ||
+       !fail || !queue)
+    {
+        goto build_error;
+    }
+
+
+    /* Adding each pattern to the trie. State 0 is the root
+     * and, while building, 0 also means no transition.
+     */
+    for(i = 0; i < count; i++)
+    {
+        int state = 0;
+        uchar *pt = (uchar *)patterns[i];
+
+        while(*pt != '\0')
+        {
+            unsigned short *next;
+
+            next = &ac->delta[(state * ac->nclasses) + classes[*pt]];
+            if(*next == 0)
+            {
+                ac->depth[nstates] = ac->depth[state] +1;
+                *next = nstates++;
+            }
+            state = *next;
+            pt++;
+        }
+
+        ac->final[state] = 1;
+        ac->own[state] = 1;
+    }
+
+
+    /* Computing the failure transitions (breadth first) and
+     * completing the transition table.
+     */
+    for(c = 0; c < ac->nclasses; c++)
+    {
+        int next = ac->delta[c];
+        if(next)
+        {
+            fail[next] = 0;
+            queue[q_end++] = next;
+        }
+    }
+
+    while(q_begin < q_end)
+    {
+        int state = queue[q_begin++];
+
+        for(c = 0; c < ac->nclasses; c++)
+        {
+            int fstate = ac->delta[(fail[state] * ac->nclasses) + c];
+            int next = ac->delta[(state * ac->nclasses) + c];
+
+            if(next)
+            {
+                fail[next] = fstate;
+                if(ac->final[fstate])
+                {
+                    ac->final[next] = 1;
+                }
+                queue[q_end++] = next;
+            }
+            else
+            {
+                ac->delta[(state * ac->nclasses) + c] = fstate;
+            }
+        }
+    }
+
+    ac->nstates = nstates;
+
+    free(fail);
+    free(queue);
+    return(ac);
+
+
+    /* Error handling */
+    build_error:
+
+    if(fail)
+        free(fail);
+    if(queue)
+        free(queue);
+
+    _OS_MatchAC_Free(ac);
+    return(NULL);
+}
+
+
+/** int _OS_MatchAC(OSMatchAC *ac, char *str, int str_len) v0.1
+ * Returns TRUE if any of the patterns is found in
+ * the first str_len characters of str.
+ * Just like _OS_Match, a pattern starting at the beginning
+ * of str may go past str_len (up to the end of the string).
+ */
+int _OS_MatchAC(OSMatchAC *ac, char *str, int str_len)
+{
+    int i = 0;
+    int state = 0;
+    uchar *pt = (uchar *)str;
+
+    while((i < str_len) && (*pt != '\0'))
+    {
+        state = ac->delta[(state * ac->nclasses) + ac->classmap[*pt]];
+        if(ac->final[state])
+        {
+            return(TRUE);
+        }
+        pt++;
+        i++;
+    }
+
+
+    /* Past str_len, only the beginning of the string counts */
+    while((*pt != '\0') && (ac->depth[state] == i))
+    {
+        state = ac->delta[(state * ac->nclasses) + ac->classmap[*pt]];
+        if(ac->depth[state] != i +1)
+        {
+            break;
+        }
+        if(ac->own[state])
+        {
+            return(TRUE);
+        }
+        pt++;
+        i++;
+    }
+
+    return(FALSE);
+}
+
+
+/** void _OS_MatchAC_Free(OSMatchAC *ac) v0.1
+ * Releases the memory used by the automaton.
+ */
+void _OS_MatchAC_Free(OSMatchAC *ac)
+{
+    if(!ac)
+    {
+        return;
+    }
+
+    if(ac->delta)
+        free(ac->delta);
+    if(ac->final)
+        free(ac->final);
+    if(ac->own)
+        free(ac->own);
+    if(ac->depth)
+        free(ac->depth);
+
+    free(ac);
+    return;
+}
+
+
+/* EOF */
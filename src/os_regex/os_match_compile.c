@@ -57,6 +57,7 @@ int OSMatch_Compile(char *pattern, OSMatch *reg, int flags)
     reg->error = 0;
     reg->patterns = NULL;
     reg->size = NULL;
+    reg->ac = NULL;
 
 
     /* The pattern can't be null */
@@ -220,6 +221,57 @@ int OSMatch_Compile(char *pattern, OSMatch *reg, int flags)
     }while(!end_of_string);
 
 
+    /* If we have too many sub patterns to search anywhere
+     * in the string, merge them in a single automaton.
+     */
+    {
+        int ac_count = 0;
+        char **ac_patterns;
+
+        for(i = 0; reg->patterns[i]; i++)
+        {
+            if(reg->match_fp[i] == _OS_Match)
+            {
+                ac_count++;
+            }
+        }
+
+        if(ac_count >= OS_MATCH_AC_MIN)
+        {
+            ac_patterns = calloc(ac_count +1, sizeof(char *));
+            if(!ac_patterns)
+            {
+                reg->error = OS_REGEX_OUTOFMEMORY;
+                goto compile_error;
+            }
+
+            ac_count = 0;
+            for(i = 0; reg->patterns[i]; i++)
+            {
+                if(reg->match_fp[i] == _OS_Match)
+                {
+                    ac_patterns[ac_count++] = reg->patterns[i];
+                }
+            }
+
+            /* Keeping the old matching if we can't build it */
+            reg->ac = _OS_MatchAC_Build(ac_patterns, ac_count);
+            if(reg->ac)
+            {
+                for(i = 0; reg->patterns[i]; i++)
+                {
+                    if(reg->match_fp[i] == _OS_Match)
+                    {
+                        reg->match_fp[i] = NULL;
+                    }
+                }
+            }
+
+            free(ac_patterns);
+        }
+    }
+
+
     /* Success return */
     free(new_str_free);
     return(1);
@@ -122,13 +122,23 @@ int OSMatch_Execute(char *str, int str_len, OSMatch *reg)
     }
 
 
-    /* Looping on all sub patterns */
+    /* Checking all the sub patterns merged in the automaton */
+    if(reg->ac)
+    {
+        if(_OS_MatchAC(reg->ac, str, str_len) == TRUE)
+        {
+            return(1);
+        }
+    }
+
+
+    /* Looping on all other sub patterns */
     while(reg->patterns[i])
     {
-        if(reg->match_fp[i](reg->patterns[i],
-                            str,
-                            str_len,
-                            reg->size[i]) == TRUE)
+        if(reg->match_fp[i] && reg->match_fp[i](reg->patterns[i],
+                                                str,
+                                                str_len,
+                                                reg->size[i]) == TRUE)
         {
             return(1);
         }
@@ -45,6 +45,13 @@ void OSMatch_FreePattern(OSMatch *reg)
         reg->match_fp = NULL;
     }
 
+    /* Freeing the automaton */
+    if(reg->ac)
+    {
+        _OS_MatchAC_Free(reg->ac);
+        reg->ac = NULL;
+    }
+
     return;
 }
 
@@ -19,6 +19,7 @@
 /* OSRegex_Compile flags */
 #define OS_RETURN_SUBSTRING     0000200
 #define OS_CASE_SENSITIVE       0000400
+#define OS_RETURN_OFFSET        0001000
 
 
 /* Pattern maximum size */
@@ -36,6 +37,16 @@
 #define OS_REGEX_NO_MATCH       8
 
 
+/* Location of a sub string (offset and size on
+ * the string executed). Used with OS_RETURN_OFFSET.
+ */
+typedef struct _OSRegexSub
+{
+    int offset;
+    int size;
+}OSRegexSub;
+
+
 /* OSRegex structure */
 typedef struct _OSRegex
 {
@@ -43,8 +54,14 @@ typedef struct _OSRegex
     int *flags;
     char **patterns;
     char **sub_strings;
+    OSRegexSub *sub_offsets;
     char ***prts_closure;
     char ***prts_str;
+
+    /* Literal string that must be present for each
+     * sub pattern to match (NULL if none).
+     */
+    char **literals;
 }OSRegex;
 
 
@@ -55,6 +72,9 @@ typedef struct _OSMatch
     int *size;
     char **patterns;
     int (**match_fp)(char *str, char *str2, int str_len, int size);
+
+    /* Automaton for the sub patterns (when there are many) */
+    struct _OSMatchAC *ac;
 }OSMatch;
 
 
@@ -66,6 +86,8 @@ typedef struct _OSMatch
  * Allowed flags are:
  *      - OS_CASE_SENSITIVE
  *      - OS_RETURN_SUBSTRING
+ *      - OS_RETURN_OFFSET (the sub strings are not copied. Their
+ *        location is set on reg->sub_offsets, ending with -1)
  * Returns 1 on success or 0 on error.
  * The error code is set on reg->error.
  */
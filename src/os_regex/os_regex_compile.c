@@ -24,6 +24,7 @@
  * Allowed flags are:
  *      - OS_CASE_SENSITIVE
  *      - OS_RETURN_SUBSTRING
+ *      - OS_RETURN_OFFSET
  * Returns 1 on success or 0 on error.
  * The error code is set on reg->error.
  */
@@ -55,7 +56,8 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
     reg->prts_closure = NULL;
     reg->prts_str = NULL;
     reg->sub_strings = NULL;
-
+    reg->sub_offsets = NULL;
+    reg->literals = NULL;
 
 
     /* The pattern can't be null */
@@ -186,10 +188,11 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
     count++;
     reg->patterns = calloc(count +1, sizeof(char *));
     reg->flags = calloc(count +1, sizeof(int));
+    reg->literals = calloc(count +1, sizeof(char *));
 
 
     /* For the substrings */
-    if((prts_size > 0) && (flags & OS_RETURN_SUBSTRING))
+    if((prts_size > 0) && (flags & (OS_RETURN_SUBSTRING|OS_RETURN_OFFSET)))
     {
         reg->prts_closure = calloc(count +1, sizeof(char **));
         reg->prts_str = calloc(count +1, sizeof(char **));
@@ -202,7 +205,7 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
 
 
     /* Memory allocation error check */
-    if(!reg->patterns || !reg->flags)
+    if(!reg->patterns || !reg->flags || !reg->literals)
     {
         reg->error = OS_REGEX_OUTOFMEMORY;
         goto compile_error;
@@ -213,6 +216,7 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
     {
         reg->patterns[i] = NULL;
         reg->flags[i] = 0;
+        reg->literals[i] = NULL;
 
         /* The parenthesis closure if set */
         if(reg->prts_closure)
@@ -264,6 +268,14 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
             }
 
 
+            /* Getting the literal string to look for before
+             * executing this sub pattern. It is just an
+             * optimization, so not having it is not an error.
+             */
+            reg->literals[i] = _OS_RegexLiteral(reg->patterns[i],
+                                                reg->flags[i]);
+
+
             /* Setting the parenthesis closures */
             /* The parenthesis closure if set */
             if(reg->prts_closure)
@@ -352,6 +364,18 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
         goto compile_error;
     }
 
+    /* Or just their location */
+    if(flags & OS_RETURN_OFFSET)
+    {
+        reg->sub_offsets = calloc(max_prts_size + 1, sizeof(OSRegexSub));
+        if(reg->sub_offsets == NULL)
+        {
+            reg->error = OS_REGEX_OUTOFMEMORY;
+            goto compile_error;
+        }
+        reg->sub_offsets[0].offset = -1;
+    }
+
     /* Success return */
     free(new_str_free);
     return(1);
@@ -371,4 +395,81 @@ int OSRegex_Compile(char *pattern, OSRegex *reg, int flags)
 }
 
 
+/** char *_OS_RegexLiteral(char *pattern, int flags) v0.1
+ * Gets the longest sequence of plain characters from a (compiled)
+ * sub pattern. _OS_Regex only moves over these characters by
+ * matching them one after the other, so they must be present
+ * in any string that matches the sub pattern.
+ * Returns NULL if there is none worth looking for.
+ */
+char *_OS_RegexLiteral(char *pattern, int flags)
+{
+    int size = 0;
+    int max_size = 0;
+    char *max_begin = NULL;
+    char *pt = pattern;
+    char *literal;
+
+
+    /* If the pattern starts with a plain character and it is
+     * set to the beginning, _OS_Regex already fails fast.
+     */
+    if((flags & BEGIN_SET) && (*pt != BACKSLASH) && !prts(*pt))
+    {
+        return(NULL);
+    }
+
+    while(*pt != '\0')
+    {
+        /* Regex (and its '+' or '*') and parenthesis
+         * end the sequence.
+         */
+        if(*pt == BACKSLASH)
+        {
+            size = 0;
+            pt++;
+            if(*pt == '\0')
+            {
+                break;
+            }
+
+            pt++;
+            if(isPlus(*pt))
+            {
+                pt++;
+            }
+            continue;
+        }
+        else if(prts(*pt))
+        {
+            size = 0;
+            pt++;
+            continue;
+        }
+
+        size++;
+        if(size > max_size)
+        {
+            max_size = size;
+            max_begin = pt - (size -1);
+        }
+        pt++;
+    }
+
+    if(max_size < OS_REGEX_LITERAL_MIN)
+    {
+        return(NULL);
+    }
+
+    literal = calloc(max_size +1, sizeof(char));
+    if(!literal)
+    {
+        return(NULL);
+    }
+
+    strncpy(literal, max_begin, max_size);
+    return(literal);
+}
+
+
 /* EOF */
@@ -48,6 +48,11 @@ char *OSRegex_Execute(char *str, OSRegex *reg)
     {
         int j = 0, k = 0, str_char = 0;
 
+        if(reg->sub_offsets)
+        {
+            reg->sub_offsets[0].offset = -1;
+        }
+
         /* Looping on all sub patterns */
         while(reg->patterns[i])
         {
@@ -59,11 +64,46 @@ char *OSRegex_Execute(char *str, OSRegex *reg)
                 j++;
             }
 
+            /* The literal must be present */
+            if(reg->literals[i] && !_OS_FindLiteral(reg->literals[i], str))
+            {
+                i++;
+                continue;
+            }
+
             if((ret = _OS_Regex(reg->patterns[i], str, reg->prts_closure[i],
                         reg->prts_str[i], reg->flags[i])))
             {
                 j = 0;
 
+                /* Only setting the location of the sub strings */
+                if(reg->sub_offsets)
+                {
+                    while(reg->prts_str[i][j] && reg->prts_str[i][j+1])
+                    {
+                        reg->sub_offsets[k].offset = reg->prts_str[i][j] - str;
+
+                        /* Same size strdup would get below */
+                        if(reg->prts_str[i][j+1] >= reg->prts_str[i][j])
+                        {
+                            reg->sub_offsets[k].size = reg->prts_str[i][j+1] -
+                                                       reg->prts_str[i][j];
+                        }
+                        else
+                        {
+                            reg->sub_offsets[k].size =
+                                strlen(reg->prts_str[i][j]);
+                        }
+
+                        k++;
+                        reg->sub_offsets[k].offset = -1;
+
+                        j+=2;
+                    }
+
+                    return(ret);
+                }
+
                 /* We must always have the open and the close */
                 while(reg->prts_str[i][j] && reg->prts_str[i][j+1])
                 {
@@ -101,6 +141,13 @@ char *OSRegex_Execute(char *str, OSRegex *reg)
     /* Looping on all sub patterns */
     while(reg->patterns[i])
     {
+        /* The literal must be present */
+        if(reg->literals[i] && !_OS_FindLiteral(reg->literals[i], str))
+        {
+            i++;
+            continue;
+        }
+
         if((ret = _OS_Regex(reg->patterns[i], str, NULL, NULL, reg->flags[i])))
         {
             return(ret);
@@ -111,6 +158,41 @@ char *OSRegex_Execute(char *str, OSRegex *reg)
     return(NULL);
 }
 
+/** int _OS_FindLiteral(char *literal, char *str) v0.1
+ * Looks for the literal (from _OS_RegexLiteral) in str,
+ * comparing the characters the same way _OS_Regex does.
+ * Returns TRUE if found or FALSE otherwise.
+ */
+int _OS_FindLiteral(char *literal, char *str)
+{
+    char *pt;
+    char *st;
+
+    while(*str != '\0')
+    {
+        if(*literal == charmap[(uchar)*str])
+        {
+            pt = literal +1;
+            st = str +1;
+
+            while((*pt != '\0') && (*pt == charmap[(uchar)*st]))
+            {
+                pt++;
+                st++;
+            }
+
+            if(*pt == '\0')
+            {
+                return(TRUE);
+            }
+        }
+        str++;
+    }
+
+    return(FALSE);
+}
+
+
 #define PRTS(x) ((prts(*x) && x++) || 1)
 #define ENDOFFILE(x) ( PRTS(x) && (*x == '\0'))
 
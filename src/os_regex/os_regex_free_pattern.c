@@ -27,6 +27,20 @@ void OSRegex_FreePattern(OSRegex *reg)
 {
     int i = 0;
 
+    /* Freeing the literals (one for each pattern, if set) */
+    if(reg->literals)
+    {
+        i = 0;
+        while(reg->patterns && reg->patterns[i])
+        {
+            if(reg->literals[i])
+                free(reg->literals[i]);
+            i++;
+        }
+        free(reg->literals);
+        reg->literals = NULL;
+    }
+
     /* Freeing the patterns */
     if(reg->patterns)
     {
@@ -79,6 +93,13 @@ void OSRegex_FreePattern(OSRegex *reg)
         reg->sub_strings = NULL;
     }
 
+    /* Freeing the sub strings location */
+    if(reg->sub_offsets)
+    {
+        free(reg->sub_offsets);
+        reg->sub_offsets = NULL;
+    }
+
     return;
 }
 
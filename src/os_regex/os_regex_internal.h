@@ -704,6 +704,42 @@ static const uchar regexmap[][256] =
 };
 
 
+/* Minimum size of the literal string used to discard
+ * the OSRegex sub patterns before executing them.
+ */
+#define OS_REGEX_LITERAL_MIN    2
+
+
+/* Literal functions for OSRegex */
+char *_OS_RegexLiteral(char *pattern, int flags);
+int _OS_FindLiteral(char *literal, char *str);
+
+
+/* Minimum number of sub patterns (that can match anywhere
+ * in the string) to use the multi pattern automaton.
+ */
+#define OS_MATCH_AC_MIN     4
+
+
+/* Aho-Corasick automaton (used by OSMatch) */
+typedef struct _OSMatchAC
+{
+    int nstates;
+    int nclasses;
+    uchar classmap[256];
+    unsigned short *delta;
+    uchar *final;       /* Any pattern ends on this state */
+    uchar *own;         /* A pattern ends exactly here */
+    int *depth;
+}OSMatchAC;
+
+
+/* Multi pattern functions (os_match_ac.c) */
+OSMatchAC *_OS_MatchAC_Build(char **patterns, int count);
+int _OS_MatchAC(OSMatchAC *ac, char *str, int str_len);
+void _OS_MatchAC_Free(OSMatchAC *ac);
+
+
 #endif
 
 
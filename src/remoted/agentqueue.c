@@ -0,0 +1,669 @@
+/* @(#) $Id: ./src/remoted/agentqueue.c, 2011/09/08 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Events from the agents to analysisd.
+ * Each agent has its own queue and event rate (token bucket). A single
+ * thread sends the events to analysisd, taking turns between the agents
+ * with events waiting (deficit round robin). An agent flooding only
+ * fills (and drops from) its own queue.
+ * If the spool is enabled, the events analysisd is not able to receive
+ * (queue full) are kept there, and sent before the new ones.
+ */
+
+
+#include <pthread.h>
+#include <poll.h>
+#include <sys/time.h>
+
+#include "shared.h"
+#include "remoted.h"
+
+
+/* Bytes each agent can send on its turn (at least one message) */
+#define AQ_QUANTUM      (OS_MAXSTR + OS_FLSIZE)
+
+/* Messages taken from a queue at once */
+#define AQ_BATCH        64
+
+
+typedef struct _agent_queue
+{
+    char *id;
+    char *name;
+
+    /* Messages waiting ("srcmsg\0msg") and their sizes */
+    char **msgs;
+    unsigned int *sizes;
+    unsigned int head;
+    unsigned int count;
+
+    /* Round robin */
+    int active;
+    int removed;
+    unsigned int deficit;
+    struct _agent_queue *next_active;
+
+    /* Token bucket */
+    double tokens;
+    struct timeval last;
+
+    /* Counters */
+    unsigned int received;
+    unsigned int forwarded;
+    unsigned int rate_dropped;
+    unsigned int full_dropped;
+    unsigned int warned_dropped;
+
+    struct _agent_queue *next;
+}agent_queue;
+
+
+static OSHash *aq_hash = NULL;
+static agent_queue *aq_all = NULL;
+static agent_queue *aq_active = NULL;
+static agent_queue *aq_active_last = NULL;
+
+static pthread_mutex_t aq_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t aq_cond = PTHREAD_COND_INITIALIZER;
+static int aq_waiting = 0;
+
+static unsigned int aq_size = 0;
+static unsigned int aq_eps = 0;
+static unsigned int aq_burst = 0;
+static int aq_stats_interval = 0;
+static int aq_spool = 0;
+static int mq_batch = 0;
+
+
+
+/* _aq_create: Creates the queue of an agent.
+ * Must be called with aq_mutex locked.
+ */
+static agent_queue *_aq_create(keyentry *agent)
+{
+    agent_queue *queue;
+
+    os_calloc(1, sizeof(agent_queue), queue);
+    os_calloc(aq_size, sizeof(char *), queue->msgs);
+    os_calloc(aq_size, sizeof(unsigned int), queue->sizes);
+    os_strdup(agent->id, queue->id);
+    os_strdup(agent->name, queue->name);
+
+    queue->tokens = aq_burst;
+    gettimeofday(&queue->last, NULL);
+
+    if(OSHash_Add(aq_hash, queue->id, queue) != 2)
+    {
+        ErrorExit(MEM_ERROR, ARGV0);
+    }
+
+    queue->next = aq_all;
+    aq_all = queue;
+
+    return(queue);
+}
+
+
+/* _aq_free: Frees the queue of an agent (and the messages left).
+ * The queue must be out of the hash, aq_all and the round.
+ */
+static void _aq_free(agent_queue *queue)
+{
+    while(queue->count)
+    {
+        free(queue->msgs[queue->head]);
+        queue->head = (queue->head +1) % aq_size;
+        queue->count--;
+    }
+
+    os_free(queue->msgs);
+    os_free(queue->sizes);
+    os_free(queue->id);
+    os_free(queue->name);
+    os_free(queue);
+}
+
+
+/* _aq_allowed: Takes a token from the agent bucket.
+ * Returns 0 if the agent is over its rate.
+ */
+static int _aq_allowed(agent_queue *queue)
+{
+    struct timeval now;
+
+    if(!aq_eps)
+    {
+        return(1);
+    }
+
+    gettimeofday(&now, NULL);
+
+    queue->tokens += ((now.tv_sec - queue->last.tv_sec) +
+                      (now.tv_usec - queue->last.tv_usec) / 1000000.0) *
+                     aq_eps;
+    queue->last = now;
+
+    if(queue->tokens > aq_burst)
+    {
+        queue->tokens = aq_burst;
+    }
+
+    if(queue->tokens < 1)
+    {
+        return(0);
+    }
+
+    queue->tokens -= 1;
+    return(1);
+}
+
+
+/* _aq_send: Sends one message (or the ones batched if msg is NULL)
+ * to analysisd.
+ */
+static void _aq_send(char *msg)
+{
+    int rc;
+
+    if(msg)
+    {
+        rc = SendMSG(logr.m_queue, msg + strlen(msg) +1, msg, SECURE_MQ);
+    }
+    else
+    {
+        rc = FlushMSG(logr.m_queue);
+    }
+
+
+    /* If we can't send the message, try to connect to the
+     * socket again. If it not exit.
+     */
+    if(rc < 0)
+    {
+        merror(QUEUE_ERROR, ARGV0, DEFAULTQUEUE, strerror(errno));
+
+        if((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0)
+        {
+            ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQUEUE);
+        }
+    }
+}
+
+
+/* _aq_writable: Checks if analysisd can receive a message now
+ * (waiting up to timeout milliseconds).
+ */
+static int _aq_writable(int timeout)
+{
+    struct pollfd pfd;
+
+    pfd.fd = logr.m_queue;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+
+    if(poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLOUT))
+    {
+        return(1);
+    }
+
+    return(0);
+}
+
+
+/* _aq_drain: Sends the spooled events, while analysisd
+ * is able to receive them. Returns the number sent.
+ */
+static int _aq_drain()
+{
+    int i;
+    char *msg;
+
+    for(i = 0; i < AQ_BATCH; i++)
+    {
+        msg = spool_get();
+        if(!msg || !_aq_writable(0))
+        {
+            break;
+        }
+
+        _aq_send(msg);
+        spool_pop();
+    }
+
+    return(i);
+}
+
+
+/* _aq_stats: Writes the counters of each agent and warns
+ * about the agents dropping events.
+ * Must be called with aq_mutex locked.
+ */
+static void _aq_stats()
+{
+    FILE *fp;
+    agent_queue *queue;
+    char tmp_file[OS_FLSIZE +1];
+
+    tmp_file[OS_FLSIZE] = '\0';
+    snprintf(tmp_file, OS_FLSIZE, "%s.tmp", AGENTSTATS_FILE);
+
+    fp = fopen(tmp_file, "w");
+    if(!fp)
+    {
+        merror(FOPEN_ERROR, ARGV0, tmp_file);
+    }
+    else
+    {
+        fprintf(fp, "# id name received forwarded rate_dropped "
+                    "queue_dropped queued\n");
+    }
+
+    for(queue = aq_all; queue; queue = queue->next)
+    {
+        unsigned int dropped = queue->rate_dropped + queue->full_dropped;
+
+        if(fp)
+        {
+            fprintf(fp, "%s %s %u %u %u %u %u\n", queue->id, queue->name,
+                    queue->received, queue->forwarded, queue->rate_dropped,
+                    queue->full_dropped, queue->count);
+        }
+
+        if(dropped != queue->warned_dropped)
+        {
+            merror(AG_DROP_WARN, ARGV0, queue->name,
+                   dropped - queue->warned_dropped);
+            queue->warned_dropped = dropped;
+        }
+    }
+
+    if(fp)
+    {
+        fclose(fp);
+        if(rename(tmp_file, AGENTSTATS_FILE) < 0)
+        {
+            merror(RENAME_ERROR, ARGV0, tmp_file);
+        }
+    }
+}
+
+
+/* agentqueue_init: Reads the limits and starts the thread
+ * sending the events to analysisd. logr.m_queue must be open.
+ */
+void agentqueue_init()
+{
+    aq_size = getDefine_Int("remoted", "agent_queue_size", 10, 1000000);
+    aq_eps = getDefine_Int("remoted", "agent_eps", 0, 1000000);
+    aq_burst = getDefine_Int("remoted", "agent_burst", 0, 1000000);
+    aq_stats_interval = getDefine_Int("remoted", "agent_stats_interval",
+                                      1, 86400);
+
+    if(aq_burst < aq_eps)
+    {
+        aq_burst = aq_eps;
+    }
+
+
+    /* Spool, if enabled (remoted.spool_size) */
+    aq_spool = spool_init();
+
+
+    /* Batched messages to analysisd (when busy) */
+    mq_batch = getDefine_Int("remoted", "mq_batch_wait", 0, 1000);
+    SetMQBatch(mq_batch);
+
+
+    aq_hash = OSHash_Create();
+    if(!aq_hash)
+    {
+        ErrorExit(MEM_ERROR, ARGV0);
+    }
+
+    if(CreateThread(agentqueue_dispatch, (void *)NULL) != 0)
+    {
+        ErrorExit(THREAD_ERROR, ARGV0);
+    }
+}
+
+
+/* agentqueue_reload: Releases the queues of the agents removed
+ * from the keys (update_keys), after the swap. The events they
+ * still have waiting are sent before the queue is freed.
+ */
+void agentqueue_reload(keystore *keys)
+{
+    agent_queue *queue;
+    agent_queue **prev;
+    keyentry *agent;
+
+
+    if(!aq_hash)
+    {
+        return;
+    }
+
+    if(pthread_mutex_lock(&aq_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+        return;
+    }
+
+    prev = &aq_all;
+    while((queue = *prev))
+    {
+        agent = OSHash_Get(keys->keyhash_id, queue->id);
+        if(agent)
+        {
+            /* Same id, maybe a new name */
+            if(strcmp(agent->name, queue->name) != 0)
+            {
+                os_free(queue->name);
+                os_strdup(agent->name, queue->name);
+            }
+
+            prev = &queue->next;
+            continue;
+        }
+
+        debug1("%s: DEBUG: Removing the queue of agent '%s'.",
+               ARGV0, queue->name);
+
+        *prev = queue->next;
+        OSHash_Delete(aq_hash, queue->id);
+
+        /* Still in the round (freed by the dispatch thread) */
+        if(queue->active)
+        {
+            queue->removed = 1;
+            continue;
+        }
+
+        _aq_free(queue);
+    }
+
+    if(pthread_mutex_unlock(&aq_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+    }
+}
+
+
+/* agentqueue_add: Queues an event from an agent.
+ * Must be called with the keys read locked.
+ * Returns -1 if the event was dropped.
+ */
+int agentqueue_add(keyentry *agent, char *msg, char *srcmsg)
+{
+    int srcmsg_size;
+    int size;
+    char *item;
+    agent_queue *queue;
+
+
+    srcmsg_size = strlen(srcmsg) +1;
+    size = srcmsg_size + strlen(msg) +1;
+
+    os_malloc(size, item);
+    memcpy(item, srcmsg, srcmsg_size);
+    memcpy(item + srcmsg_size, msg, size - srcmsg_size);
+
+
+    if(pthread_mutex_lock(&aq_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+        free(item);
+        return(-1);
+    }
+
+    queue = OSHash_Get(aq_hash, agent->id);
+    if(!queue)
+    {
+        queue = _aq_create(agent);
+    }
+
+    queue->received++;
+
+
+    /* Over its rate or queue size */
+    if(!_aq_allowed(queue))
+    {
+        queue->rate_dropped++;
+        pthread_mutex_unlock(&aq_mutex);
+        free(item);
+        return(-1);
+    }
+    if(queue->count >= aq_size)
+    {
+        queue->full_dropped++;
+        pthread_mutex_unlock(&aq_mutex);
+        free(item);
+        return(-1);
+    }
+
+    queue->msgs[(queue->head + queue->count) % aq_size] = item;
+    queue->sizes[(queue->head + queue->count) % aq_size] = size;
+    queue->count++;
+
+
+    /* Waiting for its turn */
+    if(!queue->active)
+    {
+        queue->active = 1;
+        queue->next_active = NULL;
+
+        if(aq_active_last)
+        {
+            aq_active_last->next_active = queue;
+        }
+        else
+        {
+            aq_active = queue;
+        }
+        aq_active_last = queue;
+
+        if(aq_waiting)
+        {
+            pthread_cond_signal(&aq_cond);
+        }
+    }
+
+    if(pthread_mutex_unlock(&aq_mutex) != 0)
+    {
+        merror(MUTEX_ERROR, ARGV0);
+    }
+
+    return(0);
+}
+
+
+/* agentqueue_dispatch: Sends the events waiting to analysisd,
+ * one agent at a time.
+ */
+void *agentqueue_dispatch(void *none)
+{
+    int i;
+    int msgs_n;
+    int stats;
+    int pending = 0;
+    time_t stats_time = time(0);
+
+    char *msgs[AQ_BATCH];
+    unsigned int sizes[AQ_BATCH];
+    agent_queue *queue;
+
+
+    while(1)
+    {
+        if(pthread_mutex_lock(&aq_mutex) != 0)
+        {
+            merror(MUTEX_ERROR, ARGV0);
+            return(NULL);
+        }
+
+
+        /* Nothing waiting. Sending the batched messages first. */
+        if(!aq_active && pending)
+        {
+            pthread_mutex_unlock(&aq_mutex);
+
+            _aq_send(NULL);
+            pending = 0;
+            continue;
+        }
+
+        /* Only the spool waiting. Sending it when possible. */
+        if(!aq_active && aq_spool && spool_count())
+        {
+            pthread_mutex_unlock(&aq_mutex);
+
+            if(_aq_writable(1000) && _aq_drain() && mq_batch)
+            {
+                pending = 1;
+            }
+
+            if(pthread_mutex_lock(&aq_mutex) != 0)
+            {
+                merror(MUTEX_ERROR, ARGV0);
+                return(NULL);
+            }
+        }
+
+        else if(!aq_active)
+        {
+            struct timespec wait_time;
+
+            wait_time.tv_sec = time(0) + 1;
+            wait_time.tv_nsec = 0;
+
+            aq_waiting = 1;
+            pthread_cond_timedwait(&aq_cond, &aq_mutex, &wait_time);
+            aq_waiting = 0;
+        }
+
+
+        /* Taking the messages of the next agent (within its deficit) */
+        msgs_n = 0;
+        queue = aq_active;
+        if(queue)
+        {
+            queue->deficit += AQ_QUANTUM;
+
+            while(queue->count && msgs_n < AQ_BATCH &&
+                  queue->sizes[queue->head] <= queue->deficit)
+            {
+                queue->deficit -= queue->sizes[queue->head];
+                sizes[msgs_n] = queue->sizes[queue->head];
+                msgs[msgs_n++] = queue->msgs[queue->head];
+
+                queue->head = (queue->head +1) % aq_size;
+                queue->count--;
+            }
+            queue->forwarded += msgs_n;
+
+
+            /* Leaving the round, or going to the end of it */
+            aq_active = queue->next_active;
+            if(!aq_active)
+            {
+                aq_active_last = NULL;
+            }
+
+            if(!queue->count)
+            {
+                queue->active = 0;
+                queue->deficit = 0;
+
+                /* Agent removed from the keys */
+                if(queue->removed)
+                {
+                    _aq_free(queue);
+                }
+            }
+            else
+            {
+                if(queue->deficit > AQ_QUANTUM)
+                {
+                    queue->deficit = AQ_QUANTUM;
+                }
+
+                queue->next_active = NULL;
+                if(aq_active_last)
+                {
+                    aq_active_last->next_active = queue;
+                }
+                else
+                {
+                    aq_active = queue;
+                }
+                aq_active_last = queue;
+            }
+        }
+
+
+        /* Agent counters */
+        stats = 0;
+        if((time(0) - stats_time) >= aq_stats_interval)
+        {
+            _aq_stats();
+            stats_time = time(0);
+            stats = 1;
+        }
+
+        if(pthread_mutex_unlock(&aq_mutex) != 0)
+        {
+            merror(MUTEX_ERROR, ARGV0);
+        }
+
+
+        /* Sending without the lock. The spooled events go first
+         * and, while there are some left, the new ones go after them.
+         */
+        if(aq_spool)
+        {
+            if(spool_count() && _aq_drain() && mq_batch)
+            {
+                pending = 1;
+            }
+
+            if(spool_count() || !_aq_writable(0))
+            {
+                for(i = 0; i < msgs_n; i++)
+                {
+                    spool_add(msgs[i], sizes[i]);
+                    free(msgs[i]);
+                }
+                msgs_n = 0;
+            }
+
+            spool_sync(stats);
+        }
+
+        for(i = 0; i < msgs_n; i++)
+        {
+            _aq_send(msgs[i]);
+            free(msgs[i]);
+        }
+
+        if(msgs_n && mq_batch)
+        {
+            pending = 1;
+        }
+    }
+
+    return(NULL);
+}
+
+
+
+/* EOF */
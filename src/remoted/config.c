@@ -37,6 +37,8 @@ int RemotedConfig(char *cfgfile, remoted *logr)
     logr->conn = NULL;
     logr->allowips = NULL;
     logr->denyips = NULL;
+    logr->threads = 1;
+    logr->socks = NULL;
 
     if(ReadConfig(modules, cfgfile, logr, NULL) < 0)
         return(OS_INVALID);
@@ -583,12 +583,23 @@ void *wait_for_msgs(void *none)
         }
 
 
-        /* Checking if any agent is ready */
-        for(i = 0;i<keys.keysize; i++)
+        /* Checking if any agent is ready. The keys are read locked
+         * for each agent, so a reload (update_keys) can swap them
+         * between two agents, but not while one is being served.
+         */
+        for(i = 0;; i++)
         {
+            keyentries_rdlock();
+            if(i >= keys.keysize)
+            {
+                keyentries_unlock();
+                break;
+            }
+
             /* If agent wasn't changed, try next */
             if(_changed[i] != 1)
             {
+                keyentries_unlock();
                 continue;
             }
 
@@ -597,6 +608,7 @@ void *wait_for_msgs(void *none)
             /* locking mutex */
             if(pthread_mutex_lock(&lastmsg_mutex) != 0)
             {
+                keyentries_unlock();
                 merror(MUTEX_ERROR, ARGV0);
                 break;
             }
@@ -618,6 +630,7 @@ void *wait_for_msgs(void *none)
             /* Unlocking mutex */
             if(pthread_mutex_unlock(&lastmsg_mutex) != 0)
             {
+                keyentries_unlock();
                 merror(MUTEX_ERROR, ARGV0);
                 break;
             }
@@ -626,6 +639,8 @@ void *wait_for_msgs(void *none)
             {
                 read_controlmsg(i, msg);
             }
+
+            keyentries_unlock();
         }
     }
 
@@ -68,11 +68,58 @@ void HandleRemote(int position, int uid)
     }
     else
     {
+        /* Secure connections may have many receiver threads */
+        if(logr.conn[position] == SECURE_CONN)
+        {
+            logr.threads = getDefine_Int("remoted", "receiver_threads",
+                                         1, 64);
+        }
+
+        /* One socket for each thread, if supported */
+        if(logr.threads > 1)
+        {
+            int i;
+
+            os_calloc(logr.threads, sizeof(int), logr.socks);
+            for(i = 0; i < logr.threads; i++)
+            {
+                if((logr.socks[i] = OS_BindportudpReuse(logr.port[position],
+                                                        logr.lip[position],
+                                                        logr.ipv6[position])) < 0)
+                {
+                    break;
+                }
+            }
+
+            /* Not supported. They share the same socket. */
+            if(i < logr.threads)
+            {
+                merror("%s: WARN: Unable to use SO_REUSEPORT (%s). "
+                       "The receiver threads share the same socket.",
+                       ARGV0, strerror(errno));
+
+                while(i > 0)
+                {
+                    i--;
+                    close(logr.socks[i]);
+                }
+                free(logr.socks);
+                logr.socks = NULL;
+            }
+            else
+            {
+                logr.sock = logr.socks[0];
+            }
+        }
+
         /* Using UDP. Fast, unreliable.. perfect */
-        if((logr.sock =
-            OS_Bindportudp(logr.port[position], logr.lip[position], logr.ipv6[position])) < 0)
+        if(!logr.socks)
         {
-            ErrorExit(BIND_ERROR, ARGV0, logr.port[position]);
+            if((logr.sock =
+                OS_Bindportudp(logr.port[position], logr.lip[position], logr.ipv6[position])) < 0)
+            {
+                ErrorExit(BIND_ERROR, ARGV0, logr.port[position]);
+            }
         }
     }
 
@@ -60,13 +60,42 @@ void send_msg_init();
 
 int check_keyupdate();
 
+/* Reload the keys when they change */
+void *update_keys(void *none);
+
+/* Queue the events from the agents to analysisd */
+void agentqueue_init();
+int agentqueue_add(keyentry *agent, char *msg, char *srcmsg);
+void agentqueue_reload(keystore *keys);
+void *agentqueue_dispatch(void *none);
+
+/* Spool of the events while analysisd is busy */
+int spool_init();
+unsigned int spool_count();
+int spool_add(char *item, unsigned int size);
+char *spool_get();
+void spool_pop();
+void spool_sync(int stats);
+
 void key_lock();
 
 void key_unlock();
 
+void keyentries_rdlock();
+
+void keyentries_unlock();
+
 void keyupdate_init();
 
 
+/* Per agent event counters (written by agentqueue_dispatch) */
+#define AGENTSTATS_FILE     "/queue/rids/agent-stats"
+
+/* Event spool (see spool.c) and its counters */
+#define SPOOL_FILE          "/queue/spool/events"
+#define SPOOLSTATS_FILE     "/queue/spool/stats"
+
+
 /*** Global variables ***/
 
 keystore keys;
@@ -12,6 +12,8 @@
 
 
 
+#include <pthread.h>
+
 #include "shared.h"
 #include "os_net/os_net.h"
 
@@ -19,83 +21,171 @@
 #include "remoted.h"
 
 
-/** void HandleSecure() v0.3
- * Handle the secure connections
+/* Messages from the same agent are handled one at a time
+ * (counters and control messages). Agents share these locks.
  */
-void HandleSecure()
+#define SECURE_AGENT_LOCKS  64
+
+static pthread_mutex_t agent_mutex[SECURE_AGENT_LOCKS];
+
+/** void HandleSecureMSG() v0.1
+ * Handles one message received from an agent.
+ * Must be called with the keys read locked.
+ */
+static void HandleSecureMSG(char *buffer, int recv_b,
+                            struct sockaddr_in *peer_info,
+                            socklen_t peer_size)
 {
     int agentid;
 
-    char buffer[OS_MAXSTR +1];
     char cleartext_msg[OS_MAXSTR +1];
     char srcip[IPSIZE +1];
     char *tmp_msg;
     char srcmsg[OS_FLSIZE +1];
 
+    pthread_mutex_t *agent_lock;
 
-    int recv_b;
 
-    struct sockaddr_in peer_info;
-    socklen_t peer_size;
+    /* Setting the source ip */
+    strncpy(srcip, inet_ntoa(peer_info->sin_addr), IPSIZE);
+    srcip[IPSIZE] = '\0';
 
 
-    /* Send msg init */
-    send_msg_init();
 
+    /* Getting a valid agentid */
+    if(buffer[0] == '!')
+    {
+        tmp_msg = buffer;
+        tmp_msg++;
 
-    /* Initializing key mutex. */
-    keyupdate_init();
 
+        /* We need to make sure that we have a valid id
+         * and that we reduce the recv buffer size.
+         */
+        while(isdigit((int)*tmp_msg))
+        {
+            tmp_msg++;
+            recv_b--;
+        }
 
-    /* Initializing manager */
-    manager_init(0);
+        if(*tmp_msg != '!')
+        {
+            merror(ENCFORMAT_ERROR, __local_name, srcip);
+            return;
+        }
 
+        *tmp_msg = '\0';
+        tmp_msg++;
+        recv_b-=2;
 
-    /* Creating Ar forwarder thread */
-    if(CreateThread(AR_Forward, (void *)NULL) != 0)
+        agentid = OS_IsAllowedDynamicID(&keys, buffer +1, srcip);
+        if(agentid == -1)
+        {
+            /* New agents are known after update_keys reloads the keys.
+             * The agent will send the message again.
+             */
+            if(check_keyupdate())
+            {
+                debug1("%s: DEBUG: Keys not reloaded yet for '%s'.",
+                       ARGV0, srcip);
+            }
+            else
+            {
+                merror(ENC_IP_ERROR, ARGV0, srcip);
+            }
+            return;
+        }
+    }
+    else
     {
-        ErrorExit(THREAD_ERROR, ARGV0);
+        agentid = OS_IsAllowedIP(&keys, srcip);
+        if(agentid < 0)
+        {
+            if(check_keyupdate())
+            {
+                debug1("%s: DEBUG: Keys not reloaded yet for '%s'.",
+                       ARGV0, srcip);
+            }
+            else
+            {
+                merror(DENYIP_WARN,ARGV0,srcip);
+            }
+            return;
+        }
+        tmp_msg = buffer;
     }
 
-    /* Creating wait_for_msgs thread */
-    if(CreateThread(wait_for_msgs, (void *)NULL) != 0)
+
+    /* Only one message from this agent at a time */
+    agent_lock = &agent_mutex[agentid % SECURE_AGENT_LOCKS];
+    if(pthread_mutex_lock(agent_lock) != 0)
     {
-        ErrorExit(THREAD_ERROR, ARGV0);
+        merror(MUTEX_ERROR, ARGV0);
+        return;
     }
 
 
-    /* Connecting to the message queue
-     * Exit if it fails.
-     */
-    if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
+    /* Decrypting the message */
+    tmp_msg = ReadSecMSG(&keys, tmp_msg, cleartext_msg,
+                         agentid, recv_b -1);
+    if(tmp_msg == NULL)
     {
-        ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQUEUE);
+        /* If duplicated, a warning was already generated */
+        pthread_mutex_unlock(agent_lock);
+        return;
     }
 
 
-    verbose(AG_AX_AGENTS, ARGV0, MAX_AGENTS);
+    /* Check if it is a control message */
+    if(IsValidHeader(tmp_msg))
+    {
+        /* We need to save the peerinfo if it is a control msg */
+        memcpy(&keys.keyentries[agentid]->peer_info, peer_info, peer_size);
+        keys.keyentries[agentid]->rcvd = time(0);
 
+        save_controlmsg(agentid, tmp_msg);
 
-    /* Reading authentication keys */
-    verbose(ENC_READ, ARGV0);
+        pthread_mutex_unlock(agent_lock);
+        return;
+    }
 
-    OS_ReadKeys(&keys);
+    pthread_mutex_unlock(agent_lock);
+
+
+    /* Generating srcmsg */
+    snprintf(srcmsg, OS_FLSIZE,"(%s) %s",keys.keyentries[agentid]->name,
+                                         keys.keyentries[agentid]->ip->ip);
 
-    debug1("%s: DEBUG: OS_StartCounter.", ARGV0);
-    OS_StartCounter(&keys);
-    debug1("%s: DEBUG: OS_StartCounter completed.", ARGV0);
+
+    /* Queuing to analysisd (dropped if over the agent limits) */
+    agentqueue_add(keys.keyentries[agentid], tmp_msg, srcmsg);
+
+    return;
+}
+
+
+
+/** void *HandleSecureSocket(void *sock) v0.1
+ * Receives the messages from one socket (each
+ * receiver thread has its own, if supported).
+ */
+static void *HandleSecureSocket(void *sock)
+{
+    int recv_sock = *(int *)sock;
+    int recv_b;
+
+    char buffer[OS_MAXSTR +1];
+
+    struct sockaddr_in peer_info;
+    socklen_t peer_size;
 
 
     /* setting up peer size */
     peer_size = sizeof(peer_info);
-    logr.peer_size = sizeof(peer_info);
 
 
     /* Initializing some variables */
     memset(buffer, '\0', OS_MAXSTR +1);
-    memset(cleartext_msg, '\0', OS_MAXSTR +1);
-    memset(srcmsg, '\0', OS_FLSIZE +1);
-    tmp_msg = NULL;
 
 
 
@@ -103,7 +193,7 @@ void HandleSecure()
     while(1)
     {
         /* Receiving message  */
-        recv_b = recvfrom(logr.sock, buffer, OS_MAXSTR, 0,
+        recv_b = recvfrom(recv_sock, buffer, OS_MAXSTR, 0,
                 (struct sockaddr *)&peer_info, &peer_size);
 
 
@@ -114,123 +204,111 @@ void HandleSecure()
         }
 
 
-        /* Setting the source ip */
-        strncpy(srcip, inet_ntoa(peer_info.sin_addr), IPSIZE);
-        srcip[IPSIZE] = '\0';
+        keyentries_rdlock();
 
+        HandleSecureMSG(buffer, recv_b, &peer_info, peer_size);
 
+        keyentries_unlock();
+    }
 
-        /* Getting a valid agentid */
-        if(buffer[0] == '!')
-        {
-            tmp_msg = buffer;
-            tmp_msg++;
+    return(NULL);
+}
 
 
-            /* We need to make sure that we have a valid id
-             * and that we reduce the recv buffer size.
-             */
-            while(isdigit((int)*tmp_msg))
-            {
-                tmp_msg++;
-                recv_b--;
-            }
 
-            if(*tmp_msg != '!')
-            {
-                merror(ENCFORMAT_ERROR, __local_name, srcip);
-                continue;
-            }
+/** void HandleSecure() v0.3
+ * Handle the secure connections
+ */
+void HandleSecure()
+{
+    int i;
 
-            *tmp_msg = '\0';
-            tmp_msg++;
-            recv_b-=2;
 
-            agentid = OS_IsAllowedDynamicID(&keys, buffer +1, srcip);
-            if(agentid == -1)
-            {
-                if(check_keyupdate())
-                {
-                    agentid = OS_IsAllowedDynamicID(&keys, buffer +1, srcip);
-                    if(agentid == -1)
-                    {
-                        merror(ENC_IP_ERROR, ARGV0, srcip);
-                        continue;
-                    }
-                }
-                else
-                {
-                    merror(ENC_IP_ERROR, ARGV0, srcip);
-                    continue;
-                }
-            }
-        }
-        else
-        {
-            agentid = OS_IsAllowedIP(&keys, srcip);
-            if(agentid < 0)
-            {
-                if(check_keyupdate())
-                {
-                    agentid = OS_IsAllowedIP(&keys, srcip);
-                    if(agentid == -1)
-                    {
-                        merror(DENYIP_WARN,ARGV0,srcip);
-                        continue;
-                    }
-                }
-                else
-                {
-                    merror(DENYIP_WARN,ARGV0,srcip);
-                    continue;
-                }
-            }
-            tmp_msg = buffer;
-        }
+    /* Send msg init */
+    send_msg_init();
 
 
-        /* Decrypting the message */
-        tmp_msg = ReadSecMSG(&keys, tmp_msg, cleartext_msg,
-                             agentid, recv_b -1);
-        if(tmp_msg == NULL)
-        {
-            /* If duplicated, a warning was already generated */
-            continue;
-        }
+    /* Initializing key mutex. */
+    keyupdate_init();
 
 
-        /* Check if it is a control message */
-        if(IsValidHeader(tmp_msg))
-        {
-            /* We need to save the peerinfo if it is a control msg */
-            memcpy(&keys.keyentries[agentid]->peer_info, &peer_info, peer_size);
-            keys.keyentries[agentid]->rcvd = time(0);
+    /* Initializing the agent locks */
+    for(i = 0; i < SECURE_AGENT_LOCKS; i++)
+    {
+        pthread_mutex_init(&agent_mutex[i], NULL);
+    }
 
-            save_controlmsg(agentid, tmp_msg);
 
-            continue;
-        }
+    /* Initializing manager */
+    manager_init(0);
 
 
-        /* Generating srcmsg */
-        snprintf(srcmsg, OS_FLSIZE,"(%s) %s",keys.keyentries[agentid]->name,
-                                             keys.keyentries[agentid]->ip->ip);
+    /* Creating Ar forwarder thread */
+    if(CreateThread(AR_Forward, (void *)NULL) != 0)
+    {
+        ErrorExit(THREAD_ERROR, ARGV0);
+    }
 
+    /* Creating wait_for_msgs thread */
+    if(CreateThread(wait_for_msgs, (void *)NULL) != 0)
+    {
+        ErrorExit(THREAD_ERROR, ARGV0);
+    }
 
-        /* If we can't send the message, try to connect to the
-         * socket again. If it not exit.
-         */
-        if(SendMSG(logr.m_queue, tmp_msg, srcmsg,
-                   SECURE_MQ) < 0)
-        {
-            merror(QUEUE_ERROR, ARGV0, DEFAULTQUEUE, strerror(errno));
 
-            if((logr.m_queue = StartMQ(DEFAULTQUEUE, WRITE)) < 0)
-            {
-                ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQUEUE);
-            }
+    /* Connecting to the message queue
+     * Exit if it fails.
+     */
+    if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
+    {
+        ErrorExit(QUEUE_FATAL, ARGV0, DEFAULTQUEUE);
+    }
+
+
+    /* Queues of the agent events (and sender thread) */
+    agentqueue_init();
+
+
+    verbose(AG_AX_AGENTS, ARGV0, MAX_AGENTS);
+
+
+    /* Reading authentication keys */
+    verbose(ENC_READ, ARGV0);
+
+    OS_ReadKeys(&keys);
+
+    debug1("%s: DEBUG: OS_StartCounter.", ARGV0);
+    OS_StartCounter(&keys);
+    debug1("%s: DEBUG: OS_StartCounter completed.", ARGV0);
+
+
+    /* Creating the key update thread */
+    if(CreateThread(update_keys, (void *)NULL) != 0)
+    {
+        ErrorExit(THREAD_ERROR, ARGV0);
+    }
+
+
+    /* setting up peer size */
+    logr.peer_size = sizeof(struct sockaddr_in);
+
+
+    /* Creating the other receiver threads */
+    for(i = 1; i < logr.threads; i++)
+    {
+        if(CreateThread(HandleSecureSocket,
+                        logr.socks?(void *)&logr.socks[i]:
+                                   (void *)&logr.sock) != 0)
+        {
+            ErrorExit(THREAD_ERROR, ARGV0);
         }
     }
+
+    debug1("%s: DEBUG: Secure receiver threads: %d.", ARGV0, logr.threads);
+
+
+    /* This one receives on the first socket */
+    HandleSecureSocket((void *)&logr.sock);
 }
 
 
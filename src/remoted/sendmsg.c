@@ -11,9 +11,14 @@
  */
 
 
-#include "shared.h"
+/* The rwlock kind (writer preferred) is a glibc extension */
+#ifdef __linux__
+	#define _GNU_SOURCE
+#endif
 #include <pthread.h>
 
+#include "shared.h"
+
 #include "remoted.h"
 #include "os_net/os_net.h"
 
@@ -24,14 +29,36 @@ pthread_mutex_t sendmsg_mutex;
 /* pthread key update mutex */
 pthread_mutex_t keyupdate_mutex;
 
+/* Keys in use by the receiver threads (write locked to update) */
+pthread_rwlock_t keyentries_rwlock;
+
 
 /* void keyupdate_init()
  * Initializes mutex.
+ * The keys lock prefers the writer (update_keys). The glibc default
+ * prefers the readers, and the receiver threads always holding a read
+ * lock under load would keep the new keys from ever being loaded.
+ * None of the readers takes the read lock twice, so the writer
+ * waiting can not block them.
  */
 void keyupdate_init()
 {
+    pthread_rwlockattr_t rwlock_attr;
+
     /* Initializing mutex */
     pthread_mutex_init(&keyupdate_mutex, NULL);
+
+    pthread_rwlockattr_init(&rwlock_attr);
+    #ifdef __GLIBC__
+    pthread_rwlockattr_setkind_np(&rwlock_attr,
+                          PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    #endif
+
+    if(pthread_rwlock_init(&keyentries_rwlock, &rwlock_attr) != 0)
+    {
+        ErrorExit(MUTEX_ERROR, ARGV0);
+    }
+    pthread_rwlockattr_destroy(&rwlock_attr);
 }
 
 
@@ -55,44 +82,115 @@ void key_unlock()
 }
 
 
-/* check_keyupdate()
- * Check for key updates.
+/* void keyentries_rdlock()
+ * void keyentries_unlock()
+ * Locks/unlocks the keys for reading (receiver and manager threads).
  */
-int check_keyupdate()
+void keyentries_rdlock()
 {
-    /* Checking key for updates. */
-    if(!OS_CheckUpdateKeys(&keys))
+    if(pthread_rwlock_rdlock(&keyentries_rwlock) != 0)
     {
-        return(0);
+        merror(MUTEX_ERROR, ARGV0);
     }
-
-    key_lock();
-
-    /* Locking before using */
-    if(pthread_mutex_lock(&sendmsg_mutex) != 0)
+}
+void keyentries_unlock()
+{
+    if(pthread_rwlock_unlock(&keyentries_rwlock) != 0)
     {
-        key_unlock();
         merror(MUTEX_ERROR, ARGV0);
-        return(0);
     }
+}
+
+
+/* check_keyupdate()
+ * Checks if the keys changed on disk (to be read by update_keys).
+ * Must be called with the keys read locked.
+ */
+int check_keyupdate()
+{
+    return(OS_CheckUpdateKeys(&keys));
+}
+
 
-    if(OS_UpdateKeys(&keys))
+/* update_keys()
+ * Reloads the keys when they change. The new keys are read while the
+ * receiver threads keep using the old ones, which are only write
+ * locked to carry the agents state and swap them.
+ */
+void *update_keys(void *none)
+{
+    keystore old_keys;
+    keystore new_keys;
+
+    while(1)
     {
+        sleep(1);
+
+        /* Only this thread changes the keys */
+        if(!OS_CheckUpdateKeys(&keys))
+        {
+            continue;
+        }
+
+        merror(ENCFILE_CHANGED, ARGV0);
+        verbose(ENC_READ, ARGV0);
+
+
+        /* Reading the new keys */
+        memset(&new_keys, 0, sizeof(keystore));
+        OS_ReadKeys(&new_keys);
+        debug1("%s: DEBUG: OS_ReadKeys completed", ARGV0);
+
+
+        /* Lock use of keys (ar forwarder) */
+        key_lock();
+
+        /* Waiting for the receiver threads */
+        if(pthread_rwlock_wrlock(&keyentries_rwlock) != 0)
+        {
+            key_unlock();
+            merror(MUTEX_ERROR, ARGV0);
+            OS_FreeKeys(&new_keys);
+            continue;
+        }
+
+        if(pthread_mutex_lock(&sendmsg_mutex) != 0)
+        {
+            keyentries_unlock();
+            key_unlock();
+            merror(MUTEX_ERROR, ARGV0);
+            OS_FreeKeys(&new_keys);
+            continue;
+        }
+
+
+        /* Swapping. Only the agents added get a counter. */
+        OS_CopyKeysState(&new_keys, &keys);
+
+        memcpy(&old_keys, &keys, sizeof(keystore));
+        memcpy(&keys, &new_keys, sizeof(keystore));
+
+        OS_StartCounter(&keys);
+
+
         if(pthread_mutex_unlock(&sendmsg_mutex) != 0)
         {
             merror(MUTEX_ERROR, ARGV0);
         }
+        keyentries_unlock();
         key_unlock();
-        return(1);
-    }
 
-    if(pthread_mutex_unlock(&sendmsg_mutex) != 0)
-    {
-        merror(MUTEX_ERROR, ARGV0);
+
+        /* Releasing the queues of the agents removed */
+        agentqueue_reload(&keys);
+
+
+        /* Freeing the old keys, outside of the locks */
+        OS_FreeKeys(&old_keys);
+        debug1("%s: DEBUG: Key update completed", ARGV0);
     }
-    key_unlock();
 
-    return(0);
+    return(NULL);
 }
 
 
@@ -108,6 +206,8 @@ void send_msg_init()
 
 /* send_msg()
  * Send message to an agent.
+ * Must be called with the keys locked (keyentries_rdlock or key_lock),
+ * since update_keys frees the old entries after swapping them.
  * Returns -1 on error
  */
 int send_msg(int agentid, char *msg)
@@ -123,18 +223,21 @@ int send_msg(int agentid, char *msg)
     }
 
 
-    msg_size = CreateSecMSG(&keys, msg, crypt_msg, agentid);
-    if(msg_size == 0)
+    /* Locking before using. The sender counter (CreateSecMSG) is
+     * shared by all the threads sending to the agents.
+     */
+    if(pthread_mutex_lock(&sendmsg_mutex) != 0)
     {
-        merror(SEC_ERROR,ARGV0);
+        merror(MUTEX_ERROR, ARGV0);
         return(-1);
     }
 
 
-    /* Locking before using */
-    if(pthread_mutex_lock(&sendmsg_mutex) != 0)
+    msg_size = CreateSecMSG(&keys, msg, crypt_msg, agentid);
+    if(msg_size == 0)
     {
-        merror(MUTEX_ERROR, ARGV0);
+        pthread_mutex_unlock(&sendmsg_mutex);
+        merror(SEC_ERROR,ARGV0);
         return(-1);
     }
 
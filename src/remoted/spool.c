@@ -0,0 +1,379 @@
+/* @(#) $Id: ./src/remoted/spool.c, 2011/09/08 dcid Exp $
+ */
+
+/* Copyright (C) 2009 Trend Micro Inc.
+ * All right reserved.
+ *
+ * This program is a free software; you can redistribute it
+ * and/or modify it under the terms of the GNU General Public
+ * License (version 2) as published by the FSF - Free Software
+ * Foundation
+ */
+
+
+/* Spool of the agent events, used while analysisd is not able to
+ * receive them (queue full). The events are appended to a memory mapped
+ * ring file (SPOOL_FILE) of remoted.spool_size MB and sent in the same
+ * order once analysisd catches up. The header is only updated after the
+ * record is written, so the spool is still valid if remoted dies (one
+ * event may be sent twice). It is msync'ed every second.
+ */
+
+
+#include <sys/mman.h>
+
+#include "shared.h"
+#include "remoted.h"
+
+
+#define SPOOL_MAGIC     "OSSPOOL"
+
+typedef struct _spool_header
+{
+    char magic[8];
+    unsigned int size;
+    unsigned int head;
+    unsigned int tail;
+}spool_header;
+
+/* Each record is its size followed by the event (aligned to 4 bytes).
+ * A size of 0 means the next record is at the beginning.
+ */
+#define SPOOL_ALIGN(x)  (((x) + 3) & ~3U)
+#define SPOOL_REC(x)    (sizeof(unsigned int) + SPOOL_ALIGN(x))
+
+static spool_header *spool_hdr = NULL;
+static char *spool_data = NULL;
+static size_t spool_mapsize = 0;
+
+static unsigned int spool_events = 0;
+static unsigned int spool_added = 0;
+static unsigned int spool_dropped = 0;
+static unsigned int spool_warned = 0;
+static time_t spool_synced = 0;
+
+
+
+/* _spool_used: Bytes used by the records.
+ */
+static unsigned int _spool_used()
+{
+    if(spool_hdr->tail >= spool_hdr->head)
+    {
+        return(spool_hdr->tail - spool_hdr->head);
+    }
+
+    return(spool_hdr->size - spool_hdr->head + spool_hdr->tail);
+}
+
+
+/* _spool_count: Counts (and checks) the records from head to tail.
+ * Returns -1 if they are not valid.
+ */
+static int _spool_count()
+{
+    int events = 0;
+    unsigned int pos = spool_hdr->head;
+    unsigned int size;
+
+    if((spool_hdr->head >= spool_hdr->size) ||
+       (spool_hdr->tail >= spool_hdr->size) ||
+       (spool_hdr->head % 4) || (spool_hdr->tail % 4))
+    {
+        return(-1);
+    }
+
+    while(pos != spool_hdr->tail)
+    {
+        if(spool_hdr->size - pos < sizeof(unsigned int))
+        {
+            pos = 0;
+            continue;
+        }
+
+        memcpy(&size, spool_data + pos, sizeof(unsigned int));
+        if(size == 0)
+        {
+            /* Wrapping, but never over the tail */
+            if(pos < spool_hdr->tail)
+            {
+                return(-1);
+            }
+            pos = 0;
+            continue;
+        }
+
+        if((size > spool_hdr->size) ||
+           (pos + SPOOL_REC(size) > spool_hdr->size) ||
+           ((pos < spool_hdr->tail) &&
+            (pos + SPOOL_REC(size) > spool_hdr->tail)))
+        {
+            return(-1);
+        }
+
+        pos += SPOOL_REC(size);
+        events++;
+    }
+
+    return(events);
+}
+
+
+/* spool_init: Opens (or creates) the spool.
+ * Returns 0 if it is disabled (remoted.spool_size = 0).
+ */
+int spool_init()
+{
+    int fd;
+    int events = 0;
+    unsigned int size;
+    spool_header hdr;
+    struct stat st;
+
+
+    size = getDefine_Int("remoted", "spool_size", 0, 4095);
+    if(size == 0)
+    {
+        return(0);
+    }
+    size *= 1024 * 1024;
+
+
+    fd = open(SPOOL_FILE, O_RDWR|O_CREAT, 0640);
+    if(fd < 0)
+    {
+        ErrorExit(FOPEN_ERROR, ARGV0, SPOOL_FILE);
+    }
+
+
+    /* Events left from the last run are kept, with the old size */
+    memset(&hdr, '\0', sizeof(hdr));
+    if((fstat(fd, &st) == 0) &&
+       (st.st_size >= (off_t)sizeof(spool_header)) &&
+       (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr)) &&
+       (memcmp(hdr.magic, SPOOL_MAGIC, sizeof(SPOOL_MAGIC)) == 0) &&
+       (st.st_size == (off_t)(sizeof(spool_header) + hdr.size)) &&
+       (hdr.head != hdr.tail))
+    {
+        size = hdr.size;
+    }
+    else
+    {
+        memset(&hdr, '\0', sizeof(hdr));
+    }
+
+    spool_mapsize = sizeof(spool_header) + size;
+    if(ftruncate(fd, spool_mapsize) < 0)
+    {
+        ErrorExit(FOPEN_ERROR, ARGV0, SPOOL_FILE);
+    }
+
+    spool_hdr = mmap(NULL, spool_mapsize, PROT_READ|PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+    if(spool_hdr == MAP_FAILED)
+    {
+        merror("%s: Unable to map the spool. errno: %d", ARGV0, errno);
+        ErrorExit(FOPEN_ERROR, ARGV0, SPOOL_FILE);
+    }
+    close(fd);
+
+    spool_data = (char *)spool_hdr + sizeof(spool_header);
+
+
+    if(hdr.size)
+    {
+        events = _spool_count();
+        if(events < 0)
+        {
+            merror("%s: Invalid spool '%s'. Starting a new one.",
+                   ARGV0, SPOOL_FILE);
+            events = 0;
+            hdr.size = 0;
+        }
+    }
+
+    if(!hdr.size)
+    {
+        memset(spool_hdr, '\0', sizeof(spool_header));
+        memcpy(spool_hdr->magic, SPOOL_MAGIC, sizeof(SPOOL_MAGIC));
+        spool_hdr->size = size;
+    }
+
+    spool_events = events;
+    spool_synced = time(0);
+
+    verbose("%s: INFO: Spool of %u bytes with %u events.",
+            ARGV0, spool_hdr->size, spool_events);
+
+    return(1);
+}
+
+
+/* spool_count: Returns the events in the spool.
+ */
+unsigned int spool_count()
+{
+    return(spool_events);
+}
+
+
+/* spool_add: Appends an event (size bytes at item).
+ * Returns -1 if the spool is full.
+ */
+int spool_add(char *item, unsigned int size)
+{
+    unsigned int pos;
+    unsigned int rec_size = SPOOL_REC(size);
+
+
+    /* Empty. Starting again from the beginning. */
+    if(spool_hdr->head == spool_hdr->tail)
+    {
+        spool_hdr->head = 0;
+        spool_hdr->tail = 0;
+    }
+
+    pos = spool_hdr->tail;
+
+
+    /* The tail never reaches the head (it would look empty) */
+    if(pos >= spool_hdr->head)
+    {
+        if((spool_hdr->size - pos < rec_size) ||
+           ((spool_hdr->size - pos == rec_size) && (spool_hdr->head == 0)))
+        {
+            if(rec_size >= spool_hdr->head)
+            {
+                spool_dropped++;
+                return(-1);
+            }
+            pos = 0;
+        }
+    }
+    else if(spool_hdr->head - pos <= rec_size)
+    {
+        spool_dropped++;
+        return(-1);
+    }
+
+
+    /* Writing the record before making it visible */
+    memcpy(spool_data + pos, &size, sizeof(unsigned int));
+    memcpy(spool_data + pos + sizeof(unsigned int), item, size);
+
+    if(pos == 0 && spool_hdr->tail != 0 &&
+       spool_hdr->size - spool_hdr->tail >= sizeof(unsigned int))
+    {
+        memset(spool_data + spool_hdr->tail, '\0', sizeof(unsigned int));
+    }
+
+    spool_hdr->tail = pos + rec_size;
+    if(spool_hdr->tail == spool_hdr->size)
+    {
+        spool_hdr->tail = 0;
+    }
+
+    spool_events++;
+    spool_added++;
+
+    return(0);
+}
+
+
+/* spool_get: Returns the oldest event (NULL if empty).
+ * It is only removed by spool_pop.
+ */
+char *spool_get()
+{
+    unsigned int size;
+
+    while(spool_hdr->head != spool_hdr->tail)
+    {
+        if(spool_hdr->size - spool_hdr->head < sizeof(unsigned int))
+        {
+            spool_hdr->head = 0;
+            continue;
+        }
+
+        memcpy(&size, spool_data + spool_hdr->head, sizeof(unsigned int));
+        if(size == 0)
+        {
+            spool_hdr->head = 0;
+            continue;
+        }
+
+        return(spool_data + spool_hdr->head + sizeof(unsigned int));
+    }
+
+    return(NULL);
+}
+
+
+/* spool_pop: Removes the oldest event.
+ */
+void spool_pop()
+{
+    unsigned int size;
+
+    if(!spool_get())
+    {
+        return;
+    }
+
+    memcpy(&size, spool_data + spool_hdr->head, sizeof(unsigned int));
+
+    spool_hdr->head += SPOOL_REC(size);
+    if(spool_hdr->head == spool_hdr->size)
+    {
+        spool_hdr->head = 0;
+    }
+
+    spool_events--;
+}
+
+
+/* spool_sync: Flushes the spool to disk (once a second at most)
+ * and writes its counters to SPOOLSTATS_FILE if stats is set.
+ */
+void spool_sync(int stats)
+{
+    FILE *fp;
+
+    if(!spool_hdr)
+    {
+        return;
+    }
+
+    if(spool_synced != time(0))
+    {
+        msync(spool_hdr, spool_mapsize, MS_ASYNC);
+        spool_synced = time(0);
+    }
+
+    if(!stats)
+    {
+        return;
+    }
+
+    fp = fopen(SPOOLSTATS_FILE, "w");
+    if(!fp)
+    {
+        merror(FOPEN_ERROR, ARGV0, SPOOLSTATS_FILE);
+        return;
+    }
+
+    fprintf(fp, "# used size events spooled dropped\n");
+    fprintf(fp, "%u %u %u %u %u\n", _spool_used(), spool_hdr->size,
+            spool_events, spool_added, spool_dropped);
+    fclose(fp);
+
+    if(spool_dropped != spool_warned)
+    {
+        merror(SPOOL_FULL_WARN, ARGV0, spool_dropped - spool_warned);
+        spool_warned = spool_dropped;
+    }
+}
+
+
+
+/* EOF */
@@ -11,6 +11,11 @@
  */
 
 
+/* recvmmsg is Linux specific and is only picked up with _GNU_SOURCE */
+#ifdef __linux__
+	#define _GNU_SOURCE
+	#include <sys/socket.h>
+#endif
 
 #include "shared.h"
 #include "os_net/os_net.h"
@@ -18,22 +23,53 @@
 #include "remoted.h"
 
 
+/* Datagrams read at once (recvmmsg) */
+#define SYSLOG_BATCH        64
+
+/* Receive buffer of the socket (the kernel may cap it) */
+#define SYSLOG_RCVBUF       (4 * 1024 * 1024)
+
+/* Known senders, with the result of the allow/deny check */
+#define SYSLOG_PEERS        256
+
+typedef struct _syslog_peer
+{
+    unsigned int addr;
+    int used;
+    int denied;
+    char srcip[IPSIZE +1];
+}syslog_peer;
+
+static syslog_peer peers[SYSLOG_PEERS];
+
+static char buffers[SYSLOG_BATCH][OS_SIZE_1024 +2];
+static struct sockaddr_in peers_info[SYSLOG_BATCH];
+
+static int mq_batch = 0;
+
+
+
+/* Allowed/denied ips, compiled at startup */
+static os_iptree *allowtree = NULL;
+static os_iptree *denytree = NULL;
+
+
 
 /* OS_IPNotAllowed, v0.1, 2005/02/11
  * Checks if an IP is not allowed.
  */
 static int OS_IPNotAllowed(char *srcip)
 {
-    if(logr.denyips != NULL)
+    if(denytree != NULL)
     {
-        if(OS_IPFoundList(srcip, logr.denyips))
+        if(OS_IPFoundTree(srcip, denytree))
         {
             return(1);
         }
     }
-    if(logr.allowips != NULL)
+    if(allowtree != NULL)
     {
-        if(OS_IPFoundList(srcip, logr.allowips))
+        if(OS_IPFoundTree(srcip, allowtree))
         {
             return(0);
         }
@@ -44,28 +80,143 @@ static int OS_IPNotAllowed(char *srcip)
 }
 
 
-/** void HandleSyslog() v0.2
- * Handle syslog connections
+/* GetPeer: Returns the sender of a datagram, checking
+ * if it is allowed only the first time it is seen.
  */
-void HandleSyslog()
+static syslog_peer *GetPeer(struct sockaddr_in *peer_info)
 {
-    char buffer[OS_SIZE_1024 +2];
-    char srcip[IPSIZE +1];
+    unsigned int addr = peer_info->sin_addr.s_addr;
+    syslog_peer *peer;
+
+    peer = &peers[(addr * 2654435761U) >> 24];
+    if(peer->used && peer->addr == addr)
+    {
+        return(peer);
+    }
+
+    peer->used = 1;
+    peer->addr = addr;
+
+    /* Setting the source ip */
+    strncpy(peer->srcip, inet_ntoa(peer_info->sin_addr), IPSIZE);
+    peer->srcip[IPSIZE] = '\0';
+
+    peer->denied = OS_IPNotAllowed(peer->srcip);
+
+    return(peer);
+}
+
 
+/* HandleSyslogMSG: Sends a datagram to analysisd.
+ */
+static void HandleSyslogMSG(char *buffer, int recv_b,
+                            struct sockaddr_in *peer_info)
+{
     char *buffer_pt = NULL;
+    syslog_peer *peer;
 
-    int recv_b;
 
-    struct sockaddr_in peer_info;
-    socklen_t peer_size;
+    /* null terminating the message */
+    buffer[recv_b] = '\0';
+
+
+    /* Removing new line */
+    if(buffer[recv_b -1] == '\n')
+    {
+        buffer[recv_b -1] = '\0';
+    }
+
+
+    /* Removing syslog header */
+    if(buffer[0] == '<')
+    {
+        buffer_pt = strchr(buffer+1, '>');
+        if(buffer_pt)
+        {
+            buffer_pt++;
+        }
+        else
+        {
+            buffer_pt = buffer;
+        }
+    }
+    else
+    {
+        buffer_pt = buffer;
+    }
+
+    /* Checking if IP is allowed here */
+    peer = GetPeer(peer_info);
+    if(peer->denied)
+    {
+        merror(DENYIP_WARN,ARGV0,peer->srcip);
+    }
+
+    else if(SendMSG(logr.m_queue, buffer_pt, peer->srcip,
+                    SYSLOG_MQ) < 0)
+    {
+        merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
+        if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
+        {
+            ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
+        }
+    }
+}
 
 
-    /* setting peer size */
-    peer_size = sizeof(peer_info);
+/* FlushSyslogMSG: Sends the messages waiting (batched mode).
+ */
+static void FlushSyslogMSG()
+{
+    if(FlushMSG(logr.m_queue) < 0)
+    {
+        merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
+        if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
+        {
+            ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
+        }
+    }
+}
+
+
+/** void HandleSyslog() v0.3
+ * Handle syslog connections
+ */
+void HandleSyslog()
+{
+    int recv_n;
+    int rcvbuf = SYSLOG_RCVBUF;
+
+    #ifdef MSG_WAITFORONE
+    int i;
+    struct mmsghdr msgs[SYSLOG_BATCH];
+    struct iovec iovecs[SYSLOG_BATCH];
+    #else
+    socklen_t peer_size;
+    #endif
 
 
     /* Initializing some variables */
-    memset(buffer, '\0', OS_SIZE_1024 +2);
+    memset(peers, 0, sizeof(peers));
+    memset(buffers, '\0', sizeof(buffers));
+
+    #ifdef MSG_WAITFORONE
+    memset(msgs, 0, sizeof(msgs));
+    for(i = 0; i < SYSLOG_BATCH; i++)
+    {
+        iovecs[i].iov_base = buffers[i];
+        iovecs[i].iov_len = OS_SIZE_1024;
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &peers_info[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+    }
+    #endif
+
+
+    /* Compiling the allowed/denied ips */
+    allowtree = OS_IPTreeCreate(logr.allowips);
+    denytree = OS_IPTreeCreate(logr.denyips);
 
 
     /* Connecting to the message queue
@@ -77,66 +228,95 @@ void HandleSyslog()
     }
 
 
-    /* Infinite loop in here */
-    while(1)
-    {
-        /* Receiving message  */
-        recv_b = recvfrom(logr.sock, buffer, OS_SIZE_1024, 0,
-                (struct sockaddr *)&peer_info, &peer_size);
-
-        /* Nothing received */
-        if(recv_b <= 0)
-            continue;
+    /* Batched messages to analysisd (when busy) */
+    mq_batch = getDefine_Int("remoted", "mq_batch_wait", 0, 1000);
+    SetMQBatch(mq_batch);
 
 
-        /* null terminating the message */
-        buffer[recv_b] = '\0';
+    /* Bigger socket buffer for bursts */
+    if(setsockopt(logr.sock, SOL_SOCKET, SO_RCVBUF,
+                  &rcvbuf, sizeof(rcvbuf)) < 0)
+    {
+        merror("%s: Unable to set syslog receive buffer. errno: %d",
+               ARGV0, errno);
+    }
 
 
-        /* Removing new line */
-        if(buffer[recv_b -1] == '\n')
+    /* Infinite loop in here */
+    while(1)
+    {
+        /* Receiving messages. recvmmsg blocks for the first
+         * one and returns the ones waiting with it.
+         * On batched mode, the messages waiting are sent
+         * before blocking for the next ones.
+         */
+        #ifdef MSG_WAITFORONE
+        for(i = 0; i < SYSLOG_BATCH; i++)
         {
-            buffer[recv_b -1] = '\0';
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
         }
 
-        /* Setting the source ip */
-        strncpy(srcip, inet_ntoa(peer_info.sin_addr), IPSIZE);
-        srcip[IPSIZE] = '\0';
+        recv_n = recvmmsg(logr.sock, msgs, SYSLOG_BATCH,
+                          mq_batch?MSG_DONTWAIT:MSG_WAITFORONE, NULL);
 
+        if(mq_batch && (recv_n < 0) &&
+           ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            FlushSyslogMSG();
+
+            recv_n = recvmmsg(logr.sock, msgs, SYSLOG_BATCH, MSG_WAITFORONE,
+                              NULL);
+        }
 
-        /* Removing syslog header */
-        if(buffer[0] == '<')
+        /* Nothing received */
+        if(recv_n <= 0)
         {
-            buffer_pt = strchr(buffer+1, '>');
-            if(buffer_pt)
-            {
-                buffer_pt++;
-            }
-            else
+            if(mq_batch)
             {
-                buffer_pt = buffer;
+                FlushSyslogMSG();
             }
+            continue;
         }
-        else
+
+        for(i = 0; i < recv_n; i++)
         {
-            buffer_pt = buffer;
+            if(msgs[i].msg_len == 0)
+                continue;
+
+            HandleSyslogMSG(buffers[i], msgs[i].msg_len, &peers_info[i]);
         }
 
-        /* Checking if IP is allowed here */
-        if(OS_IPNotAllowed(srcip))
+        #else
+        /* On batched mode, the messages waiting are sent
+         * before blocking for the next one.
+         */
+        peer_size = sizeof(struct sockaddr_in);
+        recv_n = recvfrom(logr.sock, buffers[0], OS_SIZE_1024,
+                          mq_batch?MSG_DONTWAIT:0,
+                          (struct sockaddr *)&peers_info[0], &peer_size);
+
+        if(mq_batch && (recv_n < 0) &&
+           ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
         {
-            merror(DENYIP_WARN,ARGV0,srcip);
+            FlushSyslogMSG();
+
+            peer_size = sizeof(struct sockaddr_in);
+            recv_n = recvfrom(logr.sock, buffers[0], OS_SIZE_1024, 0,
+                              (struct sockaddr *)&peers_info[0], &peer_size);
         }
 
-        else if(SendMSG(logr.m_queue, buffer_pt, srcip,
-                        SYSLOG_MQ) < 0)
+        /* Nothing received */
+        if(recv_n <= 0)
         {
-            merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
-            if((logr.m_queue = StartMQ(DEFAULTQUEUE,READ)) < 0)
+            if(mq_batch)
             {
-                ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
+                FlushSyslogMSG();
             }
+            continue;
         }
+
+        HandleSyslogMSG(buffers[0], recv_n, &peers_info[0]);
+        #endif
     }
 }
 
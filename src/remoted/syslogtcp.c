@@ -11,6 +11,21 @@
  */
 
 
+/* All the TCP clients are handled by a single process. The
+ * sockets are watched with epoll (poll on other systems) and
+ * each client only keeps the incomplete frame between reads.
+ * Frames are split by new lines or, if they start with the
+ * length, by octet counting (RFC 6587).
+ */
+
+#ifdef __linux__
+#define SYSLOGTCP_EPOLL
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include <sys/resource.h>
 
 #include "shared.h"
 #include "os_net/os_net.h"
@@ -18,22 +33,67 @@
 #include "remoted.h"
 
 
+#define SYSLOGTCP_EVENTS    256
+
+
+/* Each TCP client (indexed by socket) */
+typedef struct _syslogtcp_client
+{
+    int sock;
+    char srcip[IPSIZE +1];
+
+    /* Incomplete frame from the last read */
+    char *pending;
+    int pending_size;
+
+    /* Dropping an oversized frame */
+    int skip;
+    int overflow;
+
+    #ifndef SYSLOGTCP_EPOLL
+    int pos;
+    #endif
+}syslogtcp_client;
+
+static syslogtcp_client **_clients = NULL;
+static int _clients_size = 0;
+
+/* Pending frame plus what is read at once */
+static char _tcp_buffer[(2 * OS_MAXSTR) +2];
+
+static int mq_batch = 0;
+
+#ifdef SYSLOGTCP_EPOLL
+static int _epoll_fd = -1;
+#else
+static struct pollfd *_pfds = NULL;
+static int _pfds_size = 0;
+static int _pfds_used = 0;
+#endif
+
+
+
+/* Allowed/denied ips, compiled at startup */
+static os_iptree *allowtree = NULL;
+static os_iptree *denytree = NULL;
+
+
 
 /* OS_IPNotAllowed, v0.1, 2005/02/11
  * Checks if an IP is not allowed.
  */
 static int OS_IPNotAllowed(char *srcip)
 {
-    if(logr.denyips != NULL)
+    if(denytree != NULL)
     {
-        if(OS_IPFoundList(srcip, logr.denyips))
+        if(OS_IPFoundTree(srcip, denytree))
         {
             return(1);
         }
     }
-    if(logr.allowips != NULL)
+    if(allowtree != NULL)
     {
-        if(OS_IPFoundList(srcip, logr.allowips))
+        if(OS_IPFoundTree(srcip, allowtree))
         {
             return(0);
         }
@@ -44,140 +104,458 @@ static int OS_IPNotAllowed(char *srcip)
 }
 
 
-/** void HandleClient() v0,1
- * Handle each client
+/* EventAdd: Starts watching sock for reading.
+ * Returns -1 on error.
  */
-static void HandleClient(int client_socket, char *srcip)
+static int EventAdd(int sock)
 {
-    int sb_size = OS_MAXSTR;
-    int r_sz = 0;
+    #ifdef SYSLOGTCP_EPOLL
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sock;
+
+    return(epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, sock, &ev));
+
+    #else
+    if(_pfds_used == _pfds_size)
+    {
+        _pfds_size = _pfds_size ? _pfds_size * 2 : SYSLOGTCP_EVENTS;
+        _pfds = realloc(_pfds, _pfds_size * sizeof(struct pollfd));
+        if(!_pfds)
+        {
+            ErrorExit(MEM_ERROR, ARGV0);
+        }
+    }
 
-    char buffer[OS_MAXSTR +2];
-    char storage_buffer[OS_MAXSTR +2];
-    char tmp_buffer[OS_MAXSTR +2];
+    _pfds[_pfds_used].fd = sock;
+    _pfds[_pfds_used].events = POLLIN;
+    _pfds[_pfds_used].revents = 0;
 
-    char *buffer_pt = NULL;
+    if(sock < _clients_size && _clients[sock])
+    {
+        _clients[sock]->pos = _pfds_used;
+    }
+    _pfds_used++;
 
+    return(0);
+    #endif
+}
 
-    /* Initializing some variables */
-    memset(buffer, '\0', OS_MAXSTR +2);
-    memset(storage_buffer, '\0', OS_MAXSTR +2);
-    memset(tmp_buffer, '\0', OS_MAXSTR +2);
 
+/* EventDel: Stops watching a client socket.
+ */
+static void EventDel(syslogtcp_client *client)
+{
+    #ifdef SYSLOGTCP_EPOLL
+    /* Closing the socket is enough */
+    return;
 
-    while(1)
+    #else
+    int last = _pfds_used -1;
+
+    if(client->pos != last)
     {
-        /* If we fail, we need to return and close the socket */
-        if((r_sz = OS_RecvTCPBuffer(client_socket, buffer, OS_MAXSTR -2)) < 0)
+        _pfds[client->pos] = _pfds[last];
+        if(_clients[_pfds[last].fd])
         {
-            close(client_socket);
-            return;
+            _clients[_pfds[last].fd]->pos = client->pos;
         }
+    }
+    _pfds_used--;
+    #endif
+}
 
-        /* We must have a new line at the end */
-        buffer_pt = strchr(buffer, '\n');
-        if(!buffer_pt)
+
+/* EventWait: Waits for sockets ready to be read.
+ * The sockets are stored at ready (up to max).
+ */
+static int EventWait(int *ready, int max, int timeout)
+{
+    int i, n;
+
+    #ifdef SYSLOGTCP_EPOLL
+    struct epoll_event events[SYSLOGTCP_EVENTS];
+
+    if(max > SYSLOGTCP_EVENTS)
+    {
+        max = SYSLOGTCP_EVENTS;
+    }
+
+    n = epoll_wait(_epoll_fd, events, max, timeout);
+    for(i = 0; i < n; i++)
+    {
+        ready[i] = events[i].data.fd;
+    }
+
+    #else
+    int total;
+
+    total = poll(_pfds, _pfds_used, timeout);
+    if(total <= 0)
+    {
+        return(total);
+    }
+
+    n = 0;
+    for(i = 0; i < _pfds_used && n < max; i++)
+    {
+        if(_pfds[i].revents)
         {
-            /* Buffer is full */
-            if((sb_size - r_sz) <= 2)
-            {
-                merror("%s: Full buffer receiving from: '%s'", ARGV0, srcip);
-                sb_size = OS_MAXSTR;
-                storage_buffer[0] = '\0';
-                continue;
-            }
+            ready[n++] = _pfds[i].fd;
+        }
+    }
+    #endif
 
-            strncat(storage_buffer, buffer, sb_size);
-            sb_size -= r_sz;
-            continue;
+    return(n);
+}
+
+
+/* CloseClient: Closes the connection and frees the client.
+ */
+static void CloseClient(syslogtcp_client *client)
+{
+    EventDel(client);
+
+    _clients[client->sock] = NULL;
+    close(client->sock);
+
+    if(client->pending)
+    {
+        free(client->pending);
+    }
+    free(client);
+}
+
+
+/* AddClient: Starts handling a new connection.
+ */
+static void AddClient(int sock, char *srcip)
+{
+    int flags;
+    syslogtcp_client *client;
+
+    /* Growing the client table (indexed by socket) */
+    if(sock >= _clients_size)
+    {
+        int new_size = _clients_size ? _clients_size : SYSLOGTCP_EVENTS;
+
+        while(new_size <= sock)
+        {
+            new_size *= 2;
         }
 
-        /* Seeing if we received more then just one message */
-        if(*(buffer_pt +1) != '\0')
+        _clients = realloc(_clients, new_size * sizeof(syslogtcp_client *));
+        if(!_clients)
+        {
+            ErrorExit(MEM_ERROR, ARGV0);
+        }
+
+        memset(_clients + _clients_size, 0,
+               (new_size - _clients_size) * sizeof(syslogtcp_client *));
+        _clients_size = new_size;
+    }
+
+    os_calloc(1, sizeof(syslogtcp_client), client);
+    client->sock = sock;
+    strncpy(client->srcip, srcip, IPSIZE);
+    _clients[sock] = client;
+
+
+    /* We never block on a client */
+    flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    if(EventAdd(sock) < 0)
+    {
+        merror("%s: Unable to watch connection from '%s'. errno: %d",
+               ARGV0, srcip, errno);
+        _clients[sock] = NULL;
+        close(sock);
+        free(client);
+    }
+}
+
+
+/* SendSyslogTCP: Sends a frame to analysisd.
+ */
+static void SendSyslogTCP(syslogtcp_client *client, char *frame, int size)
+{
+    char msg[OS_MAXSTR +1];
+    char *buffer_pt;
+
+    memcpy(msg, frame, size);
+    msg[size] = '\0';
+
+
+    /* Removing carriage returns too */
+    buffer_pt = strchr(msg, '\r');
+    if(buffer_pt)
+        *buffer_pt = '\0';
+
+
+    /* Removing syslog header */
+    buffer_pt = msg;
+    if(msg[0] == '<')
+    {
+        buffer_pt = strchr(msg+1, '>');
+        if(buffer_pt)
         {
-            *buffer_pt = '\0';
             buffer_pt++;
-            strncpy(tmp_buffer, buffer_pt, OS_MAXSTR);
         }
+        else
+        {
+            buffer_pt = msg;
+        }
+    }
+
+    if(*buffer_pt == '\0')
+    {
+        return;
+    }
+
 
-        /* Storing everything on the storage_buffer */
-        /* Checking if buffer will be  full */
-        if((sb_size - r_sz) <= 2)
+    /* Sending to the queue */
+    if(SendMSG(logr.m_queue, buffer_pt, client->srcip, SYSLOG_MQ) < 0)
+    {
+        merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
+        if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
         {
-            merror("%s: Full buffer receiving from: '%s'.", ARGV0, srcip);
-            sb_size = OS_MAXSTR;
-            storage_buffer[0] = '\0';
-            tmp_buffer[0] = '\0';
-            continue;
+            ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
         }
+    }
+}
 
-        strncat(storage_buffer, buffer, sb_size);
 
+/* OctetCount: Checks for an octet counted frame (RFC 6587),
+ * "MSG-LEN SP SYSLOG-MSG". The message must start with the
+ * priority, so plain lines starting with a number still work.
+ * Returns the header size (setting msg_size), 0 if it is not
+ * octet counted or -1 if more data is needed to know.
+ */
+static int OctetCount(char *frame, int size, int *msg_size)
+{
+    int i = 0;
+    int len = 0;
 
-        /* Removing carriage returns too */
-        buffer_pt = strchr(storage_buffer, '\r');
-        if(buffer_pt)
-            *buffer_pt = '\0';
+    if(frame[0] < '1' || frame[0] > '9')
+    {
+        return(0);
+    }
+
+    while(i < size && i < 9 && isdigit((int)frame[i]))
+    {
+        len = (len * 10) + (frame[i] - '0');
+        i++;
+    }
+
+    /* We need the length, the space and the '<' */
+    if(i + 1 >= size)
+    {
+        return((i < 9)?-1:0);
+    }
 
+    if(frame[i] != ' ' || frame[i + 1] != '<')
+    {
+        return(0);
+    }
+
+    *msg_size = len;
+    return(i + 1);
+}
+
+
+/* ReadClient: Reads from a client and sends each full frame.
+ * The incomplete one is kept for the next read.
+ */
+static void ReadClient(syslogtcp_client *client)
+{
+    int r_sz;
+    int len;
+    int pos = 0;
+    char *buffer = _tcp_buffer;
 
-        /* Removing syslog header */
-        if(storage_buffer[0] == '<')
+    len = client->pending_size;
+    if(len)
+    {
+        memcpy(buffer, client->pending, len);
+    }
+
+    r_sz = recv(client->sock, buffer + len, sizeof(_tcp_buffer) - len, 0);
+    if(r_sz <= 0)
+    {
+        if(r_sz < 0 && (errno == EAGAIN || errno == EINTR ||
+                        errno == EWOULDBLOCK))
         {
-            buffer_pt = strchr(storage_buffer+1, '>');
-            if(buffer_pt)
-            {
-                buffer_pt++;
-            }
-            else
+            return;
+        }
+
+        CloseClient(client);
+        return;
+    }
+    len += r_sz;
+
+
+    while(pos < len)
+    {
+        char *frame = buffer + pos;
+        char *buffer_pt;
+        int avail = len - pos;
+        int header;
+        int msg_size = 0;
+
+        /* Dropping the rest of an oversized message */
+        if(client->skip)
+        {
+            int n = (client->skip < avail)?client->skip:avail;
+
+            client->skip -= n;
+            pos += n;
+            continue;
+        }
+
+        if(client->overflow)
+        {
+            buffer_pt = memchr(frame, '\n', avail);
+            if(!buffer_pt)
             {
-                buffer_pt = storage_buffer;
+                pos = len;
+                break;
             }
+
+            client->overflow = 0;
+            pos += (buffer_pt - frame) + 1;
+            continue;
         }
-        else
+
+
+        /* Octet counting */
+        header = OctetCount(frame, avail, &msg_size);
+        if(header < 0)
+        {
+            break;
+        }
+        else if(header > 0)
         {
-            buffer_pt = storage_buffer;
+            if(msg_size >= OS_MAXSTR)
+            {
+                merror("%s: Full buffer receiving from: '%s'",
+                       ARGV0, client->srcip);
+                client->skip = msg_size;
+                pos += header;
+                continue;
+            }
+
+            if(avail < header + msg_size)
+            {
+                break;
+            }
+
+            SendSyslogTCP(client, frame + header, msg_size);
+            pos += header + msg_size;
+            continue;
         }
 
 
-        /* Sending to the queue */
-        if(SendMSG(logr.m_queue, buffer_pt, srcip,SYSLOG_MQ) < 0)
+        /* We must have a new line at the end */
+        buffer_pt = memchr(frame, '\n', avail);
+        if(!buffer_pt)
         {
-            merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
-            if((logr.m_queue = StartMQ(DEFAULTQUEUE,READ)) < 0)
+            if(avail >= OS_MAXSTR)
             {
-                ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
+                merror("%s: Full buffer receiving from: '%s'",
+                       ARGV0, client->srcip);
+                client->overflow = 1;
+                pos = len;
             }
+            break;
         }
 
-        /* Cleaning up the buffers */
-        if(tmp_buffer[0] != '\0')
+        if(buffer_pt - frame >= OS_MAXSTR)
         {
-            strncpy(storage_buffer, tmp_buffer, OS_MAXSTR);
-            sb_size = OS_MAXSTR - (strlen(storage_buffer) +1);
-            tmp_buffer[0] = '\0';
+            merror("%s: Full buffer receiving from: '%s'",
+                   ARGV0, client->srcip);
         }
         else
         {
-            storage_buffer[0] = '\0';
-            sb_size = OS_MAXSTR;
+            SendSyslogTCP(client, frame, buffer_pt - frame);
         }
+        pos += (buffer_pt - frame) + 1;
+    }
+
+
+    /* Keeping the incomplete frame */
+    client->pending_size = len - pos;
+    if(client->pending_size)
+    {
+        client->pending = realloc(client->pending, client->pending_size);
+        if(!client->pending)
+        {
+            ErrorExit(MEM_ERROR, ARGV0);
+        }
+        memcpy(client->pending, buffer + pos, client->pending_size);
+    }
+    else if(client->pending)
+    {
+        free(client->pending);
+        client->pending = NULL;
     }
 }
 
 
-/** void HandleSyslogTCP() v0.2
+/* AcceptClients: Accepts all the waiting connections.
+ */
+static void AcceptClients()
+{
+    int client_socket;
+    char srcip[IPSIZE +1];
+
+    memset(srcip, '\0', IPSIZE + 1);
+
+    while(1)
+    {
+        client_socket = OS_AcceptTCP(logr.sock, srcip, IPSIZE);
+        if(client_socket < 0)
+        {
+            /* Out of descriptors. Waiting for some to be closed. */
+            if(errno == EMFILE || errno == ENFILE)
+            {
+                merror("%s: Unable to accept TCP connection. errno: %d",
+                       ARGV0, errno);
+                sleep(1);
+            }
+            return;
+        }
+
+        /* Checking if IP is allowed here */
+        if(OS_IPNotAllowed(srcip))
+        {
+            merror(DENYIP_WARN,ARGV0,srcip);
+            close(client_socket);
+            continue;
+        }
+
+        AddClient(client_socket, srcip);
+    }
+}
+
+
+/** void HandleSyslogTCP() v0.3
  * Handle syslog tcp connections
  */
 void HandleSyslogTCP()
 {
-    int client_socket = 0;
-    int st_errors = 0;
-    int childcount = 0;
+    int i;
+    int n;
+    int flags;
+    int ready[SYSLOGTCP_EVENTS];
+    struct rlimit rl;
 
-    char srcip[IPSIZE +1];
 
-    /* Initializing some variables */
-    memset(srcip, '\0', IPSIZE + 1);
+    /* Compiling the allowed/denied ips */
+    allowtree = OS_IPTreeCreate(logr.allowips);
+    denytree = OS_IPTreeCreate(logr.denyips);
 
 
     /* Connecting to the message queue
@@ -189,57 +567,86 @@ void HandleSyslogTCP()
     }
 
 
+    /* Batched messages to analysisd (when busy) */
+    mq_batch = getDefine_Int("remoted", "mq_batch_wait", 0, 1000);
+    SetMQBatch(mq_batch);
+
+
+    /* Each client takes a descriptor. Using all we can. */
+    if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+
+    #ifdef SYSLOGTCP_EPOLL
+    _epoll_fd = epoll_create(SYSLOGTCP_EVENTS);
+    if(_epoll_fd < 0)
+    {
+        ErrorExit("%s: Unable to create epoll descriptor. errno: %d",
+                  ARGV0, errno);
+    }
+    #endif
+
+    flags = fcntl(logr.sock, F_GETFL, 0);
+    fcntl(logr.sock, F_SETFL, flags | O_NONBLOCK);
+
+    if(EventAdd(logr.sock) < 0)
+    {
+        ErrorExit("%s: Unable to watch syslog socket. errno: %d",
+                  ARGV0, errno);
+    }
+
+
     /* Infinit loop in here */
     while(1)
     {
-        /* Waiting for the childs .. */
-        while (childcount)
+        /* On batched mode, the messages waiting are sent
+         * before blocking for the next ones.
+         */
+        n = 0;
+        if(mq_batch)
         {
-            int wp;
-            wp = waitpid((pid_t) -1, NULL, WNOHANG);
-            if (wp < 0)
-                merror(WAITPID_ERROR, ARGV0);
-
-            /* if = 0, we still need to wait for the child process */
-            else if (wp == 0)
-                break;
-            else
-                childcount--;
+            n = EventWait(ready, SYSLOGTCP_EVENTS, 0);
+            if(n == 0 && FlushMSG(logr.m_queue) < 0)
+            {
+                merror(QUEUE_ERROR,ARGV0,DEFAULTQUEUE, strerror(errno));
+                if((logr.m_queue = StartMQ(DEFAULTQUEUE,WRITE)) < 0)
+                {
+                    ErrorExit(QUEUE_FATAL,ARGV0,DEFAULTQUEUE);
+                }
+            }
         }
 
-
-        /* Accepting new connections */
-        client_socket = OS_AcceptTCP(logr.sock, srcip, IPSIZE);
-        if(client_socket < 0)
+        if(n == 0)
         {
-            st_errors++;
+            n = EventWait(ready, SYSLOGTCP_EVENTS, -1);
         }
 
-        /* Checking if IP is allowed here */
-        if(OS_IPNotAllowed(srcip))
+        if(n < 0)
         {
-            merror(DENYIP_WARN,ARGV0,srcip);
-            close(client_socket);
+            if(errno != EINTR)
+            {
+                merror("%s: Error waiting for TCP connections. errno: %d",
+                       ARGV0, errno);
+                sleep(1);
+            }
+            continue;
         }
 
 
-        /* Forking to deal with new client */
-        if(fork() == 0)
-        {
-            HandleClient(client_socket, srcip);
-            exit(0);
-        }
-        else
+        for(i = 0; i < n; i++)
         {
-            childcount++;
-
-            /* Closing client socket, since the child is handling it */
-            close(client_socket);
-            continue;
+            if(ready[i] == logr.sock)
+            {
+                AcceptClients();
+            }
+            else if(ready[i] < _clients_size && _clients[ready[i]])
+            {
+                ReadClient(_clients[ready[i]]);
+            }
         }
-
-        /* The parent process should not reach here */
-        return;
     }
 }
 
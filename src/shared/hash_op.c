@@ -21,13 +21,230 @@
 
 
 
+/* Open addressing (linear probing) on a power of 2 table.
+ * Deleted entries are marked and only removed on the next resize.
+ * The resize is incremental: the old table is moved a few slots
+ * at a time on each OSHash_Add. The slots moved are marked as deleted
+ * on the old table, so only the ones from old_pos on are still set.
+ */
+#define OSHASH_ROWS     1024
+#define OSHASH_STEP     16
+
+static char _os_hash_deleted;
+
+#define OSHASH_IS_DELETED(n) ((n)->key == (void *)&_os_hash_deleted)
+#define OSHASH_IS_SET(n) ((n)->key && !OSHASH_IS_DELETED(n))
+
+#define ROTL32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+
+
+/** unsigned int _os_genhash(OSHash *self, char *key, unsigned int size)
+ * Generates hash for key (4 bytes at a time, murmur3 style).
+ */
+static unsigned int _os_genhash(OSHash *self, char *key, unsigned int size)
+{
+    unsigned int hash_key = self->initial_seed;
+    unsigned int word;
+    unsigned int i = size;
+
+    while(i >= 4)
+    {
+        memcpy(&word, key, 4);
+
+        word *= 0xcc9e2d51;
+        word = ROTL32(word, 15);
+        word *= 0x1b873593;
+
+        hash_key ^= word;
+        hash_key = ROTL32(hash_key, 13);
+        hash_key = (hash_key * 5) + 0xe6546b64;
+
+        key += 4;
+        i -= 4;
+    }
+
+    /* Last bytes */
+    word = 0;
+    switch(i)
+    {
+        case 3: word ^= (unsigned char)key[2] << 16;
+        case 2: word ^= (unsigned char)key[1] << 8;
+        case 1: word ^= (unsigned char)key[0];
+                word *= 0xcc9e2d51;
+                word = ROTL32(word, 15);
+                word *= 0x1b873593;
+                hash_key ^= word;
+    }
+
+    /* Final mix */
+    hash_key ^= size;
+    hash_key ^= hash_key >> 16;
+    hash_key *= 0x85ebca6b;
+    hash_key ^= hash_key >> 13;
+    hash_key *= 0xc2b2ae35;
+    hash_key ^= hash_key >> 16;
+
+    return(hash_key);
+}
+
+
+
+/** OSHashNode *_os_hash_find(OSHashNode *table, unsigned int rows,
+ *                            char *key, unsigned int hash_key,
+ *                            unsigned int size)
+ * Returns the node of the key on the table (NULL if not there).
+ */
+static OSHashNode *_os_hash_find(OSHashNode *table, unsigned int rows,
+                                 char *key, unsigned int hash_key,
+                                 unsigned int size)
+{
+    unsigned int index = hash_key & (rows -1);
+
+    /* The table always has empty slots */
+    while(table[index].key)
+    {
+        if((table[index].hash == hash_key) &&
+           (table[index].key_size == size) &&
+           !OSHASH_IS_DELETED(&table[index]) &&
+           (memcmp(table[index].key, key, size) == 0))
+        {
+            return(&table[index]);
+        }
+
+        index = (index +1) & (rows -1);
+    }
+
+    return(NULL);
+}
+
+
+
+/** OSHashNode *_os_hash_lookup(OSHash *self, char *key,
+ *                              unsigned int hash_key, unsigned int size)
+ * Looks for the key on the table and on the old one (if resizing).
+ */
+static OSHashNode *_os_hash_lookup(OSHash *self, char *key,
+                                   unsigned int hash_key, unsigned int size)
+{
+    OSHashNode *curr_node;
+
+    curr_node = _os_hash_find(self->table, self->rows, key, hash_key, size);
+    if(!curr_node && self->old_table)
+    {
+        curr_node = _os_hash_find(self->old_table, self->old_rows,
+                                  key, hash_key, size);
+    }
+
+    return(curr_node);
+}
+
+
+
+/** OSHashNode *_os_hash_insert(OSHash *self, unsigned int hash_key)
+ * Gets a free slot for the hash on the table.
+ */
+static OSHashNode *_os_hash_insert(OSHash *self, unsigned int hash_key)
+{
+    unsigned int index = hash_key & (self->rows -1);
+
+    while(OSHASH_IS_SET(&self->table[index]))
+    {
+        index = (index +1) & (self->rows -1);
+    }
+
+    if(!self->table[index].key)
+    {
+        self->used++;
+    }
+
+    return(&self->table[index]);
+}
+
+
+
+/** void _os_hash_move(OSHash *self, unsigned int count)
+ * Moves count slots of the old table to the new one.
+ */
+static void _os_hash_move(OSHash *self, unsigned int count)
+{
+    OSHashNode *old_node;
+    OSHashNode *new_node;
+
+    if(!self->old_table)
+    {
+        return;
+    }
+
+    while(count && (self->old_pos < self->old_rows))
+    {
+        old_node = &self->old_table[self->old_pos];
+        if(OSHASH_IS_SET(old_node))
+        {
+            new_node = _os_hash_insert(self, old_node->hash);
+            *new_node = *old_node;
+
+            /* The key belongs to the new table now (the slot is
+             * kept marked, not to break the probing on the old one).
+             */
+            old_node->key = (void *)&_os_hash_deleted;
+            old_node->data = NULL;
+        }
+
+        self->old_pos++;
+        count--;
+    }
+
+    /* Everything moved */
+    if(self->old_pos == self->old_rows)
+    {
+        free(self->old_table);
+        self->old_table = NULL;
+        self->old_rows = 0;
+        self->old_pos = 0;
+    }
+
+    return;
+}
+
+
+
+/** int _os_hash_resize(OSHash *self, unsigned int rows)
+ * Starts moving the entries to a new table with rows slots.
+ * Returns 0 on error (out of memory).
+ */
+static int _os_hash_resize(OSHash *self, unsigned int rows)
+{
+    OSHashNode *table;
+
+    /* Only one resize at a time */
+    _os_hash_move(self, self->old_rows);
+
+    table = (OSHashNode *)calloc(rows, sizeof(OSHashNode));
+    if(!table)
+    {
+        return(0);
+    }
+
+    self->old_table = self->table;
+    self->old_rows = self->rows;
+    self->old_pos = 0;
+
+    self->table = table;
+    self->rows = rows;
+    self->used = 0;
+
+    return(1);
+}
+
+
+
 /** OSHash *OSHash_Create()
  * Creates the Hash.
  * Returns NULL on error.
  */
 OSHash *OSHash_Create()
 {
-    int i = 0;
     OSHash *self;
 
     /* Allocating memory for the hash */
@@ -39,16 +256,11 @@ OSHash *OSHash_Create()
 
 
     /* Setting default row size */
-    self->rows = os_getprime(1024);
-    if(self->rows == 0)
-    {
-        free(self);
-        return(NULL);
-    }
+    self->rows = OSHASH_ROWS;
 
 
     /* Creating hashing table */
-    self->table = (OSHashNode **)calloc(self->rows +1, sizeof(OSHashNode *));
+    self->table = (OSHashNode *)calloc(self->rows, sizeof(OSHashNode));
     if(!self->table)
     {
         free(self);
@@ -56,17 +268,9 @@ OSHash *OSHash_Create()
     }
 
 
-    /* Zeroing our tables */
-    for(i = 0; i <= self->rows; i++)
-    {
-        self->table[i] = NULL;
-    }
-
-
     /* Getting seed */
     srandom(time(0));
-    self->initial_seed = os_getprime(random() % self->rows);
-    self->constant = os_getprime(random() % self->rows);
+    self->initial_seed = random();
 
 
     return(self);
@@ -79,29 +283,31 @@ OSHash *OSHash_Create()
  */
 void *OSHash_Free(OSHash *self)
 {
-    int i = 0;
-    OSHashNode *curr_node;
-    OSHashNode *next_node;
+    unsigned int i = 0;
 
 
     /* Freeing each entry */
-    while(i <= self->rows)
+    for(i = 0; i < self->rows; i++)
+    {
+        if(OSHASH_IS_SET(&self->table[i]))
+        {
+            free(self->table[i].key);
+        }
+    }
+
+    /* Only the slots not moved yet */
+    for(i = self->old_pos; i < self->old_rows; i++)
     {
-        curr_node = self->table[i];
-        next_node = curr_node;
-        while(next_node)
+        if(OSHASH_IS_SET(&self->old_table[i]))
         {
-            next_node = next_node->next;
-            free(curr_node->key);
-            free(curr_node);
-            curr_node = next_node;
+            free(self->old_table[i].key);
         }
-        i++;
     }
 
 
     /* Freeing the hash table */
     free(self->table);
+    free(self->old_table);
 
     free(self);
     return(NULL);
@@ -109,69 +315,32 @@ void *OSHash_Free(OSHash *self)
 
 
 
-/** int _os_genhash(OSHash *self, char *key)
- * Generates hash for key
- */
-int _os_genhash(OSHash *self, char *key)
-{
-    unsigned int hash_key = self->initial_seed;
-
-    /* What we have here is a simple polynomial hash.
-     * x0 * a^k-1 .. xk * a^k-k +1
-     */
-    while(*key)
-    {
-        hash_key *= self->constant;
-        hash_key += *key;
-        key++;
-    }
-
-    return(hash_key);
-}
-
-
-
 /** int OSHash_setSize(OSHash *self, int size)
- * Sets new size for hash.
+ * Sets new size for hash (the number of entries expected).
  * Returns 0 on error (out of memory).
  */
 int OSHash_setSize(OSHash *self, int new_size)
 {
-    int i = 0;
+    unsigned int rows = self->rows;
 
-    /* We can't decrease the size */
-    if(new_size <= self->rows)
+    /* Keeping the table at most half full */
+    while(rows < ((unsigned int)new_size * 2))
     {
-        return(1);
+        rows *= 2;
     }
 
-
-    /* Getting next prime */
-    self->rows = os_getprime(new_size);
-    if(self->rows == 0)
+    /* We can't decrease the size */
+    if(rows == self->rows)
     {
-        return(0);
+        return(1);
     }
 
-
-    /* If we fail, the hash should not be used anymore */
-    self->table = realloc(self->table, (self->rows +1) * sizeof(OSHashNode *));
-    if(!self->table)
+    if(!_os_hash_resize(self, rows))
     {
         return(0);
     }
 
-
-    /* Zeroing our tables */
-    for(i = 0; i <= self->rows; i++)
-    {
-        self->table[i] = NULL;
-    }
-
-
-    /* New seed */
-    self->initial_seed = os_getprime(random() % self->rows);
-    self->constant = os_getprime(random() % self->rows);
+    _os_hash_move(self, self->old_rows);
 
     return(1);
 }
@@ -184,33 +353,19 @@ int OSHash_setSize(OSHash *self, int new_size)
  */
 int OSHash_Update(OSHash *self, char *key, void *data)
 {
-    unsigned int hash_key;
-    unsigned int index;
-
+    unsigned int size = strlen(key);
     OSHashNode *curr_node;
 
 
-    /* Generating hash of the message */
-    hash_key = _os_genhash(self, key);
-
-
-    /* Getting array index */
-    index = hash_key % self->rows;
-
-
-    /* Checking for duplicated entries in the index */
-    curr_node = self->table[index];
-    while(curr_node)
+    curr_node = _os_hash_lookup(self, key, _os_genhash(self, key, size),
+                                size);
+    if(!curr_node)
     {
-        /* Checking for duplicated key -- not adding */
-        if(strcmp(curr_node->key, key) == 0)
-        {
-            curr_node->data = data;
-            return(1);
-        }
-        curr_node = curr_node->next;
+        return(0);
     }
-    return(0);
+
+    curr_node->data = data;
+    return(1);
 }
 
 
@@ -223,62 +378,61 @@ int OSHash_Update(OSHash *self, char *key, void *data)
  */
 int OSHash_Add(OSHash *self, char *key, void *data)
 {
+    unsigned int size = strlen(key);
     unsigned int hash_key;
-    unsigned int index;
 
-    OSHashNode *curr_node;
     OSHashNode *new_node;
 
 
     /* Generating hash of the message */
-    hash_key = _os_genhash(self, key);
+    hash_key = _os_genhash(self, key, size);
 
 
-    /* Getting array index */
-    index = hash_key % self->rows;
+    /* Checking for duplicated key -- not adding */
+    if(_os_hash_lookup(self, key, hash_key, size))
+    {
+        return(1);
+    }
 
 
-    /* Checking for duplicated entries in the index */
-    curr_node = self->table[index];
-    while(curr_node)
+    /* Keeping the table at most half used. It only grows
+     * if there are many entries (otherwise it just gets
+     * rid of the deleted ones).
+     */
+    if(((self->used +1) * 2) > self->rows)
     {
-        /* Checking for duplicated key -- not adding */
-        if(strcmp(curr_node->key, key) == 0)
+        unsigned int rows = self->rows;
+
+        if(((self->elements +1) * 4) > self->rows)
         {
-            /* Not adding */
-            return(1);
+            rows *= 2;
+        }
+
+        if(!_os_hash_resize(self, rows) && (self->used +1 >= self->rows))
+        {
+            return(0);
         }
-        curr_node = curr_node->next;
     }
 
 
+    /* Moving a few entries from the old table */
+    _os_hash_move(self, OSHASH_STEP);
+
+
     /* Creating new node */
-    new_node = calloc(1, sizeof(OSHashNode));
-    if(!new_node)
-    {
-        return(0);
-    }
-    new_node->next = NULL;
-    new_node->data = data;
+    new_node = _os_hash_insert(self, hash_key);
+
     new_node->key = strdup(key);
     if( new_node->key == NULL ) {
-        free(new_node);
         debug1("hash_op: DEBUG: strdup() failed!");
+        new_node->key = (void *)&_os_hash_deleted;
         return(0);
     }
+    new_node->data = data;
+    new_node->hash = hash_key;
+    new_node->key_size = size;
 
-
-    /* Adding to table */
-    if(!self->table[index])
-    {
-        self->table[index] = new_node;
-    }
-    /* If there is duplicated, add to the beginning */
-    else
-    {
-        new_node->next = self->table[index];
-        self->table[index] = new_node;
-    }
+    self->elements++;
 
     return(2);
 }
@@ -292,74 +446,87 @@ int OSHash_Add(OSHash *self, char *key, void *data)
  */
 void *OSHash_Get(OSHash *self, char *key)
 {
-    unsigned int hash_key;
-    unsigned int index;
-
+    unsigned int size = strlen(key);
     OSHashNode *curr_node;
 
 
-    /* Generating hash of the message */
-    hash_key = _os_genhash(self, key);
+    curr_node = _os_hash_lookup(self, key, _os_genhash(self, key, size),
+                                size);
+    if(!curr_node)
+    {
+        return(NULL);
+    }
 
+    return(curr_node->data);
+}
 
-    /* Getting array index */
-    index = hash_key % self->rows;
+/* Returns a pointer to a hash node if found, that hash node is removed from the table */
+void* OSHash_Delete(OSHash *self, char *key)
+{
+    unsigned int size = strlen(key);
+    OSHashNode *curr_node;
+    void *data;
 
 
-    /* Getting entry */
-    curr_node = self->table[index];
-    while(curr_node != NULL)
+    curr_node = _os_hash_lookup(self, key, _os_genhash(self, key, size),
+                                size);
+    if(!curr_node)
     {
-        /* Skip null pointers */
-        if( curr_node->key == NULL )
-            continue;
+        return NULL;
+    }
+
+    /* The slot is kept until the next resize */
+    free(curr_node->key);
+    curr_node->key = (void *)&_os_hash_deleted;
+    data = curr_node->data;
+    curr_node->data = NULL;
+
+    self->elements--;
+
+    return data;
+}
+
 
-        /* We may have colisions, so double check with strcmp */
-        if(strcmp(curr_node->key, key) == 0)
+
+/** OSHashNode *OSHash_Begin(OSHash *self, unsigned int *i)
+ * Gets the first entry of the hash.
+ */
+OSHashNode *OSHash_Begin(OSHash *self, unsigned int *i)
+{
+    /* Finishing any resize (only one table to read) */
+    _os_hash_move(self, self->old_rows);
+
+    *i = 0;
+    while(*i < self->rows)
+    {
+        if(OSHASH_IS_SET(&self->table[*i]))
         {
-            return(curr_node->data);
+            return(&self->table[*i]);
         }
-
-        curr_node = curr_node->next;
+        (*i)++;
     }
 
     return(NULL);
 }
 
-/* Returns a pointer to a hash node if found, that hash node is removed from the table */
-void* OSHash_Delete(OSHash *self, char *key)
-{
-    OSHashNode *curr_node;
-    OSHashNode *prev_node = 0;
-    unsigned int hash_key;
-    unsigned int index;
-    void *data;
 
-    /* Generating hash of the message */
-    hash_key = _os_genhash(self, key);
-
-    /* Getting array index */
-    index = hash_key % self->rows;
-
-    curr_node = self->table[index];
-    while( curr_node != NULL ) {
-        if(strcmp(curr_node->key, key) == 0) {
-            if( prev_node == NULL ) {
-                self->table[index] = curr_node->next;
-            }
-            else {
-                prev_node->next = curr_node->next;
-            }
-            free(curr_node->key);
-            data = curr_node->data;
-            free(curr_node);
-            return data;
+
+/** OSHashNode *OSHash_Next(OSHash *self, unsigned int *i)
+ * Gets the entry after the one at *i.
+ */
+OSHashNode *OSHash_Next(OSHash *self, unsigned int *i)
+{
+    (*i)++;
+    while(*i < self->rows)
+    {
+        if(OSHASH_IS_SET(&self->table[*i]))
+        {
+            return(&self->table[*i]);
         }
-        prev_node = curr_node;
-        curr_node = curr_node->next;
+        (*i)++;
     }
 
-    return NULL;
+    return(NULL);
 }
 
 /* EOF */
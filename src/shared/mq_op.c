@@ -17,6 +17,136 @@
 
 #ifndef WIN32
 
+
+/* Batched mode. The messages are kept together (each one
+ * with its '\0') and sent in a single datagram.
+ */
+static char _mq_batch[OS_MAXSTR];
+static int _mq_batch_size = 0;
+static int _mq_batch_count = 0;
+static int _mq_batch_queue = -1;
+static int _mq_batch_wait = 0;
+static struct timeval _mq_batch_time;
+
+
+
+/* _SendMQ: Sends size bytes of msg to the queue (retrying
+ * if the receiver socket is busy).
+ */
+static int _SendMQ(int queue, char *msg, int size)
+{
+    int __mq_rcode;
+
+    /* We attempt 5 times to send the message if
+     * the receiver socket is busy.
+     * After the first error, we wait 1 second.
+     * After the second error, we wait more 3 seconds.
+     * After the third error, we wait 5 seconds.
+     * After the fourth error, we wait 10 seconds.
+     * If we failed again, the message is not going
+     * to be delivered and an error is sent back.
+     */
+    if((__mq_rcode = OS_SendUnix(queue, msg, size)) < 0)
+    {
+        /* Error on the socket */
+        if(__mq_rcode == OS_SOCKTERR)
+        {
+            merror("%s: socketerr (not available).", __local_name);
+            close(queue);
+            return(-1);
+        }
+
+
+        /* Unable to send. Socket busy */
+        sleep(1);
+        if(OS_SendUnix(queue, msg, size) < 0)
+        {
+            /* When the socket is to busy, we may get some
+             * error here. Just sleep 2 second and try
+             * again.
+             */
+            sleep(3);
+            /* merror("%s: socket busy", __local_name); */
+            if(OS_SendUnix(queue, msg, size) < 0)
+            {
+                sleep(5);
+                merror("%s: socket busy ..", __local_name);
+                if(OS_SendUnix(queue, msg, size) < 0)
+                {
+                    sleep(10);
+                    merror("%s: socket busy ..", __local_name);
+                    if(OS_SendUnix(queue, msg, size) < 0)
+                    {
+                        /* Message is going to be lost
+                         * if the application does not care
+                         * about checking the error
+                         */
+                        close(queue);
+                        return(-1);
+                    }
+                }
+            }
+        }
+    }
+
+    return(0);
+}
+
+
+
+/* SetMQBatch: Enables the batched mode for SendMSG.
+ * The messages are sent when the datagram is full, when
+ * the first one is older than max_wait milliseconds or
+ * when FlushMSG is called. The receiver must split the
+ * datagrams (analysisd does). 0 disables it.
+ * There is no timer: the age is checked on the next SendMSG,
+ * so the callers flush before blocking (remoted when its
+ * sockets are empty, logcollector when its queue is empty).
+ */
+void SetMQBatch(int max_wait)
+{
+    if(_mq_batch_size)
+    {
+        FlushMSG(_mq_batch_queue);
+    }
+
+    _mq_batch_wait = max_wait;
+    return;
+}
+
+
+
+/* FlushMSG: Sends the messages waiting on the batch.
+ * If the queue changed (reconnected after an error), they are
+ * sent to the new one.
+ * Returns -1 if they could not be delivered.
+ */
+int FlushMSG(int queue)
+{
+    int size = _mq_batch_size;
+    int count = _mq_batch_count;
+
+    if(!size)
+    {
+        return(0);
+    }
+
+    _mq_batch_size = 0;
+    _mq_batch_count = 0;
+    _mq_batch_queue = queue;
+
+    if(_SendMQ(queue, _mq_batch, size) < 0)
+    {
+        merror("%s: ERROR: Unable to send %d batched messages to the "
+               "queue. They were dropped.", __local_name, count);
+        return(-1);
+    }
+
+    return(0);
+}
+
+
+
 /* StartMQ v0.2, 2004/07/30
  * Start the Message Queue. type: WRITE||READ
  */
@@ -81,7 +211,6 @@ int StartMQ(char * path, short int type)
  */
 int SendMSG(int queue, char *message, char *locmsg, char loc)
 {
-    int __mq_rcode;
     char tmpstr[OS_MAXSTR+1];
 
     tmpstr[OS_MAXSTR] = '\0';
@@ -120,61 +249,54 @@ int SendMSG(int queue, char *message, char *locmsg, char loc)
         return(-1);
 
 
-    /* We attempt 5 times to send the message if
-     * the receiver socket is busy.
-     * After the first error, we wait 1 second.
-     * After the second error, we wait more 3 seconds.
-     * After the third error, we wait 5 seconds.
-     * After the fourth error, we wait 10 seconds.
-     * If we failed again, the message is not going
-     * to be delivered and an error is sent back.
-     */
-    if((__mq_rcode = OS_SendUnix(queue, tmpstr,0)) < 0)
+    /* Adding to the batch */
+    if(_mq_batch_wait)
     {
-        /* Error on the socket */
-        if(__mq_rcode == OS_SOCKTERR)
+        struct timeval now;
+        int size = strlen(tmpstr) +1;
+
+        /* No space left. A new queue (reconnected) gets the
+         * messages batched before too.
+         */
+        if(_mq_batch_size &&
+           ((queue != _mq_batch_queue) ||
+            (_mq_batch_size + size > OS_MAXSTR -1)))
         {
-            merror("%s: socketerr (not available).", __local_name);
-            close(queue);
-            queue = -1;
-            return(-1);
+            if(FlushMSG(queue) < 0)
+            {
+                return(-1);
+            }
         }
 
+        /* Larger messages go alone */
+        if(size > OS_MAXSTR -1)
+        {
+            return(_SendMQ(queue, tmpstr, 0));
+        }
 
-        /* Unable to send. Socket busy */
-        sleep(1);
-        if(OS_SendUnix(queue, tmpstr, 0) < 0)
+        gettimeofday(&now, NULL);
+        if(!_mq_batch_size)
         {
-            /* When the socket is to busy, we may get some
-             * error here. Just sleep 2 second and try
-             * again.
-             */
-            sleep(3);
-            /* merror("%s: socket busy", __local_name); */
-            if(OS_SendUnix(queue, tmpstr,0) < 0)
-            {
-                sleep(5);
-                merror("%s: socket busy ..", __local_name);
-                if(OS_SendUnix(queue, tmpstr,0) < 0)
-                {
-                    sleep(10);
-                    merror("%s: socket busy ..", __local_name);
-                    if(OS_SendUnix(queue, tmpstr,0) < 0)
-                    {
-                        /* Message is going to be lost
-                         * if the application does not care
-                         * about checking the error
-                         */
-                        close(queue);
-                        queue = -1;
-                        return(-1);
-                    }
-                }
-            }
+            _mq_batch_queue = queue;
+            _mq_batch_time = now;
+        }
+
+        memcpy(_mq_batch + _mq_batch_size, tmpstr, size);
+        _mq_batch_size += size;
+        _mq_batch_count++;
+
+        /* Waiting for too long */
+        if((((now.tv_sec - _mq_batch_time.tv_sec) * 1000) +
+            ((now.tv_usec - _mq_batch_time.tv_usec) / 1000)) >= _mq_batch_wait)
+        {
+            return(FlushMSG(queue));
         }
+
+        return(0);
     }
 
-    return(0);
+
+    return(_SendMQ(queue, tmpstr, 0));
 }
 
 #endif
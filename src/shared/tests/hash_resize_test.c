@@ -0,0 +1,131 @@
+/* Hash operations while the table is being resized (the old table
+ * is only moved a few slots at a time). Build it with
+ * -fsanitize=address to check the memory of the keys too.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hash_op.h"
+
+
+#define TEST_KEYS   530
+
+static int errors = 0;
+
+
+static void check(int ok, char *what, int i)
+{
+    if(!ok)
+    {
+        printf("FAILED: %s (key %d)\n", what, i);
+        errors++;
+    }
+}
+
+
+/* Adds the keys, leaving the hash in the middle of a resize */
+static OSHash *fill(char **data)
+{
+    int i;
+    char key[64];
+    OSHash *mhash;
+
+    mhash = OSHash_Create();
+    if(!mhash)
+    {
+        printf("FAILED: OSHash_Create\n");
+        exit(1);
+    }
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Add(mhash, key, data[i]) == 2, "add", i);
+    }
+
+    check(mhash->old_table != NULL && mhash->old_pos > 0,
+          "resize in progress", TEST_KEYS);
+
+    return(mhash);
+}
+
+
+int main(int argc, char **argv)
+{
+    int i;
+    char key[64];
+    char *data[TEST_KEYS];
+    OSHash *mhash;
+
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        data[i] = malloc(16);
+        snprintf(data[i], 15, "%d", i);
+    }
+
+
+    /* Get and Delete (of moved and not moved keys) */
+    mhash = fill(data);
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Get(mhash, key) == data[i], "get", i);
+    }
+
+    for(i = 0; i < TEST_KEYS; i += 2)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Delete(mhash, key) == data[i], "delete", i);
+    }
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Get(mhash, key) == ((i % 2)?data[i]:NULL),
+              "get after delete", i);
+    }
+    check(OSHash_Delete(mhash, "key-0") == NULL, "delete again", 0);
+
+
+    /* Adding the deleted keys again (not duplicated) */
+    for(i = 0; i < TEST_KEYS; i += 2)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Add(mhash, key, data[i]) == 2, "add again", i);
+    }
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        snprintf(key, 63, "key-%d", i);
+        check(OSHash_Add(mhash, key, data[i]) == 1, "duplicated", i);
+        check(OSHash_Get(mhash, key) == data[i], "get after add", i);
+    }
+
+    OSHash_Free(mhash);
+
+
+    /* Free in the middle of a resize */
+    mhash = fill(data);
+    OSHash_Free(mhash);
+
+
+    for(i = 0; i < TEST_KEYS; i++)
+    {
+        free(data[i]);
+    }
+
+    if(errors)
+    {
+        printf("%d errors\n", errors);
+        return(1);
+    }
+
+    printf("OK\n");
+    return(0);
+}
+
+
+/* EOF */
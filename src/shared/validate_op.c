@@ -315,6 +315,204 @@ int OS_IPFoundList(char *ip_address, os_ip **list_of_ips)
 }
 
 
+/* _iptree_child: Returns the child of node (creating it if needed).
+ */
+static int _iptree_child(os_iptree *tree, int node, int bit)
+{
+    if(tree->nodes[node].child[bit])
+    {
+        return(tree->nodes[node].child[bit]);
+    }
+
+    if(tree->used == tree->size)
+    {
+        tree->size *= 2;
+        tree->nodes = realloc(tree->nodes, tree->size * sizeof(os_iptree_node));
+        if(!tree->nodes)
+        {
+            ErrorExit(MEM_ERROR, __local_name);
+        }
+    }
+
+    tree->nodes[tree->used].child[0] = 0;
+    tree->nodes[tree->used].child[1] = 0;
+    tree->nodes[tree->used].index = -1;
+
+    tree->nodes[node].child[bit] = tree->used;
+    return(tree->used++);
+}
+
+
+/** os_iptree *OS_IPTreeCreate(os_ip **list_of_ips)
+ * Compiles the list of ips into a prefix tree. Each node keeps
+ * the position of the first entry of the list ending on it.
+ * Returns NULL if the list is NULL.
+ */
+os_iptree *OS_IPTreeCreate(os_ip **list_of_ips)
+{
+    int i;
+    int others = 0;
+    os_iptree *tree;
+
+    if(!list_of_ips)
+    {
+        return(NULL);
+    }
+
+    os_calloc(1, sizeof(os_iptree), tree);
+    tree->list = list_of_ips;
+    tree->first_negated = -1;
+
+    tree->size = 64;
+    tree->used = 1;
+    os_calloc(tree->size, sizeof(os_iptree_node), tree->nodes);
+    tree->nodes[0].index = -1;
+
+    for(i = 0; list_of_ips[i]; i++)
+    {
+        int bit;
+        int node = 0;
+        int prefix = 0;
+        unsigned int mask = ntohl(list_of_ips[i]->netmask);
+        unsigned int addr = ntohl(list_of_ips[i]->ip_address);
+
+        if((tree->first_negated < 0) && (list_of_ips[i]->ip[0] == '!'))
+        {
+            tree->first_negated = i;
+        }
+
+        while(prefix < 32 && (mask & (0x80000000 >> prefix)))
+        {
+            prefix++;
+        }
+
+        /* Netmask not contiguous */
+        if(prefix < 32 && (mask << prefix))
+        {
+            tree->others = realloc(tree->others, (others +2) * sizeof(int));
+            if(!tree->others)
+            {
+                ErrorExit(MEM_ERROR, __local_name);
+            }
+            tree->others[others++] = i;
+            tree->others[others] = -1;
+            continue;
+        }
+
+        for(bit = 0; bit < prefix; bit++)
+        {
+            node = _iptree_child(tree, node, (addr >> (31 - bit)) & 1);
+        }
+
+        if(tree->nodes[node].index < 0)
+        {
+            tree->nodes[node].index = i;
+        }
+    }
+
+    return(tree);
+}
+
+
+/** void OS_IPTreeFree(os_iptree *tree)
+ * Frees the tree (the list is not touched).
+ */
+void OS_IPTreeFree(os_iptree *tree)
+{
+    if(!tree)
+    {
+        return;
+    }
+
+    free(tree->nodes);
+    if(tree->others)
+    {
+        free(tree->others);
+    }
+    free(tree);
+}
+
+
+/** int OS_IPFoundTree(char *ip_address, os_iptree *tree)
+ * Same as OS_IPFoundList: the first entry of the list matching
+ * decides, and it is a match if no negated entry comes before
+ * (or is) it. Without any match, only a list with negated
+ * entries matches.
+ * Returns 1 on success or 0 on failure.
+ */
+int OS_IPFoundTree(char *ip_address, os_iptree *tree)
+{
+    return(OS_IPFoundTreeAddr(inet_addr(ip_address), tree));
+}
+
+
+/** int OS_IPFoundTreeAddr(unsigned int ip_address, os_iptree *tree)
+ * Same as OS_IPFoundTree, for an address already parsed
+ * (inet_addr, network order).
+ */
+int OS_IPFoundTreeAddr(unsigned int ip_address, os_iptree *tree)
+{
+    int i;
+    int bit;
+    int node = 0;
+    int first = -1;
+    unsigned int addr;
+
+    /* Invalid ip address */
+    if(ip_address == 0)
+    {
+        return(0);
+    }
+    addr = ntohl(ip_address);
+
+    /* Walking the prefixes of the address */
+    for(bit = 0; ; bit++)
+    {
+        int index = tree->nodes[node].index;
+
+        if((index >= 0) && ((first < 0) || (index < first)))
+        {
+            first = index;
+        }
+
+        if(bit == 32)
+        {
+            break;
+        }
+
+        node = tree->nodes[node].child[(addr >> (31 - bit)) & 1];
+        if(!node)
+        {
+            break;
+        }
+    }
+
+    for(i = 0; tree->others && tree->others[i] >= 0; i++)
+    {
+        os_ip *l_ip = tree->list[tree->others[i]];
+
+        if((first >= 0) && (tree->others[i] > first))
+        {
+            break;
+        }
+
+        if((ip_address & l_ip->netmask) == l_ip->ip_address)
+        {
+            first = tree->others[i];
+            break;
+        }
+    }
+
+
+    if(first >= 0)
+    {
+        return((tree->first_negated < 0) || (first < tree->first_negated));
+    }
+
+    return(tree->first_negated >= 0);
+}
+
+
 /** int OS_IsValidIP(char *ip)
  * Validates if an ip address is in the right
  * format.